@@ -11,6 +11,10 @@
 #define KLEE_CONSTRAINTS_H
 
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/Internal/ADT/PersistentVector.h"
+
+#include <vector>
 
 // FIXME: Currently we use ConstraintManager for two things: to pass
 // sets of constraints around, and to optimize constraints. We should
@@ -22,28 +26,61 @@ class ExprVisitor;
   
 class ConstraintManager {
 public:
-  typedef std::vector< ref<Expr> > constraints_ty;
-  typedef constraints_ty::iterator iterator;
+  /// The constraints are shared between copies, so copying a constraint
+  /// manager (say, when forking a state) takes constant time.
+  typedef PersistentVector< ref<Expr> > constraints_ty;
+  typedef constraints_ty::const_iterator iterator;
   typedef constraints_ty::const_iterator const_iterator;
 
-  ConstraintManager() {}
+  ConstraintManager() : constraintsHash(0), partitioned(false) {}
 
   // create from constraints with no optimization
   explicit
-  ConstraintManager(const std::vector< ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+  ConstraintManager(const std::vector< ref<Expr> > &_constraints)
+    : constraintsHash(0), partitioned(false) {
+    for (unsigned i = 0; i != _constraints.size(); ++i)
+      pushConstraint(_constraints[i]);
+  }
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+  ConstraintManager(const ConstraintManager &cs)
+    : constraints(cs.constraints),
+      constraintReads(cs.constraintReads),
+      constraintsHash(cs.constraintsHash),
+      equalities(cs.equalities),
+      readers(cs.readers),
+      partitioned(cs.partitioned),
+      factorParent(cs.factorParent),
+      factorMembers(cs.factorMembers),
+      byteReaders(cs.byteReaders),
+      wholeReaders(cs.wholeReaders) {}
 
-  typedef std::vector< ref<Expr> >::const_iterator constraint_iterator;
+  typedef constraints_ty::const_iterator constraint_iterator;
 
   // given a constraint which is known to be valid, attempt to 
   // simplify the existing constraint set
   void simplifyForValidConstraint(ref<Expr> e);
 
+  /// simplifyExpr - Replace the subexpressions of \a e which the
+  /// constraints fix: those a constraint (Eq constant x) fixes to the
+  /// constant, and the constraints themselves, which are true.
   ref<Expr> simplifyExpr(ref<Expr> e) const;
 
+  /// addConstraint - Add \a e to the constraints. An equality with a
+  /// constant is substituted into the constraints which contain its other
+  /// side; only the constraints which read what that side reads are
+  /// visited.
   void addConstraint(ref<Expr> e);
+
+  /// getIndependentConstraints - Find the constraints which \a e depends on:
+  /// those which read an array byte \a e reads, and transitively those
+  /// which read a byte any of them reads. They are returned in the order
+  /// they were added.
+  ///
+  /// The constraints are partitioned into such independent factors the
+  /// first time this is called, and the partition is then kept up to date
+  /// as constraints are added.
+  void getIndependentConstraints(ref<Expr> e,
+                                 std::vector< ref<Expr> > &result) const;
   
   bool empty() const {
     return constraints.empty();
@@ -61,20 +98,81 @@ public:
     return constraints.size();
   }
 
+  /// hash - A hash of the constraints which does not depend on their
+  /// order, kept up to date as they are added.
+  unsigned hash() const {
+    return constraintsHash;
+  }
+
   bool operator==(const ConstraintManager &other) const {
-    return constraints == other.constraints;
+    if (constraints.sharesWith(other.constraints))
+      return true;
+    if (constraintsHash != other.constraintsHash ||
+        constraints.size() != other.constraints.size())
+      return false;
+    for (const_iterator it = begin(), ie = end(), it2 = other.begin();
+         it != ie; ++it, ++it2)
+      if (*it != *it2)
+        return false;
+    return true;
   }
   
   /// Dump the contents of this constraint set for debugging purposes.
   void dump(std::ostream &out) const;
 
 private:
-  std::vector< ref<Expr> > constraints;
+  /// ReadKey - An array byte which is read at a constant index, or, with
+  /// the index ~0U, an array which is read at a symbolic one.
+  typedef std::pair<const Array*, unsigned> ReadKey;
+
+  /// ConstraintReads - The (sorted) array bytes a constraint reads, shared
+  /// between copies so that rebuilding the indices below does not visit
+  /// the constraints again.
+  struct ConstraintReads {
+    unsigned refCount;
+    std::vector<ReadKey> keys;
+
+    ConstraintReads() : refCount(0) {}
+  };
+
+  constraints_ty constraints;
+  /// The array bytes each constraint reads.
+  PersistentVector< ref<ConstraintReads> > constraintReads;
+  /// The sum of the hashes of the constraints.
+  unsigned constraintsHash;
+  /// The substitutions simplifyExpr makes, from the first constraint which
+  /// fixes each expression.
+  ImmutableMap< ref<Expr>, ref<Expr> > equalities;
+  /// The indices of the constraints reading each array byte.
+  ImmutableMap< ReadKey, PersistentVector<unsigned> > readers;
+
+  /// Whether the partition below is valid. Like the indices above, it is
+  /// kept in persistent maps, which copies share.
+  mutable bool partitioned;
+  /// A union-find forest over the constraint indices, whose trees are the
+  /// independent factors, from each constraint which is not a root to its
+  /// parent. Trees are joined by size and never compressed (which would
+  /// change shared maps), so they are O(log n) deep.
+  mutable ImmutableMap<unsigned, unsigned> factorParent;
+  /// The members of each factor, by the root of its tree.
+  mutable ImmutableMap<unsigned, PersistentVector<unsigned> > factorMembers;
+  /// A constraint reading each array byte at a constant index, for the
+  /// arrays no constraint reads at a symbolic index.
+  mutable ImmutableMap<ReadKey, unsigned> byteReaders;
+  /// A constraint reading each array at a symbolic index.
+  mutable ImmutableMap<const Array*, unsigned> wholeReaders;
 
   // returns true iff the constraints were modified
-  bool rewriteConstraints(ExprVisitor &visitor);
+  bool rewriteConstraints(ExprVisitor &visitor, ref<Expr> target);
 
   void addConstraintInternal(ref<Expr> e);
+  void pushConstraint(ref<Expr> e);
+  void pushConstraint(ref<Expr> e, const ref<ConstraintReads> &reads);
+  void getReaders(ref<Expr> e, std::vector<unsigned> &result) const;
+
+  unsigned findFactor(unsigned index) const;
+  void unionFactors(unsigned a, unsigned b) const;
+  void addToPartition(unsigned index) const;
 };
 
 }
@@ -94,6 +94,14 @@ public:
   /// Disables forking, set by user code.
   bool forkDisabled;
 
+  /// The branch condition of a lazily forked state, not yet known to be
+  /// feasible nor added to the constraints; null otherwise.
+  ref<Expr> pendingCondition;
+  /// The branch a lazily forked state took a side of, whose coverage is
+  /// marked once pendingCondition is known to be feasible, and the side.
+  KInstruction *pendingBranch;
+  bool pendingBranchTrue;
+
 
   mutable double queryCost;
   double weight;
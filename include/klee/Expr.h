@@ -10,6 +10,8 @@
 #ifndef KLEE_EXPR_H
 #define KLEE_EXPR_H
 
+#include "klee/ExprContext.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
 #include "klee/util/Bits.h"
 #include "klee/util/Ref.h"
 
@@ -31,6 +33,9 @@ namespace klee {
 class Array;
 class ConstantExpr;
 class ObjectState;
+class ValueFacts;
+
+void destroyValueFacts(ValueFacts *facts);
 
 template<class T> class ref;
 
@@ -223,10 +228,28 @@ public:
 
 protected:  
   unsigned hashValue;
+
+private:
+  friend const ValueFacts &getValueFacts(const Expr *e);
+
+  /// The facts about the value of this expression, once computed.
+  mutable ValueFacts *facts;
   
 public:
-  Expr() : refCount(0) { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  Expr() : refCount(0), facts(0) { Expr::count++; }
+  virtual ~Expr() {
+    Expr::count--;
+    ExprContext::get().remove(this, hashValue);
+    if (facts)
+      destroyValueFacts(facts);
+  }
+
+  static void *operator new(size_t size) {
+    return ExprContext::get().allocate(size);
+  }
+  static void operator delete(void *p, size_t size) {
+    ExprContext::get().deallocate(p, size);
+  }
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -248,13 +271,11 @@ public:
   /// Returns the hash value. 
   virtual unsigned computeHash();
   
-  /// Returns 0 iff b is structuraly equivalent to *this
-  typedef llvm::DenseSet<std::pair<const Expr *, const Expr *> > ExprEquivSet;
-  int compare(const Expr &b, ExprEquivSet &equivs) const;
-  int compare(const Expr &b) const {
-    ExprEquivSet equivs;
-    return compare(b, equivs);
-  }
+  /// Returns 0 iff b is structuraly equivalent to *this, which (since
+  /// expressions are hash-consed) is iff b is *this.
+  int compare(const Expr &b) const;
+  /// Compare the parts of an expression of the same kind which are not
+  /// kids; expressions are interned by these and their kids.
   virtual int compareContents(const Expr &b) const { return 0; }
 
   // Given an array of new kids return a copy of the expression
@@ -358,6 +379,8 @@ inline std::ostream &operator<<(std::ostream &os, const Expr::Kind kind) {
 // Terminal Exprs
 
 class ConstantExpr : public Expr {
+  friend class ExprContext;
+
 public:
   static const Kind kind = Constant;
   static const unsigned numKids = 0;
@@ -385,6 +408,10 @@ public:
   /// native ConstantExpr APIs.
   const llvm::APInt &getAPValue() const { return value; }
 
+  /// isFloat - Return true if the constant was created from a floating point
+  /// value.
+  bool isFloat() const { return IsFloat; }
+
   /// getAPFloatValue - Return the value bitcast as an APFloat.
   ///
   /// The overloads will either use the built in semantics (IsIEEE) or
@@ -439,9 +466,12 @@ public:
   void toMemory(void *address);
 
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
-    ref<ConstantExpr> r(new ConstantExpr(v));
-    r->computeHash();
-    return r;
+    if (v.getBitWidth() <= 64)
+      if (ConstantExpr *ce =
+            ExprContext::get().getSmallConstant(v.getZExtValue(),
+                                                v.getBitWidth()))
+        return ce;
+    return ExprContext::get().intern(new ConstantExpr(v));
   }
 
   static ref<ConstantExpr> alloc(const llvm::APFloat &f) {
@@ -453,6 +483,8 @@ public:
   }
 
   static ref<ConstantExpr> alloc(uint64_t v, Width w) {
+    if (ConstantExpr *ce = ExprContext::get().getSmallConstant(v, w))
+      return ce;
     return alloc(llvm::APInt(w, v));
   }
   
@@ -563,6 +595,11 @@ class BinaryExpr : public NonConstantExpr {
 public:
   ref<Expr> left, right;
 
+private:
+  /// The width of left, kept so that getWidth does not walk down chains of
+  /// binary expressions.
+  Width width;
+
 public:
   unsigned getNumKids() const { return 2; }
   ref<Expr> getKid(unsigned i) const { 
@@ -572,10 +609,11 @@ public:
       return right;
     return 0;
   }
-  Width getWidth() const { return left->getWidth(); }
+  Width getWidth() const { return width; }
  
 protected:
-  BinaryExpr(const ref<Expr> &l, const ref<Expr> &r) : left(l), right(r) {}
+  BinaryExpr(const ref<Expr> &l, const ref<Expr> &r)
+    : left(l), right(r), width(l->getWidth()) {}
 
 public:
   static bool classof(const Expr *E) {
@@ -599,6 +637,12 @@ public:
   bool isIEEE() const { return IsIEEE; }
   FPCategories getCategories(bool isIEEE) const;
 
+  int compareContents(const Expr &b) const {
+    const FBinaryExpr &eb = static_cast<const FBinaryExpr&>(b);
+    if (IsIEEE != eb.IsIEEE) return IsIEEE < eb.IsIEEE ? -1 : 1;
+    return 0;
+  }
+
 protected:
   virtual FPCategories _getCategories() const = 0;
 };
@@ -638,6 +682,13 @@ public:
   }
   static bool classof(const FCmpExpr *) { return true; }
   bool isIEEE() const { return IsIEEE; }
+
+  int compareContents(const Expr &b) const {
+    const FCmpExpr &eb = static_cast<const FCmpExpr&>(b);
+    if (IsIEEE != eb.IsIEEE) return IsIEEE < eb.IsIEEE ? -1 : 1;
+    return 0;
+  }
+
   unsigned getNumKids() const { return 3; }
   ref<Expr> getKid(unsigned i) const { 
     if (i == 2)
@@ -645,9 +696,7 @@ public:
     return CmpExpr::getKid(i);
   }
   static ref<Expr> alloc (const ref<Expr> &l, const ref<Expr> &r, const ref<Expr> &pred, bool IsIEEE) {
-    ref<Expr> res(new FCmpExpr(l, r, pred, IsIEEE));
-    res->computeHash();
-    return res;
+    return ExprContext::get().intern(new FCmpExpr(l, r, pred, IsIEEE));
   }
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r, const ref<Expr> &pred, bool IsIEEE);
   Kind getKind() const { return FCmp; }
@@ -684,9 +733,7 @@ public:
   ref<Expr> src;
 
   static ref<Expr> alloc(const ref<Expr> &src) {
-    ref<Expr> r(new NotOptimizedExpr(src));
-    r->computeHash();
-    return r;
+    return ExprContext::get().intern(new NotOptimizedExpr(src));
   }
   
   static ref<Expr> create(ref<Expr> src);
@@ -713,11 +760,8 @@ public:
 /// Class representing a byte update of an array.
 class UpdateNode {
   friend class UpdateList;
-  friend class STPBuilder; // for setting STPArray
 
   mutable unsigned refCount;
-  // gross
-  mutable void *stpArray;
   // cache instead of recalc
   unsigned hashValue;
 
@@ -728,6 +772,21 @@ public:
 private:
   /// size of this update sequence, including this update
   unsigned size;
+  /// The number of consecutive updates at concrete indices, starting with
+  /// this one.
+  unsigned concreteSize;
+
+  /// Whether the index below has been built.
+  mutable bool indexed;
+  /// The latest update at each index among the concreteSize updates
+  /// starting with this one. It shares its structure with the index of
+  /// the next update.
+  mutable ImmutableMap<uint64_t, const UpdateNode*> concreteWrites;
+  /// The number of indices in concreteWrites.
+  mutable unsigned numConcreteIndices;
+  /// The update following the concreteSize updates starting with this
+  /// one, or null if there is none.
+  mutable const UpdateNode *concreteEnd;
   
 public:
   UpdateNode(const UpdateNode *_next, 
@@ -736,14 +795,23 @@ public:
 
   unsigned getSize() const { return size; }
 
+  /// findConcreteWrite - Find the latest update at the concrete index \a
+  /// index among the consecutive updates at concrete indices starting
+  /// with this one, which is the update a read at \a index resolves to if
+  /// there is one. \a rest is set to the update following them.
+  const UpdateNode *findConcreteWrite(uint64_t index,
+                                      const UpdateNode *&rest) const;
+
   int compare(const UpdateNode &b) const;  
   unsigned hash() const { return hashValue; }
 
 private:
-  UpdateNode() : refCount(0), stpArray(0) {}
+  UpdateNode() : refCount(0), concreteSize(0), indexed(false),
+                 numConcreteIndices(0), concreteEnd(0) {}
   ~UpdateNode();
 
   unsigned computeHash();
+  void buildIndex() const;
 };
 
 class Array {
@@ -757,9 +825,6 @@ public:
   /// the array size.
   const std::vector< ref<ConstantExpr> > constantValues;
 
-  // FIXME: This does not belong here.
-  mutable void *stpInitialArray;
-
   Expr::Width domain, range;
 
 public:
@@ -776,7 +841,7 @@ public:
         Expr::Width _domain = Expr::Int32, Expr::Width _range = Expr::Int8)
     : name(_name), size(_size), 
       constantValues(constantValuesBegin, constantValuesEnd), 
-      stpInitialArray(0), domain(_domain), range(_range) {
+      domain(_domain), range(_range) {
     assert((isSymbolicArray() || constantValues.size() == size) &&
            "Invalid size for constant array!");
 #ifdef NDEBUG
@@ -815,10 +880,16 @@ public:
   /// size of this update list
   unsigned getSize() const { return (head ? head->getSize() : 0); }
   
+  /// extend - Add an update at the head. Once most of the updates at
+  /// concrete indices at the head are overwritten by later ones, they are
+  /// dropped (and the rest copied).
   void extend(const ref<Expr> &index, const ref<Expr> &value);
 
   int compare(const UpdateList &b) const;
   unsigned hash() const;
+
+private:
+  void compact();
 };
 
 /// Class representing a one byte read from an array. 
@@ -833,9 +904,7 @@ public:
 
 public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
-    ref<Expr> r(new ReadExpr(updates, index));
-    r->computeHash();
-    return r;
+    return ExprContext::get().intern(new ReadExpr(updates, index));
   }
   
   static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -875,17 +944,20 @@ public:
 public:
   ref<Expr> cond, trueExpr, falseExpr;
 
+private:
+  /// The width of trueExpr, kept so that getWidth does not walk down
+  /// chains of selects.
+  Width width;
+
 public:
   static ref<Expr> alloc(const ref<Expr> &c, const ref<Expr> &t, 
                          const ref<Expr> &f) {
-    ref<Expr> r(new SelectExpr(c, t, f));
-    r->computeHash();
-    return r;
+    return ExprContext::get().intern(new SelectExpr(c, t, f));
   }
   
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
 
-  Width getWidth() const { return trueExpr->getWidth(); }
+  Width getWidth() const { return width; }
   Kind getKind() const { return Select; }
 
   unsigned getNumKids() const { return numKids; }
@@ -911,7 +983,7 @@ public:
 
 private:
   SelectExpr(const ref<Expr> &c, const ref<Expr> &t, const ref<Expr> &f) 
-    : cond(c), trueExpr(t), falseExpr(f) {}
+    : cond(c), trueExpr(t), falseExpr(f), width(t->getWidth()) {}
 
 public:
   static bool classof(const Expr *E) {
@@ -935,9 +1007,7 @@ private:
 
 public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
-    ref<Expr> c(new ConcatExpr(l, r));
-    c->computeHash();
-    return c;
+    return ExprContext::get().intern(new ConcatExpr(l, r));
   }
   
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -994,9 +1064,7 @@ public:
 
 public:  
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
-    ref<Expr> r(new ExtractExpr(e, o, w));
-    r->computeHash();
-    return r;
+    return ExprContext::get().intern(new ExtractExpr(e, o, w));
   }
   
   /// Creates an ExtractExpr with the given bit offset and width
@@ -1045,9 +1113,7 @@ public:
 
 public:  
   static ref<Expr> alloc(const ref<Expr> &e) {
-    ref<Expr> r(new NotExpr(e));
-    r->computeHash();
-    return r;
+    return ExprContext::get().intern(new NotExpr(e));
   }
   
   static ref<Expr> create(const ref<Expr> &e);
@@ -1122,9 +1188,7 @@ public:                                                          \
 public:                                                          \
     _class_kind ## Expr(ref<Expr> e, Width w) : CastExpr(e,w) {} \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
-      ref<Expr> r(new _class_kind ## Expr(e, w));                \
-      r->computeHash();                                          \
-      return r;                                                  \
+      return ExprContext::get().intern(new _class_kind ## Expr(e, w)); \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -1224,6 +1288,8 @@ public:
     const F2IConvertExpr &eb = static_cast<const F2IConvertExpr&>(b);
     if (width != eb.width) return width < eb.width ? -1 : 1;
     if (FromIsIEEE != eb.FromIsIEEE) return FromIsIEEE < eb.FromIsIEEE ? -1 : 1;
+    if (RoundNearest != eb.RoundNearest)
+      return RoundNearest < eb.RoundNearest ? -1 : 1;
     return 0;
   }
 
@@ -1242,9 +1308,7 @@ public:                                                              \
 public:                                                              \
     _class_kind ## Expr _expr_decl : _base_class _expr_ref {}        \
     static ref<Expr> alloc _expr_decl {                              \
-      ref<Expr> res(new _class_kind ## Expr _expr_ref);              \
-      res->computeHash();                                            \
-      return res;                                                    \
+      return ExprContext::get().intern(new _class_kind ## Expr _expr_ref); \
     }                                                                \
     static ref<Expr> create _expr_decl;                              \
     Kind getKind() const { return _class_kind; }                     \
@@ -1297,13 +1361,17 @@ public:
   Kind getKind() const { return FOrd1; }
   static ref<Expr> create(const ref<Expr> &e, bool isIEEE);
   static ref<Expr> alloc(const ref<Expr> &e, bool isIEEE) {
-    ref<Expr> r(new FOrd1Expr(e, isIEEE));
-    r->computeHash();
-    return r;
+    return ExprContext::get().intern(new FOrd1Expr(e, isIEEE));
   }
 
   unsigned getNumKids() const { return 1; }
   ref<Expr> getKid(unsigned i) const { return (i==0) ? src : 0; }
+
+  int compareContents(const Expr &b) const {
+    const FOrd1Expr &eb = static_cast<const FOrd1Expr&>(b);
+    if (IsIEEE != eb.IsIEEE) return IsIEEE < eb.IsIEEE ? -1 : 1;
+    return 0;
+  }
   
   virtual ref<Expr> rebuild(ref<Expr> kids[]) const {
     return create(kids[0], IsIEEE);
@@ -1329,6 +1397,12 @@ public:
 
   unsigned getNumKids() const { return 1; }
   ref<Expr> getKid(unsigned i) const { return (i==0) ? src : 0; }
+
+  int compareContents(const Expr &b) const {
+    const FUnaryExpr &eb = static_cast<const FUnaryExpr&>(b);
+    if (IsIEEE != eb.IsIEEE) return IsIEEE < eb.IsIEEE ? -1 : 1;
+    return 0;
+  }
 };
 
 #define FUNARY_EXPR_CLASS(_class_kind) \
@@ -1358,6 +1432,13 @@ public:
 
   uint64_t getKey() const { return key; }
 
+  int compareContents(const Expr &b) const {
+    const AnyExpr &eb = static_cast<const AnyExpr&>(b);
+    if (width != eb.width) return width < eb.width ? -1 : 1;
+    if (key != eb.key) return key < eb.key ? -1 : 1;
+    return 0;
+  }
+
   unsigned getNumKids() const { return 0; }
   ref<Expr> getKid(unsigned i) const { return 0; }
 
@@ -1368,9 +1449,7 @@ public:
 
   static ref<Expr> create(Width width, uint64_t key = -1ULL);
   static ref<Expr> alloc(Width width, uint64_t key) {
-    ref<Expr> r(new AnyExpr(width, key));
-    r->computeHash();
-    return r;
+    return ExprContext::get().intern(new AnyExpr(width, key));
   }
 
   static bool classof(const Expr *E) {
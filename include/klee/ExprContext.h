@@ -0,0 +1,206 @@
+//===-- ExprContext.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRCONTEXT_H
+#define KLEE_EXPRCONTEXT_H
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <tr1/unordered_map>
+
+#include <stdint.h>
+
+namespace klee {
+  class Array;
+  class ConstantExpr;
+  class Expr;
+  class ExprBuilder;
+  class UpdateNode;
+
+  /// ExprCache - Data derived from expressions, update lists or arrays, such
+  /// as a solver's translation of them, kept outside of them.
+  ///
+  /// A cache registers with the ExprContext, which tells it when an update
+  /// node or array is destroyed (so it can drop what it keeps for it) and
+  /// can clear every cache at once.
+  class ExprCache {
+  public:
+    virtual ~ExprCache() {}
+
+    /// clear - Drop everything kept.
+    virtual void clear() = 0;
+
+    /// forgetUpdate - \a un is being destroyed.
+    virtual void forgetUpdate(const UpdateNode *un) {}
+
+    /// forgetArray - \a array is being destroyed.
+    virtual void forgetArray(const Array *array) {}
+  };
+
+  /// ExprContext - The state shared by all expressions.
+  ///
+  /// Expressions are hash-consed: every expression is allocated through
+  /// intern, which returns the existing expression if an equal one is
+  /// alive. Structurally equal expressions are therefore the same object,
+  /// so they are compared by pointer and stored only once.
+  ///
+  /// The context also allocates expressions, from arenas of fixed size
+  /// blocks, and keeps the small constants of the common widths alive in
+  /// tables, so that they are never allocated again.
+  ///
+  /// Finally it owns the builder clients should construct expressions with,
+  /// so an optimizing builder can be installed for the whole program, and
+  /// keeps track of the caches derived from expressions (see ExprCache).
+  class ExprContext {
+  public:
+    /// The bound below which constants are kept in the tables.
+    enum { SmallConstantLimit = 256 };
+
+  private:
+    typedef std::tr1::unordered_multimap<unsigned, Expr*> UniqueTable;
+
+    enum {
+      /// The arena block sizes are multiples of Granularity, up to (but
+      /// not including) NumSizeClasses * Granularity.
+      Granularity = 8,
+      NumSizeClasses = 16,
+      SlabSize = 64 * 1024,
+      /// The widths with constant tables: Bool, Int8, Int16, Int32 and
+      /// Int64.
+      NumSmallConstantWidths = 5
+    };
+
+    /// The live expressions, by hash.
+    UniqueTable uniqueTable;
+
+    /// The freed blocks of each size class, linked through their first
+    /// word.
+    void *freeLists[NumSizeClasses];
+    /// The unused part of the slab blocks are carved from.
+    char *slabCur, *slabEnd;
+
+    /// The small constants, created on first use and never freed.
+    ConstantExpr *smallConstants[NumSmallConstantWidths][SmallConstantLimit];
+
+    /// The builder, or null if the default one has not been created yet.
+    ExprBuilder *builder;
+
+    std::vector<ExprCache*> caches;
+
+    ExprContext() : slabCur(0), slabEnd(0), builder(0) {
+      memset(freeLists, 0, sizeof freeLists);
+      memset(smallConstants, 0, sizeof smallConstants);
+    }
+    ExprContext(const ExprContext&);
+    void operator=(const ExprContext&);
+
+    Expr *internExpr(Expr *e);
+    void *allocateSlow(size_t size);
+    ConstantExpr *createSmallConstant(uint64_t value, unsigned width);
+
+  public:
+    /// get - Return the context. It is never destroyed, so expressions may
+    /// outlive static destructors.
+    static ExprContext &get() {
+      static ExprContext *context = new ExprContext();
+      return *context;
+    }
+
+    /// intern - Return the expression equal to \a e, which must have just
+    /// been allocated and not yet referenced. If there is none \a e itself
+    /// is returned, otherwise it is deleted.
+    template<class T>
+    T *intern(T *e) {
+      return static_cast<T*>(internExpr(e));
+    }
+
+    /// remove - Forget \a e, which is being destroyed; \a hash is its hash.
+    void remove(const Expr *e, unsigned hash);
+
+    /// getNumExprs - The number of live expressions.
+    unsigned getNumExprs() const { return uniqueTable.size(); }
+
+    /// allocate - Allocate \a size bytes for an expression.
+    void *allocate(size_t size) {
+      size_t sizeClass = (size + Granularity - 1) / Granularity;
+      if (sizeClass < NumSizeClasses && freeLists[sizeClass]) {
+        void *res = freeLists[sizeClass];
+        freeLists[sizeClass] = *(void**) res;
+        return res;
+      }
+      return allocateSlow(size);
+    }
+
+    /// deallocate - Free the \a size bytes at \a p, from allocate.
+    void deallocate(void *p, size_t size) {
+      size_t sizeClass = (size + Granularity - 1) / Granularity;
+      if (sizeClass < NumSizeClasses) {
+        *(void**) p = freeLists[sizeClass];
+        freeLists[sizeClass] = p;
+      } else {
+        ::operator delete(p);
+      }
+    }
+
+    /// getSmallConstant - Return the constant of width \a width with value
+    /// \a value if it is kept in a table, and null otherwise.
+    ConstantExpr *getSmallConstant(uint64_t value, unsigned width) {
+      if (value >= SmallConstantLimit)
+        return 0;
+
+      unsigned index;
+      switch (width) {
+      case 1: index = 0; break;
+      case 8: index = 1; break;
+      case 16: index = 2; break;
+      case 32: index = 3; break;
+      case 64: index = 4; break;
+      default: return 0;
+      }
+      if (width < 8 && (value >> width))
+        return 0;
+
+      ConstantExpr *&res = smallConstants[index][value];
+      if (!res)
+        res = createSmallConstant(value, width);
+      return res;
+    }
+
+    /// getBuilder - Return the builder to construct expressions with; the
+    /// default builder unless another was installed.
+    ExprBuilder &getBuilder();
+
+    /// setBuilder - Install \a b as the builder, taking ownership of it. The
+    /// previous builder is deleted.
+    void setBuilder(ExprBuilder *b);
+
+    /// registerCache - Notify \a cache of the destruction of update nodes
+    /// and arrays, and clear it with the others, until it is unregistered.
+    void registerCache(ExprCache *cache) { caches.push_back(cache); }
+    void unregisterCache(ExprCache *cache);
+
+    /// clearCaches - Clear every registered cache, freeing what is derived
+    /// from the expressions built so far.
+    void clearCaches();
+
+    void forgetUpdate(const UpdateNode *un) {
+      for (unsigned i = 0, e = caches.size(); i != e; ++i)
+        caches[i]->forgetUpdate(un);
+    }
+
+    void forgetArray(const Array *array) {
+      for (unsigned i = 0, e = caches.size(); i != e; ++i)
+        caches[i]->forgetArray(array);
+    }
+  };
+}
+
+#endif
@@ -11,6 +11,7 @@
 #define __UTIL_MAPOFSETS_H__
 
 #include <cassert>
+#include <stdint.h>
 #include <vector>
 #include <set>
 #include <map>
@@ -24,6 +25,14 @@
 
 namespace klee {
 
+  /// MapOfSetsTraits - How elements are summarized in the signatures used to
+  /// prune superset searches. Each element should map to a word with one
+  /// (pseudo-random) bit set; the default of no bits prunes nothing.
+  template<class K>
+  struct MapOfSetsTraits {
+    static uint64_t getSignature(const K &) { return 0; }
+  };
+
   /** This implements the UBTree data structure (see Hoffmann and
       Koehler, "A New Method to Index and Query Sets", IJCAI 1999) */
   template<class K, class V>
@@ -53,10 +62,24 @@ namespace klee {
     template<class Predicate>
     V *findSubset(const std::set<K> &set, const Predicate &p);
 
+    /// setLookupLimit - Give up findSuperset and findSubset searches after
+    /// visiting this many nodes; 0 is unlimited.
+    void setLookupLimit(unsigned limit) { lookupLimit = limit; }
+
+    /// getLookupNodes - The number of nodes visited by the last findSuperset
+    /// or findSubset search.
+    unsigned getLookupNodes() const { return lookupNodes; }
+
   private:
     class Node;
 
     Node root;
+    unsigned lookupLimit;
+    unsigned lookupNodes;
+
+    bool visitNode() { return ++lookupNodes <= lookupLimit || !lookupLimit; }
+    static void getSignatures(const std::set<K> &set,
+                              std::vector<uint64_t> &result);
 
     template<class Iterator, class Vector>
     void findSubsets(Node *n, 
@@ -74,6 +97,7 @@ namespace klee {
     V *findSuperset(Node *n, 
                     typename std::set<K>::iterator begin, 
                     typename std::set<K>::iterator end,
+                    const uint64_t *need,
                     const Predicate &p);
     template<class Predicate>
     V *findSubset(Node *n, 
@@ -96,10 +120,12 @@ namespace klee {
 
   private:
     bool isEndOfSet;
+    /// The union of the signatures of the elements below this node.
+    uint64_t signature;
     std::map<K, Node> children;
     
   public:
-    Node() : isEndOfSet(false) {}
+    Node() : isEndOfSet(false), signature(0) {}
   };
   
   template<class K, class V>
@@ -182,14 +208,31 @@ namespace klee {
   /***/
 
   template<class K, class V>
-  MapOfSets<K,V>::MapOfSets() {}  
+  MapOfSets<K,V>::MapOfSets() : lookupLimit(0), lookupNodes(0) {}  
+
+  /// getSignatures - Compute the signature of each suffix of \a set, followed
+  /// by that of the empty suffix.
+  template<class K, class V>
+  void MapOfSets<K,V>::getSignatures(const std::set<K> &set,
+                                     std::vector<uint64_t> &result) {
+    result.assign(set.size() + 1, 0);
+    unsigned i = set.size();
+    for (typename std::set<K>::const_reverse_iterator it = set.rbegin(),
+           ie = set.rend(); it != ie; ++it, --i)
+      result[i - 1] = result[i] | MapOfSetsTraits<K>::getSignature(*it);
+  }
 
   template<class K, class V>
   void MapOfSets<K,V>::insert(const std::set<K> &set, const V &value) {
+    std::vector<uint64_t> signatures;
+    getSignatures(set, signatures);
     Node *n = &root;
+    unsigned i = 0;
     for (typename std::set<K>::const_iterator it = set.begin(), ie = set.end();
-         it != ie; ++it)
+         it != ie; ++it, ++i) {
+      n->signature |= signatures[i];
       n = &n->children.insert(std::make_pair(*it, Node())).first->second;
+    }
     n->isEndOfSet = true;
     n->value = value;
   }
@@ -298,6 +341,8 @@ namespace klee {
                                 typename std::set<K>::iterator begin, 
                                 typename std::set<K>::iterator end,
                                 const Predicate &p) {   
+    if (!visitNode())
+      return 0;
     if (n->isEndOfSet && p(n->value)) {
       return &n->value;
     } else if (begin==end) {
@@ -335,26 +380,31 @@ namespace klee {
   V *MapOfSets<K,V>::findSuperset(Node *n, 
                                   typename std::set<K>::iterator begin, 
                                   typename std::set<K>::iterator end,
+                                  const uint64_t *need,
                                   const Predicate &p) {   
+    // The elements still to be matched must all be below this node.
+    if ((n->signature & *need) != *need || !visitNode())
+      return 0;
     if (begin==end) {
       if (n->isEndOfSet && p(n->value))
         return &n->value;
       for (typename Node::children_ty::iterator it = n->children.begin(),
              ie = n->children.end(); it != ie; ++it) {
-        V *res = findSuperset(&it->second, begin, end, p);
+        V *res = findSuperset(&it->second, begin, end, need, p);
         if (res) return res;
       }
     } else {
-      typename Node::children_ty::iterator kbegin = n->children.begin();
+      // Sets are stored in order, so only the children before the next
+      // element can lead to it.
       typename Node::children_ty::iterator kmid = 
         n->children.lower_bound(*begin);
-      for (typename Node::children_ty::iterator it = n->children.begin(),
-             ie = n->children.end(); it != ie; ++it) {
-        V *res = findSuperset(&it->second, begin, end, p);
+      for (typename Node::children_ty::iterator it = n->children.begin();
+           it != kmid; ++it) {
+        V *res = findSuperset(&it->second, begin, end, need, p);
         if (res) return res;
       }
       if (kmid!=n->children.end() && *begin==kmid->first) {
-        V *res = findSuperset(&kmid->second, ++begin, end, p);
+        V *res = findSuperset(&kmid->second, ++begin, end, need + 1, p);
         if (res) return res;
       }
     }
@@ -364,18 +414,23 @@ namespace klee {
   template<class K, class V>
   template<class Predicate>
   V *MapOfSets<K,V>::findSuperset(const std::set<K> &set, const Predicate &p) {    
-    return findSuperset(&root, set.begin(), set.end(), p);
+    std::vector<uint64_t> signatures;
+    getSignatures(set, signatures);
+    lookupNodes = 0;
+    return findSuperset(&root, set.begin(), set.end(), &signatures[0], p);
   }
 
   template<class K, class V>
   template<class Predicate>
   V *MapOfSets<K,V>::findSubset(const std::set<K> &set, const Predicate &p) {    
+    lookupNodes = 0;
     return findSubset(&root, set.begin(), set.end(), p);
   }
 
   template<class K, class V>
   void MapOfSets<K,V>::clear() {
     root.isEndOfSet = false;
+    root.signature = 0;
     root.value = V();
     root.children.clear();
   }
@@ -0,0 +1,212 @@
+//===-- PersistentVector.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_PERSISTENTVECTOR_H__
+#define __UTIL_PERSISTENTVECTOR_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+namespace klee {
+
+  /// PersistentVector - A vector which can be copied in constant time.
+  ///
+  /// The elements are kept in a tree of reference counted nodes, each with
+  /// up to Width children or (at the leaves) elements. Copies share the
+  /// tree; appending copies only the nodes on the path to the last leaf
+  /// which are shared, and updates the others in place. Indexing takes
+  /// O(log n) time, and iterating O(1) per element.
+  template<class T>
+  class PersistentVector {
+    enum { Bits = 5, Width = 1 << Bits, Mask = Width - 1 };
+
+    struct Node {
+      unsigned refCount;
+      std::vector<Node*> children;
+      std::vector<T> values;
+
+      Node() : refCount(1) {}
+    };
+
+    Node *root;
+    /// The bit offset of the index into the root's children; 0 if the root
+    /// is a leaf.
+    unsigned shift;
+    size_t count;
+
+    static void release(Node *n) {
+      if (n && --n->refCount == 0) {
+        for (unsigned i = 0; i != n->children.size(); ++i)
+          release(n->children[i]);
+        delete n;
+      }
+    }
+
+    /// makeUnique - Return a node we may change in place, in place of \a n.
+    static Node *makeUnique(Node *n) {
+      if (n->refCount == 1)
+        return n;
+      Node *res = new Node(*n);
+      res->refCount = 1;
+      for (unsigned i = 0; i != res->children.size(); ++i)
+        ++res->children[i]->refCount;
+      --n->refCount;
+      return res;
+    }
+
+    static Node *newPath(unsigned level, const T &value) {
+      Node *n = new Node();
+      if (level == 0)
+        n->values.push_back(value);
+      else
+        n->children.push_back(newPath(level - Bits, value));
+      return n;
+    }
+
+    static Node *pushInto(Node *n, unsigned level, size_t index,
+                          const T &value) {
+      n = makeUnique(n);
+      if (level == 0) {
+        n->values.push_back(value);
+      } else {
+        unsigned sub = (index >> level) & Mask;
+        if (sub < n->children.size())
+          n->children[sub] = pushInto(n->children[sub], level - Bits, index,
+                                      value);
+        else
+          n->children.push_back(newPath(level - Bits, value));
+      }
+      return n;
+    }
+
+    const Node *getLeaf(size_t index) const {
+      assert(index < count && "index out of range");
+      const Node *n = root;
+      for (unsigned level = shift; level; level -= Bits)
+        n = n->children[(index >> level) & Mask];
+      return n;
+    }
+
+  public:
+    class const_iterator {
+      friend class PersistentVector;
+
+      const PersistentVector *v;
+      size_t index;
+      /// The leaf holding the current element, once it has been looked up.
+      mutable const Node *leaf;
+
+      const_iterator(const PersistentVector *_v, size_t _index)
+        : v(_v), index(_index), leaf(0) {}
+
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef T value_type;
+      typedef ptrdiff_t difference_type;
+      typedef const T *pointer;
+      typedef const T &reference;
+
+      const_iterator() : v(0), index(0), leaf(0) {}
+
+      const T &operator*() const {
+        if (!leaf)
+          leaf = v->getLeaf(index);
+        return leaf->values[index & Mask];
+      }
+      const T *operator->() const { return &**this; }
+
+      const_iterator &operator++() {
+        if (!(++index & Mask))
+          leaf = 0;
+        return *this;
+      }
+      const_iterator operator++(int) {
+        const_iterator res = *this;
+        ++*this;
+        return res;
+      }
+
+      bool operator==(const const_iterator &b) const {
+        return index == b.index && v == b.v;
+      }
+      bool operator!=(const const_iterator &b) const {
+        return !(*this == b);
+      }
+    };
+
+    PersistentVector() : root(0), shift(0), count(0) {}
+    PersistentVector(const PersistentVector &b)
+      : root(b.root), shift(b.shift), count(b.count) {
+      if (root)
+        ++root->refCount;
+    }
+    ~PersistentVector() { release(root); }
+
+    PersistentVector &operator=(const PersistentVector &b) {
+      if (b.root)
+        ++b.root->refCount;
+      release(root);
+      root = b.root;
+      shift = b.shift;
+      count = b.count;
+      return *this;
+    }
+
+    void swap(PersistentVector &b) {
+      std::swap(root, b.root);
+      std::swap(shift, b.shift);
+      std::swap(count, b.count);
+    }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    const T &operator[](size_t index) const {
+      return getLeaf(index)->values[index & Mask];
+    }
+    const T &back() const { return (*this)[count - 1]; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+    /// sharesWith - Whether both vectors are copies of each other.
+    bool sharesWith(const PersistentVector &b) const {
+      return root == b.root && count == b.count;
+    }
+
+    void push_back(const T &value) {
+      if (!root) {
+        root = newPath(0, value);
+      } else if (count == ((size_t) Width << shift)) {
+        // The tree is full; grow a level.
+        Node *n = new Node();
+        n->children.push_back(root);
+        n->children.push_back(newPath(shift, value));
+        root = n;
+        shift += Bits;
+      } else {
+        root = pushInto(root, shift, count, value);
+      }
+      ++count;
+    }
+
+    void clear() {
+      release(root);
+      root = 0;
+      shift = 0;
+      count = 0;
+    }
+  };
+
+}
+
+#endif
@@ -11,12 +11,67 @@
 #define KLEE_CELL_H
 
 #include <klee/Expr.h>
+#include <klee/util/Bits.h>
 
 namespace klee {
   class MemoryObject;
 
+  /// Cell - A register, holding an expression or, for concrete values of
+  /// at most 64 bits, an immediate. Executing concrete instructions on
+  /// immediates avoids making a ConstantExpr for every result; one is made
+  /// (and kept) only when the expression is asked for.
+  ///
+  /// A cell which holds neither is uninitialized.
   struct Cell {
-    ref<Expr> value;
+  private:
+    /// The value, or null if it is an immediate not yet asked for as an
+    /// expression.
+    mutable ref<Expr> expr;
+    uint64_t immediate;
+    /// The width of the immediate, or 0 if there is none.
+    Expr::Width immediateWidth;
+
+  public:
+    Cell() : immediate(0), immediateWidth(0) {}
+
+    bool isUninitialized() const {
+      return expr.isNull() && !immediateWidth;
+    }
+
+    /// getImmediate - Get the value as an immediate, if it is concrete and
+    /// at most 64 bits wide.
+    bool getImmediate(uint64_t &value, Expr::Width &width) const {
+      if (!immediateWidth)
+        return false;
+      value = immediate;
+      width = immediateWidth;
+      return true;
+    }
+
+    /// getValue - Get the value as an expression; null if uninitialized.
+    ref<Expr> getValue() const {
+      if (expr.isNull() && immediateWidth)
+        expr = ConstantExpr::alloc(immediate, immediateWidth);
+      return expr;
+    }
+
+    void setValue(ref<Expr> e) {
+      expr = e;
+      immediateWidth = 0;
+      if (ConstantExpr *CE = dyn_cast_or_null<ConstantExpr>(e.get())) {
+        if (CE->getWidth() <= 64) {
+          immediate = CE->getZExtValue();
+          immediateWidth = CE->getWidth();
+        }
+      }
+    }
+
+    void setImmediate(uint64_t value, Expr::Width width) {
+      assert(width && width <= 64 && "invalid immediate width");
+      expr = ref<Expr>();
+      immediate = bits64::truncateToNBits(value, width);
+      immediateWidth = width;
+    }
   };
 }
 
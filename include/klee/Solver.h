@@ -70,6 +70,10 @@ namespace klee {
     Solver(SolverImpl *_impl) : impl(_impl) {}
     virtual ~Solver();
 
+    /// setTimeout - Set the timeout of a complete solver to the given value;
+    /// 0 is off. Solvers without a timeout ignore it.
+    virtual void setTimeout(double timeout) {}
+
     /// evaluate - Determine the full validity of an expression in particular
     /// state.
     ////
@@ -175,6 +179,39 @@ namespace klee {
     void setTimeout(double timeout);
   };
 
+  /// SMTLIBSolver - A complete solver which runs an external SMT-LIBv2
+  /// solver binary on each query, writing the query to the solver's standard
+  /// input and reading the result and model back from its standard output.
+  class SMTLIBSolver : public Solver {
+  public:
+    /// SMTLIBSolver - Construct a new SMTLIBSolver.
+    ///
+    /// \param path - The solver binary to run.
+    /// \param args - White space separated arguments for the solver, which
+    /// must make it read SMT-LIBv2 from its standard input.
+    SMTLIBSolver(const std::string &path, const std::string &args);
+
+    /// setTimeout - Set constraint solver timeout delay to the given value; 0
+    /// is off.
+    void setTimeout(double timeout);
+  };
+
+  /// PortfolioSolver - A complete solver which runs each query on several
+  /// complete solvers at once, each in a long-lived worker process of its
+  /// own, and uses the first answer.
+  class PortfolioSolver : public Solver {
+  public:
+    /// PortfolioSolver - Construct a new PortfolioSolver, which takes
+    /// ownership of the given solvers.
+    ///
+    /// \param backends - The complete solvers to race.
+    PortfolioSolver(const std::vector<Solver*> &backends);
+
+    /// setTimeout - Set the time to wait for an answer to the given value; 0
+    /// is off.
+    void setTimeout(double timeout);
+  };
+
   /* *** */
 
   /// createValidatingSolver - Create a solver which will validate all query
@@ -192,6 +229,16 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCachingSolver(Solver *s);
 
+  /// createPersistentCachingSolver - Create a solver which caches query
+  /// results in a memory mapped file, to reuse them in later runs. Several
+  /// processes may share the file at once.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, which is created if it does not exist.
+  /// \param sizeMB - The size of a newly created cache file, in megabytes.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path,
+                                        unsigned sizeMB);
+
   /// createCexCachingSolver - Create a counterexample caching solver. This is a
   /// more sophisticated cache which records counterexamples for a constraint
   /// set and uses subset/superset relations among constraints to try and
@@ -207,6 +254,23 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createFastCexSolver(Solver *s);
 
+  /// createFPLocalSearchSolver - Create a solver which tries to find a
+  /// satisfying assignment for queries involving floating point by concrete
+  /// local search, hill climbing on the distance (in ULPs) to the branch
+  /// conditions. Queries it cannot satisfy are passed to the underlying
+  /// solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createFPLocalSearchSolver(Solver *s);
+
+  /// createModelSamplingSolver - Create a solver which tries to find a
+  /// satisfying assignment by compiling the constraints once and checking
+  /// them against recent models, random inputs and mutations of these.
+  /// Queries it cannot satisfy are passed to the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createModelSamplingSolver(Solver *s);
+
   /// createIndependentSolver - Create a solver which will eliminate any
   /// unnecessary constraints before propogating the query to the underlying
   /// solver.
@@ -0,0 +1,107 @@
+//===-- ExprBytecode.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_EXPRBYTECODE_H
+#define KLEE_UTIL_EXPRBYTECODE_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <vector>
+#include <tr1/unordered_map>
+
+namespace klee {
+  class Assignment;
+
+  /// ExprBytecode - A set of constraints compiled to a flat program, for
+  /// checking them against many assignments.
+  ///
+  /// Each node of the constraints (shared nodes once) becomes an
+  /// instruction over 64-bit registers, which are reused once their value
+  /// is dead. Evaluating the program under an assignment is a single loop
+  /// over the instructions, with no expressions built; floating point
+  /// nodes are evaluated on the host FPU, as ConstantExpr does for the
+  /// unary operations.
+  ///
+  /// Only values of at most 64 bits (and floating point values of 32 or 64
+  /// bits) are supported. Whenever the program cannot decide a constraint
+  /// exactly -- it was not compiled, or a division by zero, a free value, a
+  /// NaN computed on the host or a conversion ConstantExpr would not agree
+  /// with is met -- the result is Unknown, and the caller should use the
+  /// Assignment instead.
+  class ExprBytecode {
+  public:
+    enum Result { False, True, Unknown };
+
+  private:
+    struct Instruction {
+      /// The Expr::Kind of the node.
+      unsigned char op;
+      unsigned char numArgs;
+      /// Whether the result is a constraint, to be checked once computed.
+      bool check;
+      /// The width of the result, and of the (first) operand.
+      Expr::Width width, opWidth;
+      /// The result and operand registers. For reads the second and third
+      /// are the first operand in updateArgs and the number of updates.
+      unsigned dst, args[3];
+      /// The value of constants, the offset of extracts, the width of the
+      /// right of concats, the predicate of FCmp, whether FPToUI and FPToSI
+      /// round to nearest, or the array slot of reads.
+      uint64_t imm;
+    };
+
+    std::vector<Instruction> code;
+    /// The index and value operands of the updates of each read, from the
+    /// most recent update.
+    std::vector<unsigned> updateArgs;
+    /// The arrays read, by slot.
+    std::vector<const Array*> arrays;
+    /// The contents of each constant array, by slot (empty for symbolic
+    /// arrays).
+    std::vector< std::vector<unsigned char> > constantTables;
+    unsigned numRegisters;
+    bool valid;
+
+    /// The instruction defining the value of each compiled node. Only used
+    /// while compiling.
+    std::tr1::unordered_map<const Expr*, unsigned> values;
+    std::map<const Array*, unsigned> arraySlots;
+
+    void compileRoot(const ref<Expr> &e);
+    bool emit(const Expr *e);
+    unsigned getArraySlot(const Array *array);
+    void getOperands(Instruction &I, std::vector<unsigned*> &res);
+    void allocateRegisters();
+
+  public:
+    /// Compile the constraints in [begin, end).
+    template<typename InputIterator>
+    ExprBytecode(InputIterator begin, InputIterator end)
+      : numRegisters(0), valid(true) {
+      for (; begin != end && valid; ++begin)
+        compileRoot(*begin);
+      values.clear();
+      arraySlots.clear();
+      if (valid)
+        allocateRegisters();
+    }
+
+    /// isValid - Whether every constraint could be compiled.
+    bool isValid() const { return valid; }
+
+    /// getNumInstructions - The size of the program.
+    unsigned getNumInstructions() const { return code.size(); }
+
+    /// evaluate - Whether \a a satisfies all of the constraints.
+    Result evaluate(const Assignment &a) const;
+  };
+}
+
+#endif
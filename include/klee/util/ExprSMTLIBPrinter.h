@@ -24,6 +24,12 @@ namespace klee {
 	///Base Class for SMTLIBv2 printer for Expr trees. It uses the QF_ABV logic. Note however the logic can be
 	///set to QF_AUFBV because some solvers (e.g. STP) complain if this logic is set to QF_ABV.
 	///
+	///Queries containing floating point expressions are printed using the FloatingPoint theory (the logic
+	///gets an "FP" suffix). Floating point values are still bitvectors in KLEE, so a bitvector is converted to
+	///a FloatingPoint with to_fp and, because SMTLIBv2 has no conversion the other way, a FloatingPoint result
+	///used as a bitvector is bound to a fresh bitvector constant which is asserted to have that value.
+	///FSin and FCos have no SMTLIBv2 counterpart and are printed as uninterpreted functions.
+	///
 	///This printer does not abbreviate expressions. The printer ExprSMTLIBLetPrinter does though.
 	///
 	/// It is intended to be used as follows
@@ -76,7 +82,8 @@ namespace klee {
 			enum SMTLIB_SORT
 			{
 				SORT_BITVECTOR,
-				SORT_BOOL
+				SORT_BOOL,
+				SORT_FLOAT ///< A FloatingPoint sort, its format is given by the width of the expression
 			};
 
 
@@ -160,6 +167,24 @@ namespace klee {
 			/// \return True if human readable mode is switched on
 			bool isHumanReadable();
 
+			/// \return True if the query set by setQuery() contains floating point expressions
+			bool hasFloatingPoint() { return haveFloatingPoint; }
+
+			/// \return True if the query set by setQuery() uses uninterpreted functions
+			/// in place of floating point operations (FSin and FCos, which SMT-LIBv2 has no
+			/// theory for). Models for such a query may not be models of the original query.
+			bool hasFloatFunctions() { return !usedFloatFunctions.empty(); }
+
+			/// \return True if the query set by setQuery() contains floating point formats
+			/// that cannot be printed (e.g. x87 long double), in which case the printed
+			/// query is not correct.
+			bool hasUnsupportedFloat() { return haveUnsupportedFloat; }
+
+			///Get the exponent and significand widths of the SMTLIBv2 FloatingPoint sort
+			///for a floating point value of width \a w.
+			/// \return false if there is no corresponding IEEE-754 format.
+			static bool getFloatFormat(Expr::Width w, unsigned &eb, unsigned &sb);
+
 
 		protected:
 			///Contains the arrays found during scans
@@ -195,6 +220,16 @@ namespace klee {
 			//Print SMTLIBv2 assertions for constant arrays
 			virtual void printArrayDeclarations();
 
+			//Print SMTLIBv2 declarations for floating point bridge constants and functions
+			virtual void printFloatDeclarations();
+
+			//Print SMTLIBv2 assertions defining the floating point bridge constants
+			virtual void printFloatBridges();
+
+			///Print the definition of one floating point bridge constant
+			///i.e. (= ((_ to_fp eb sb) name) e)
+			void printFloatBridge(const ref<Expr>& e, unsigned int id);
+
 			//Print SMTLIBv2 for all constraints in the query
 			virtual void printConstraints();
 
@@ -235,6 +270,24 @@ namespace klee {
 			virtual void printCastExpr(const ref<CastExpr>& e);
 			virtual void printNotEqualExpr(const ref<NeExpr>& e);
 			virtual void printSelectExpr(const ref<SelectExpr>& e, ExprSMTLIBPrinter::SMTLIB_SORT s);
+			virtual void printFCmpExpr(const ref<FCmpExpr>& e);
+			virtual void printFRemExpr(const ref<FRemExpr>& e);
+
+			///For floating point operations and conversions that map directly to a single
+			///SMTLIBv2 FloatingPoint operation
+			virtual void printFloatExpr(const ref<Expr>& e);
+
+			///Print an ordered (i.e. not containing UNO) FCmp predicate other than FALSE
+			void printOrderedFCmp(unsigned int pred, const ref<Expr>& l, const ref<Expr>& r);
+
+			///Print (op a b) (or (op a) if \a b is NULL), where the arguments are printed
+			///as sort \a s
+			void printFloatApplication(const std::string& op, const ref<Expr>& a,
+			                           const ref<Expr>& b = ref<Expr>(),
+			                           ExprSMTLIBPrinter::SMTLIB_SORT s = SORT_FLOAT);
+
+			///The name of the uninterpreted function used for FSin or FCos
+			static std::string getFloatFunctionName(Expr::Kind k, Expr::Width w);
 
 			//For the set of operators that take sort "s" arguments
 			virtual void printSortArgsExpr(const ref<Expr>& e, ExprSMTLIBPrinter::SMTLIB_SORT s);
@@ -257,6 +310,16 @@ namespace klee {
 			///Helper function for scan() that scans the expressions of an update node
 			virtual void scanUpdates(const UpdateNode* un);
 
+			///Helper function for scan() that records the floating point operations, formats
+			///and bridges needed to print \a e. It must be called once for each distinct expression.
+			void scanFloat(const ref<Expr>& e);
+
+			///Record that the floating point expression \a e is used as a bitvector
+			void addFloatBridge(const ref<Expr>& e);
+
+			///Determine if kid \a kid of \a e is printed as SORT_FLOAT
+			static bool hasFloatKid(const ref<Expr>& e, unsigned int kid);
+
 			///Helper printer class
 			PrintContext* p;
 
@@ -267,6 +330,22 @@ namespace klee {
 			///Indicates if there were any constant arrays founds during a scan()
 			bool haveConstantArray;
 
+			///Indicates if there were any floating point expressions found during a scan()
+			bool haveFloatingPoint;
+
+			///Indicates if a floating point format that has no SMTLIBv2 sort was found during a scan()
+			bool haveUnsupportedFloat;
+
+			///Floating point expressions that are used as bitvectors, and the number of
+			///the bitvector constant each is bound to.
+			std::map<const ref<Expr>,unsigned int> floatBridges;
+
+			///The uninterpreted functions (kind and width) needed for the query
+			std::set<std::pair<Expr::Kind,Expr::Width> > usedFloatFunctions;
+
+			///This is the prefix string used for floating point bridge constants
+			static const char FLOAT_BRIDGE_PREFIX[];
+
 
 		private:
 			SMTLIBv2Logic logicToUse;
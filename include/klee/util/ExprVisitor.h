@@ -12,6 +12,8 @@
 
 #include "ExprHashMap.h"
 
+#include <vector>
+
 namespace klee {
   class ExprVisitor {
   protected:
@@ -97,15 +99,37 @@ namespace klee {
     virtual Action visitFCmp(const FCmpExpr&);
 
   private:
+    /// Frame - An expression whose kids are being visited.
+    struct Frame {
+      ref<Expr> e;
+      /// The results for the kids visited so far.
+      ref<Expr> kids[8];
+      unsigned next;
+      /// Whether the expression was rebuilt, and (for recursive visitors)
+      /// the rebuilt expression is being visited.
+      bool awaitingRebuilt;
+      ref<Expr> rebuilt;
+
+      explicit Frame(const ref<Expr> &_e)
+        : e(_e), next(0), awaitingRebuilt(false) {}
+    };
+
     typedef ExprHashMap< ref<Expr> > visited_ty;
     visited_ty visited;
     bool recursive;
 
-    ref<Expr> visitActual(const ref<Expr> &e);
+    Action dispatch(const Expr &e);
+    bool enter(const ref<Expr> &e, std::vector<Frame> &stack,
+               ref<Expr> &result);
     
   public:
     // apply the visitor to the expression and return a possibly
     // modified new expression.
+    //
+    // The expression is walked with an explicit stack, in post-order, and
+    // the result for every expression is remembered for the life of the
+    // visitor, so a visit is linear in the size of the DAG however deep it
+    // is.
     ref<Expr> visit(const ref<Expr> &e);
   };
 
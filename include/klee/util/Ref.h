@@ -103,8 +103,11 @@ public:
 
   // assumes non-null arguments
   bool operator<(const ref &rhs) const { return compare(rhs)<0; }
-  bool operator==(const ref &rhs) const { return compare(rhs)==0; }
-  bool operator!=(const ref &rhs) const { return compare(rhs)!=0; }
+
+  // Expressions are hash-consed (see ExprContext), so equal expressions
+  // are the same object.
+  bool operator==(const ref &rhs) const { return ptr == rhs.ptr; }
+  bool operator!=(const ref &rhs) const { return ptr != rhs.ptr; }
 };
 
 template<class T>
@@ -0,0 +1,75 @@
+//===-- ValueFacts.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_VALUEFACTS_H
+#define KLEE_VALUEFACTS_H
+
+#include "klee/Expr.h"
+
+namespace klee {
+
+  /// ValueFacts - What is known about the values an expression of at most
+  /// 64 bits may take: which bits are known to be zero or one, and the
+  /// unsigned and signed intervals the value lies in. The facts hold under
+  /// every assignment of the arrays, so they decide comparisons (and fix
+  /// bits) without a query.
+  ///
+  /// The facts of an expression are computed once, from the facts of its
+  /// kids, and kept on the expression (see getValueFacts). Expressions of
+  /// other widths are not tracked.
+  class ValueFacts {
+  public:
+    /// The width of the value, or 0 if it is not tracked.
+    Expr::Width width;
+    uint64_t knownZero, knownOne;
+    uint64_t umin, umax;
+    /// The signed interval, sign extended from width.
+    int64_t smin, smax;
+
+  private:
+    ValueFacts() {}
+
+    void normalize();
+
+  public:
+    /// unknown - The facts of an arbitrary value of width \a w.
+    static ValueFacts unknown(Expr::Width w);
+    /// constant - The facts of the value \a value of width \a w.
+    static ValueFacts constant(uint64_t value, Expr::Width w);
+
+    /// compute - The facts of \a e, given (in \a kids) those of its kids
+    /// for the kinds which use them.
+    static ValueFacts compute(const Expr *e, const ValueFacts *kids[]);
+
+    /// usesKids - Whether the facts of expressions of kind \a k depend on
+    /// those of their kids.
+    static bool usesKids(Expr::Kind k);
+
+    /// eval - The facts of the binary expression of kind \a k with kids
+    /// whose facts are \a a and \a b; \a w is its width.
+    static ValueFacts eval(Expr::Kind k, const ValueFacts &a,
+                           const ValueFacts &b, Expr::Width w);
+
+    bool isTracked() const { return width != 0; }
+
+    /// getConstant - Whether the value is fixed, and if so which it is.
+    bool getConstant(uint64_t &value) const {
+      if (!width || umin != umax)
+        return false;
+      value = umin;
+      return true;
+    }
+  };
+
+  /// getValueFacts - Return the facts of \a e, computing (and keeping)
+  /// those of it and its kids if not yet known.
+  const ValueFacts &getValueFacts(const Expr *e);
+}
+
+#endif
@@ -65,6 +65,8 @@ ExecutionState::ExecutionState(KFunction *kf, unsigned moduleId)
   : fakeState(false),
     depth(0),
     forkDisabled(false),
+    pendingBranch(0),
+    pendingBranchTrue(false),
     queryCost(0.), 
     weight(1),
     instsSinceCovNew(0),
@@ -87,6 +89,8 @@ ExecutionState::ExecutionState(KFunction *kf, unsigned moduleId)
 
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions) 
   : fakeState(true),
+    pendingBranch(0),
+    pendingBranchTrue(false),
     queryCost(0.),
     ptreeNode(0),
     globalConstraints(assumptions),
@@ -102,6 +106,9 @@ ExecutionState::ExecutionState(const ExecutionState &that)
     fakeState(that.fakeState),
     depth(that.depth),
     forkDisabled(that.forkDisabled),
+    pendingCondition(that.pendingCondition),
+    pendingBranch(that.pendingBranch),
+    pendingBranchTrue(that.pendingBranchTrue),
     queryCost(that.queryCost),
     weight(that.weight),
     pathOS(that.pathOS),
@@ -438,6 +445,13 @@ bool ExecutionState::merge(const ExecutionState &b) {
   if (pc() != b.pc())
     return false;
 
+  // The merging searchers park states at merge points before the executor
+  // resolves them, and the branch condition of a lazily forked state is not
+  // among its constraints yet, so it would be lost. Such a state continues
+  // unmerged and is resolved when it is next selected.
+  if (!pendingCondition.isNull() || !b.pendingCondition.isNull())
+    return false;
+
   // XXX is it even possible for these to differ? does it matter? probably
   // implies difference in object states?
   if (symbolics!=b.symbolics)
@@ -568,13 +582,13 @@ bool ExecutionState::merge(const ExecutionState &b) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      ref<Expr> &av = af.locals[i].value;
-      const ref<Expr> &bv = bf.locals[i].value;
-      if (av.isNull() || bv.isNull()) {
+      Cell &ac = af.locals[i];
+      const Cell &bc = bf.locals[i];
+      if (ac.isUninitialized() || bc.isUninitialized()) {
         // if one is null then by implication (we are at same pc)
         // we cannot reuse this local, so just ignore
       } else {
-        av = SelectExpr::create(inA, av, bv);
+        ac.setValue(SelectExpr::create(inA, ac.getValue(), bc.getValue()));
       }
     }
   }
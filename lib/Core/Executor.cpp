@@ -110,6 +110,13 @@ namespace {
   cl::opt<bool>
   RandomizeFork("randomize-fork",
                 cl::init(false));
+
+  cl::opt<bool>
+  LazyFork("lazy-fork",
+           cl::desc("Fork on symbolic branches without checking that both "
+                    "sides are feasible, checking each side only when the "
+                    "searcher selects it (default=off)"),
+           cl::init(false));
  
   cl::opt<bool>
   AllowExternalSymCalls("allow-external-sym-calls",
@@ -173,6 +180,18 @@ namespace {
   UseFPRewriter("use-fp-rewriter",
                 cl::init(false));
 
+  cl::opt<bool>
+  UseFPLocalSearch("use-fp-local-search",
+                   cl::init(false),
+                   cl::desc("Search for models of floating point queries "
+                            "concretely before calling the solver"));
+
+  cl::opt<bool>
+  UseModelSampling("use-model-sampling",
+                   cl::init(false),
+                   cl::desc("Check compiled queries against sampled inputs "
+                            "before calling the solver"));
+
   // FIXME: Command line argument duplicated in main.cpp of Kleaver
   cl::opt<int>
   MinQueryTimeToLog("min-query-time-to-log",
@@ -191,6 +210,18 @@ namespace {
 	   cl::init(true),
 	   cl::desc("Use validity caching"));
 
+  cl::opt<std::string>
+  PersistentQueryCache("persistent-query-cache",
+                       cl::desc("Cache solver results in this file, to "
+                                "reuse them across runs and share them with "
+                                "other processes (default=off)"));
+
+  cl::opt<unsigned>
+  PersistentQueryCacheSize("persistent-query-cache-size",
+                           cl::desc("Size in MB of a newly created "
+                                    "persistent query cache (default=256)"),
+                           cl::init(256));
+
   cl::opt<bool>
   OnlyReplaySeeds("only-replay-seeds", 
                   cl::desc("Discard states that do not have a seed."));
@@ -272,6 +303,17 @@ namespace {
                  cl::desc("Optimize constant divides into add/shift/multiplies before passing to STP"),
                  cl::init(true));
 
+  cl::opt<std::string>
+  SMTLIBSolverPath("smtlib-solver",
+                   cl::desc("Use this SMT-LIBv2 solver binary instead of STP, "
+                            "sending it queries through a pipe. A new solver "
+                            "process is started for every query (default=off)"));
+
+  cl::opt<std::string>
+  SMTLIBSolverArgs("smtlib-solver-args",
+                   cl::desc("Arguments for -smtlib-solver, which must make it "
+                            "read SMT-LIBv2 from standard input (e.g. -in for z3)"));
+
   cl::opt<unsigned int>
   MaxPreemptions("scheduler-preemption-bound",
 		 cl::desc("scheduler preemption bound (default=0)"),
@@ -297,6 +339,17 @@ namespace {
 		             ), cl::CommaSeparated
   );
 
+  cl::list<klee::PortfolioSolverKind> solverPortfolio("solver-portfolio",
+		  cl::desc("Run each query on all of these solvers at once, in separate processes, and use the first answer. By default only one solver is used."),
+		  cl::values(
+					  clEnumValN(klee::PORTFOLIO_STP,"stp","STP"),
+					  clEnumValN(klee::PORTFOLIO_STP_FORKED,"stp-forked","STP in a forked process"),
+					  clEnumValN(klee::PORTFOLIO_STP_NO_OPTIMIZE_DIVIDES,"stp-no-optimize-divides","STP without -stp-optimize-divides"),
+					  clEnumValN(klee::PORTFOLIO_SMTLIB,"smtlib","The solver given by -smtlib-solver"),
+					  clEnumValEnd
+		             ), cl::CommaSeparated
+  );
+
 
 }
 
@@ -314,12 +367,12 @@ namespace klee {
 
 }
 
-Solver *constructSolverChain(STPSolver *stpSolver,
+Solver *constructSolverChain(Solver *coreSolver,
                              std::string querySMT2LogPath,
                              std::string baseSolverQuerySMT2LogPath,
                              std::string queryPCLogPath,
                              std::string baseSolverQueryPCLogPath) {
-  Solver *solver = stpSolver;
+  Solver *solver = coreSolver;
 
   
 
@@ -340,10 +393,20 @@ Solver *constructSolverChain(STPSolver *stpSolver,
 
   if (UseFPRewriter)
     solver = createFPRewritingSolver(solver);
+
+  if (UseFPLocalSearch)
+    solver = createFPLocalSearchSolver(solver);
+
+  if (UseModelSampling)
+    solver = createModelSamplingSolver(solver);
   
   if (UseFastCexSolver)
     solver = createFastCexSolver(solver);
 
+  if (!PersistentQueryCache.empty())
+    solver = createPersistentCachingSolver(solver, PersistentQueryCache,
+                                           PersistentQueryCacheSize);
+
   if (UseCexCache)
     solver = createCexCachingSolver(solver);
 
@@ -354,7 +417,7 @@ Solver *constructSolverChain(STPSolver *stpSolver,
     solver = createIndependentSolver(solver);
 
   if (DebugValidateSolver)
-    solver = createValidatingSolver(solver, stpSolver);
+    solver = createValidatingSolver(solver, coreSolver);
 
   if (optionIsSet(queryLoggingOptions,ALL_PC))
   {
@@ -532,15 +595,46 @@ Executor::Executor(const InterpreterOptions &opts,
 	       ? std::min(MaxSTPTime,MaxInstructionTime)
 	       : std::max(MaxSTPTime,MaxInstructionTime)) {
 
-  STPSolver *stpSolver = new STPSolver(UseForkedSTP, STPOptimizeDivides);
+  // STP is only built when it is the core solver, so that nothing else
+  // holds on to it.
+  STPSolver *stpSolver = 0;
+  Solver *coreSolver;
+  if (!solverPortfolio.empty()) {
+    std::vector<Solver*> backends;
+    for (unsigned i = 0; i != solverPortfolio.size(); ++i) {
+      switch (solverPortfolio[i]) {
+      case PORTFOLIO_STP:
+        backends.push_back(new STPSolver(false, STPOptimizeDivides));
+        break;
+      case PORTFOLIO_STP_FORKED:
+        backends.push_back(new STPSolver(true, STPOptimizeDivides));
+        break;
+      case PORTFOLIO_STP_NO_OPTIMIZE_DIVIDES:
+        backends.push_back(new STPSolver(false, false));
+        break;
+      case PORTFOLIO_SMTLIB:
+        if (SMTLIBSolverPath.empty())
+          klee_error("-solver-portfolio=smtlib requires -smtlib-solver");
+        backends.push_back(new SMTLIBSolver(SMTLIBSolverPath,
+                                            SMTLIBSolverArgs));
+        break;
+      }
+    }
+    coreSolver = new PortfolioSolver(backends);
+    klee_message("Racing %u solvers on each query", (unsigned) backends.size());
+  } else if (!SMTLIBSolverPath.empty()) {
+    coreSolver = new SMTLIBSolver(SMTLIBSolverPath, SMTLIBSolverArgs);
+  } else {
+    coreSolver = stpSolver = new STPSolver(UseForkedSTP, STPOptimizeDivides);
+  }
   Solver *solver = 
-    constructSolverChain(stpSolver,
+    constructSolverChain(coreSolver,
                          interpreterHandler->getOutputFilename("all-queries.smt2"),
                          interpreterHandler->getOutputFilename("solver-queries.smt2"),
                          interpreterHandler->getOutputFilename("all-queries.pc"),
                          interpreterHandler->getOutputFilename("solver-queries.pc"));
   
-  this->solver = new TimingSolver(solver, stpSolver);
+  this->solver = new TimingSolver(solver, stpSolver, coreSolver);
 
   memory = new MemoryManager();
 
@@ -970,16 +1064,27 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal,
     }      
   }
 
-  double timeout = stpTimeout;
-  if (isSeeding)
-    timeout *= it->second.size();
-  solver->setTimeout(timeout);
-  bool success = solver->evaluate(current, condition, res);
-  solver->setTimeout(0);
-  if (!success) {
-    current.pc() = current.prevPC();
-    terminateStateEarly(current, "query timed out");
-    return StatePair(0, 0);
+  // A lazy fork leaves checking that each side is feasible until it is
+  // selected, so only when forking cannot be refused or decided otherwise.
+  bool lazy = LazyFork && !isSeeding && !isInternal && !replayPath &&
+    !replayOut && !isa<ConstantExpr>(condition) &&
+    !(MaxMemoryInhibit && atMemoryLimit) && !current.forkDisabled &&
+    !inhibitForking && (MaxForks==~0u || stats::forks < MaxForks);
+
+  if (lazy) {
+    res = Solver::Unknown;
+  } else {
+    double timeout = stpTimeout;
+    if (isSeeding)
+      timeout *= it->second.size();
+    solver->setTimeout(timeout);
+    bool success = solver->evaluate(current, condition, res);
+    solver->setTimeout(0);
+    if (!success) {
+      current.pc() = current.prevPC();
+      terminateStateEarly(current, "query timed out");
+      return StatePair(0, 0);
+    }
   }
 
   if (!isSeeding) {
@@ -1150,8 +1255,13 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal,
       }
     }
 
-    addConstraint(*trueState, condition);
-    addConstraint(*falseState, Expr::createIsZero(condition));
+    if (lazy) {
+      trueState->pendingCondition = condition;
+      falseState->pendingCondition = Expr::createIsZero(condition);
+    } else {
+      addConstraint(*trueState, condition);
+      addConstraint(*falseState, Expr::createIsZero(condition));
+    }
 
     // Kinda gross, do we even really still want this option?
     if (MaxDepth && MaxDepth<=trueState->depth) {
@@ -1182,6 +1292,41 @@ Executor::fork(ExecutionState &current, int reason) {
   return StatePair(newState, lastState);
 }
 
+bool Executor::resolvePendingCondition(ExecutionState &state) {
+  ref<Expr> condition = state.pendingCondition;
+
+  bool mayBeTrue;
+  solver->setTimeout(stpTimeout);
+  bool success = solver->mayBeTrue(state, condition, mayBeTrue);
+  solver->setTimeout(0);
+  if (!success) {
+    klee_warning_once(0, "dropping lazily forked state (query timed out)");
+    terminateState(state);
+    return false;
+  }
+  if (!mayBeTrue) {
+    terminateState(state);
+    return false;
+  }
+
+  state.pendingCondition = ref<Expr>();
+  addConstraint(state, condition);
+
+  if (KInstruction *branch = state.pendingBranch) {
+    // markBranchVisited works on the statistics of the current
+    // instruction, so make it the branch for the while.
+    state.pendingBranch = 0;
+    unsigned index = theStatisticManager->getIndex();
+    theStatisticManager->setIndex(branch->info->id);
+    if (state.pendingBranchTrue)
+      statsTracker->markBranchVisited(&state, 0);
+    else
+      statsTracker->markBranchVisited(0, &state);
+    theStatisticManager->setIndex(index);
+  }
+  return true;
+}
+
 ForkTag Executor::getForkTag(ExecutionState &current, int reason) {
   ForkTag tag((ForkClass)reason);
 
@@ -1317,18 +1462,18 @@ const Cell& Executor::eval(KInstruction *ki, unsigned index,
 
 void Executor::bindLocal(KInstruction *target, ExecutionState &state, 
                          ref<Expr> value) {
-  getDestCell(state, target).value = value;
+  getDestCell(state, target).setValue(value);
 }
 
 void Executor::bindArgument(KFunction *kf, unsigned index, 
                             ExecutionState &state, ref<Expr> value) {
-  getArgumentCell(state, kf, index).value = value;
+  getArgumentCell(state, kf, index).setValue(value);
 }
 
 
 void Executor::bindArgumentToPthreadCreate(KFunction *kf, unsigned index, 
 					   StackFrame &sf, ref<Expr> value) {
-  getArgumentCell(sf, kf, index).value = value;
+  getArgumentCell(sf, kf, index).setValue(value);
 }
 
 ref<Expr> Executor::toUnique(const ExecutionState &state, 
@@ -1723,7 +1868,150 @@ static inline const llvm::fltSemantics * fpWidthToSemantics(unsigned width) {
   }
 }
 
+/// signExtend - Sign extend the \a w bit immediate \a v to 64 bits.
+static int64_t signExtend(uint64_t v, Expr::Width w) {
+  return ((int64_t) (v << (64 - w))) >> (64 - w);
+}
+
+/// evalImmediateBinary - Compute the integer binary operation \a opcode on
+/// the \a w bit immediates \a l and \a r, unless it is one (a division by
+/// zero, an overflowing signed division, or an oversized shift) which is
+/// left to the expression library.
+static bool evalImmediateBinary(unsigned opcode, uint64_t l, uint64_t r,
+                                Expr::Width w, uint64_t &res) {
+  switch (opcode) {
+  case Instruction::Add: res = l + r; return true;
+  case Instruction::Sub: res = l - r; return true;
+  case Instruction::Mul: res = l * r; return true;
+  case Instruction::And: res = l & r; return true;
+  case Instruction::Or: res = l | r; return true;
+  case Instruction::Xor: res = l ^ r; return true;
+
+  case Instruction::UDiv:
+  case Instruction::URem:
+    if (!r)
+      return false;
+    res = opcode == Instruction::UDiv ? l / r : l % r;
+    return true;
+
+  case Instruction::SDiv:
+  case Instruction::SRem: {
+    int64_t sl = signExtend(l, w), sr = signExtend(r, w);
+    if (!sr || (sr == -1 && sl == signExtend(1ULL << (w - 1), w)))
+      return false;
+    res = opcode == Instruction::SDiv ? sl / sr : sl % sr;
+    return true;
+  }
+
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr:
+    if (r >= w)
+      return false;
+    if (opcode == Instruction::Shl)
+      res = l << r;
+    else if (opcode == Instruction::LShr)
+      res = l >> r;
+    else
+      res = signExtend(l, w) >> r;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+bool Executor::executeImmediateInstruction(ExecutionState &state,
+                                           KInstruction *ki) {
+  Instruction *i = ki->inst;
+  unsigned opcode = i->getOpcode();
+  uint64_t l, r;
+  Expr::Width lw, rw;
+
+  if (Instruction::isBinaryOp(opcode)) {
+    if (!isa<IntegerType>(i->getType()) ||
+        !eval(ki, 0, state).getImmediate(l, lw) ||
+        !eval(ki, 1, state).getImmediate(r, rw) || lw != rw)
+      return false;
+    uint64_t res;
+    if (!evalImmediateBinary(opcode, l, r, lw, res))
+      return false;
+    getDestCell(state, ki).setImmediate(res, lw);
+    return true;
+  }
+
+  switch (opcode) {
+  case Instruction::ICmp: {
+    if (isa<VectorType>(i->getOperand(0)->getType()) ||
+        !eval(ki, 0, state).getImmediate(l, lw) ||
+        !eval(ki, 1, state).getImmediate(r, rw) || lw != rw)
+      return false;
+
+    bool res;
+    switch (cast<ICmpInst>(i)->getPredicate()) {
+    case ICmpInst::ICMP_EQ: res = l == r; break;
+    case ICmpInst::ICMP_NE: res = l != r; break;
+    case ICmpInst::ICMP_UGT: res = l > r; break;
+    case ICmpInst::ICMP_UGE: res = l >= r; break;
+    case ICmpInst::ICMP_ULT: res = l < r; break;
+    case ICmpInst::ICMP_ULE: res = l <= r; break;
+    case ICmpInst::ICMP_SGT: res = signExtend(l, lw) > signExtend(r, lw); break;
+    case ICmpInst::ICMP_SGE: res = signExtend(l, lw) >= signExtend(r, lw); break;
+    case ICmpInst::ICMP_SLT: res = signExtend(l, lw) < signExtend(r, lw); break;
+    case ICmpInst::ICMP_SLE: res = signExtend(l, lw) <= signExtend(r, lw); break;
+    default: return false;
+    }
+    getDestCell(state, ki).setImmediate(res, Expr::Bool);
+    return true;
+  }
+
+  case Instruction::Trunc:
+  case Instruction::ZExt:
+  case Instruction::SExt: {
+    LLVM_TYPE_Q IntegerType *type = dyn_cast<IntegerType>(i->getType());
+    if (!type || type->getBitWidth() > 64 ||
+        !eval(ki, 0, state).getImmediate(l, lw))
+      return false;
+    if (opcode == Instruction::SExt)
+      l = signExtend(l, lw);
+    getDestCell(state, ki).setImmediate(l, type->getBitWidth());
+    return true;
+  }
+
+  case Instruction::GetElementPtr: {
+    KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
+    Expr::Width pointerWidth = Context::get().getPointerWidth();
+    uint64_t base;
+    Expr::Width baseWidth;
+    if (!eval(ki, 0, state).getImmediate(base, baseWidth) ||
+        baseWidth != pointerWidth)
+      return false;
+
+    for (std::vector< std::pair<unsigned, uint64_t> >::iterator 
+           it = kgepi->indices.begin(), ie = kgepi->indices.end(); 
+         it != ie; ++it) {
+      uint64_t index;
+      Expr::Width indexWidth;
+      if (!eval(ki, it->first, state).getImmediate(index, indexWidth) ||
+          indexWidth > pointerWidth)
+        return false;
+      base += signExtend(index, indexWidth) * it->second;
+    }
+    base += kgepi->offset;
+    getDestCell(state, ki).setImmediate(base, pointerWidth);
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
 void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
+  // Concrete integer instructions are executed on immediates.
+  if (executeImmediateInstruction(state, ki))
+    return;
+
   Instruction *i = ki->inst;
   switch (i->getOpcode()) {
     // Control flow
@@ -1735,7 +2023,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     ref<Expr> result = ConstantExpr::alloc(0, Expr::Bool);
 
     if (!isVoidReturn) {
-      result = eval(ki, 0, state).value;
+      result = eval(ki, 0, state).getValue();
     }
     
     if (state.stack().size() <= 1) {
@@ -1842,15 +2130,30 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // FIXME: Find a way that we don't have this hidden dependency.
       assert(bi->getCondition() == bi->getOperand(0) &&
              "Wrong operand index!");
-      ref<Expr> cond = eval(ki, 0, state).value;
+      ref<Expr> cond = eval(ki, 0, state).getValue();
       Executor::StatePair branches = fork(state, cond, false, reason);
 
       // NOTE: There is a hidden dependency here, markBranchVisited
       // requires that we still be in the context of the branch
       // instruction (it reuses its statistic id). Should be cleaned
       // up with convenient instruction specific data.
-      if (statsTracker && state.stack().back().kf->trackCoverage)
-        statsTracker->markBranchVisited(branches.first, branches.second);
+      if (statsTracker && state.stack().back().kf->trackCoverage) {
+        // A lazily forked side is only marked once it is known to be
+        // feasible, by resolvePendingCondition.
+        ExecutionState *visitedTrue = branches.first;
+        ExecutionState *visitedFalse = branches.second;
+        if (visitedTrue && !visitedTrue->pendingCondition.isNull()) {
+          visitedTrue->pendingBranch = ki;
+          visitedTrue->pendingBranchTrue = true;
+          visitedTrue = 0;
+        }
+        if (visitedFalse && !visitedFalse->pendingCondition.isNull()) {
+          visitedFalse->pendingBranch = ki;
+          visitedFalse->pendingBranchTrue = false;
+          visitedFalse = 0;
+        }
+        statsTracker->markBranchVisited(visitedTrue, visitedFalse);
+      }
 
       if (branches.first)
         transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), *branches.first);
@@ -1861,7 +2164,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::Switch: {
     SwitchInst *si = cast<SwitchInst>(i);
-    ref<Expr> cond = eval(ki, 0, state).value;
+    ref<Expr> cond = eval(ki, 0, state).getValue();
     unsigned cases = si->getNumCases();
     BasicBlock *bb = si->getParent();
 
@@ -1967,7 +2270,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     arguments.reserve(numArgs);
 
     for (unsigned j=0; j<numArgs; ++j)
-      arguments.push_back(eval(ki, j+1, state).value);
+      arguments.push_back(eval(ki, j+1, state).getValue());
 
     if (f) {
       const FunctionType *fType = 
@@ -2010,7 +2313,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
       executeCall(state, ki, f, arguments);
     } else {
-      ref<Expr> v = eval(ki, 0, state).value;
+      ref<Expr> v = eval(ki, 0, state).getValue();
 
       ExecutionState *free = &state;
       bool hasInvalid = false, first = true;
@@ -2051,12 +2354,12 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     break;
   }
   case Instruction::PHI: {
+    // Copy the cell, so that an immediate stays one.
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
-    ref<Expr> result = eval(ki, state.crtThread().incomingBBIndex, state).value;
+    getDestCell(state, ki) = eval(ki, state.crtThread().incomingBBIndex, state);
 #else
-    ref<Expr> result = eval(ki, state.crtThread().incomingBBIndex * 2, state).value;
+    getDestCell(state, ki) = eval(ki, state.crtThread().incomingBBIndex * 2, state);
 #endif
-    bindLocal(ki, state, result);
     break;
   }
 
@@ -2065,9 +2368,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     SelectInst *SI = cast<SelectInst>(ki->inst);
     assert(SI->getCondition() == SI->getOperand(0) &&
            "Wrong operand index!");
-    ref<Expr> cond = eval(ki, 0, state).value;
-    ref<Expr> tExpr = eval(ki, 1, state).value;
-    ref<Expr> fExpr = eval(ki, 2, state).value;
+    ref<Expr> cond = eval(ki, 0, state).getValue();
+    ref<Expr> tExpr = eval(ki, 1, state).getValue();
+    ref<Expr> fExpr = eval(ki, 2, state).getValue();
 
 #if 0
     Expr::Kind condKind = cond->getKind();
@@ -2093,101 +2396,101 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Arithmetic / logical
 
   case Instruction::Add: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, ISIMDOperation(this, kmodule(state), AddExpr::create).eval(i->getType(), left, right));
     break;
   }
 
   case Instruction::Sub: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, ISIMDOperation(this, kmodule(state), SubExpr::create).eval(i->getType(), left, right));
     break;
   }
  
   case Instruction::Mul: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, ISIMDOperation(this, kmodule(state), MulExpr::create).eval(i->getType(), left, right));
     break;
   }
 
   case Instruction::UDiv: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ISIMDOperation(this, kmodule(state), UDivExpr::create).eval(i->getType(), left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::SDiv: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ISIMDOperation(this, kmodule(state), SDivExpr::create).eval(i->getType(), left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::URem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ISIMDOperation(this, kmodule(state), URemExpr::create).eval(i->getType(), left, right);
     bindLocal(ki, state, result);
     break;
   }
  
   case Instruction::SRem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ISIMDOperation(this, kmodule(state), SRemExpr::create).eval(i->getType(), left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::And: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = AndExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Or: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = OrExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Xor: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = XorExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Shl: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ISIMDOperation(this, kmodule(state), ShlExpr::create).eval(i->getType(), left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::LShr: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ISIMDOperation(this, kmodule(state), LShrExpr::create).eval(i->getType(), left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::AShr: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = ISIMDOperation(this, kmodule(state), AShrExpr::create).eval(i->getType(), left, right);
     bindLocal(ki, state, result);
     break;
@@ -2201,80 +2504,80 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
  
     switch(ii->getPredicate()) {
     case ICmpInst::ICMP_EQ: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), EqExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_NE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), NeExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_UGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), UgtExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state,result);
       break;
     }
 
     case ICmpInst::ICMP_UGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), UgeExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_ULT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), UltExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_ULE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), UleExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), SgtExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), SgeExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SLT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), SltExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SLE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = ISIMDOperation(this, kmodule(state), SleExpr::create).eval(i->getType(), left, right);
       bindLocal(ki, state, result);
       break;
@@ -2299,7 +2602,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       kmodule(state)->targetData->getTypeStoreSize(ai->getAllocatedType());
     ref<Expr> size = Expr::createPointer(elementSize);
     if (ai->isArrayAllocation()) {
-      ref<Expr> count = eval(ki, 0, state).value;
+      ref<Expr> count = eval(ki, 0, state).getValue();
       count = Expr::createZExtToPointerWidth(count);
       size = MulExpr::create(size, count);
     }
@@ -2309,7 +2612,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 #if LLVM_VERSION_CODE < LLVM_VERSION(2, 7)
   case Instruction::Free: {
-    executeFree(state, eval(ki, 0, state).value);
+    executeFree(state, eval(ki, 0, state).getValue());
     break;
   }
 #endif
@@ -2317,28 +2620,28 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::Load: {
     LoadInst *li = cast<LoadInst>(i);
     unsigned addrspace = li->getPointerAddressSpace();
-    ref<Expr> base = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 0, state).getValue();
     executeMemoryOperation(state, false, addrspace, base, 0, ki);
     break;
   }
   case Instruction::Store: {
     StoreInst *si = cast<StoreInst>(i);
     unsigned addrspace = si->getPointerAddressSpace();
-    ref<Expr> base = eval(ki, 1, state).value;
-    ref<Expr> value = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 1, state).getValue();
+    ref<Expr> value = eval(ki, 0, state).getValue();
     executeMemoryOperation(state, true, addrspace, base, value, 0);
     break;
   }
 
   case Instruction::GetElementPtr: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
-    ref<Expr> base = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 0, state).getValue();
 
     for (std::vector< std::pair<unsigned, uint64_t> >::iterator 
            it = kgepi->indices.begin(), ie = kgepi->indices.end(); 
          it != ie; ++it) {
       uint64_t elementSize = it->second;
-      ref<Expr> index = eval(ki, it->first, state).value;
+      ref<Expr> index = eval(ki, it->first, state).getValue();
       base = AddExpr::create(base,
                              MulExpr::create(Expr::createSExtToPointerWidth(index),
                                              Expr::createPointer(elementSize)));
@@ -2353,7 +2656,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Conversion
   case Instruction::Trunc: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).value,
+    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).getValue(),
                                            0,
                                            getWidthForLLVMType(kmodule(state), ci->getType()));
     bindLocal(ki, state, result);
@@ -2361,14 +2664,14 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::ZExt: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).value,
+    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).getValue(),
                                         getWidthForLLVMType(kmodule(state), ci->getType()));
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::SExt: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).value,
+    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).getValue(),
                                         getWidthForLLVMType(kmodule(state), ci->getType()));
     bindLocal(ki, state, result);
     break;
@@ -2377,20 +2680,20 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::IntToPtr: {
     CastInst *ci = cast<CastInst>(i);
     Expr::Width pType = getWidthForLLVMType(kmodule(state), ci->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     bindLocal(ki, state, ZExtExpr::create(arg, pType));
     break;
   } 
   case Instruction::PtrToInt: {
     CastInst *ci = cast<CastInst>(i);
     Expr::Width iType = getWidthForLLVMType(kmodule(state), ci->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     bindLocal(ki, state, ZExtExpr::create(arg, iType));
     break;
   }
 
   case Instruction::BitCast: {
-    ref<Expr> result = eval(ki, 0, state).value;
+    ref<Expr> result = eval(ki, 0, state).getValue();
     bindLocal(ki, state, result);
     break;
   }
@@ -2398,22 +2701,22 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Floating point instructions
 
   case Instruction::FAdd: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right  = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right  = eval(ki, 1, state).getValue();
     bindLocal(ki, state, FSIMDOperation(this, kmodule(state), FAddExpr::create).eval(i->getType(), left, right));
     break;
   }
 
   case Instruction::FSub: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right  = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right  = eval(ki, 1, state).getValue();
     bindLocal(ki, state, FSIMDOperation(this, kmodule(state), FSubExpr::create).eval(i->getType(), left, right));
     break;
   }
 
   case Instruction::FMul: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right  = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right  = eval(ki, 1, state).getValue();
     bindLocal(ki, state, FSIMDOperation(this, kmodule(state), FMulExpr::create).eval(i->getType(), left, right));
     break;
   }
@@ -2424,16 +2727,16 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         AnyExpr::create(getWidthForLLVMType(kmodule(state), i->getType()));
       bindLocal(ki, state, undef);
     } else {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right  = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right  = eval(ki, 1, state).getValue();
       bindLocal(ki, state, FSIMDOperation(this, kmodule(state), FDivExpr::create).eval(i->getType(), left, right));
     }
     break;
   }
 
   case Instruction::FRem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right  = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right  = eval(ki, 1, state).getValue();
     bindLocal(ki, state, FSIMDOperation(this, kmodule(state), FRemExpr::create).eval(i->getType(), left, right));
     break;
   }
@@ -2441,7 +2744,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::FPTrunc:
   case Instruction::FPExt: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     const llvm::Type *type = i->getType();
     const fltSemantics *sem = TypeToFloatSemantics(type);
     bindLocal(ki, state,
@@ -2453,7 +2756,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   case Instruction::FPToUI:
   case Instruction::FPToSI: {
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     LLVM_TYPE_Q llvm::Type *type = i->getType();
     bindLocal(ki, state, F2ISIMDOperation(this, kmodule(state),
        (i->getOpcode() == Instruction::FPToUI
@@ -2465,7 +2768,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   case Instruction::UIToFP:
   case Instruction::SIToFP: {
-    ref<Expr> arg = eval(ki, 0, state).value;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     LLVM_TYPE_Q llvm::Type *type = i->getType();
     bindLocal(ki, state, I2FSIMDOperation(this, kmodule(state),
        (i->getOpcode() == Instruction::UIToFP
@@ -2476,8 +2779,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   case Instruction::FCmp: {
     FCmpInst *fi = cast<FCmpInst>(i);
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
 
     ref<Expr> Result = FCmpSIMDOperation(this, kmodule(state), fi->getPredicate()).eval(i->getType(), fi->getOperand(0)->getType(), left, right);
     bindLocal(ki, state, Result);
@@ -2488,8 +2791,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Unhandled
   case Instruction::ExtractElement: {
     ExtractElementInst *eei = cast<ExtractElementInst>(i);
-    ref<Expr> vec = eval(ki, 0, state).value;
-    ref<Expr> idx = eval(ki, 1, state).value;
+    ref<Expr> vec = eval(ki, 0, state).getValue();
+    ref<Expr> idx = eval(ki, 1, state).getValue();
 
     assert(isa<ConstantExpr>(idx) && "symbolic index unsupported");
     ConstantExpr *cIdx = cast<ConstantExpr>(idx);
@@ -2505,9 +2808,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::InsertElement: {
     InsertElementInst *iei = cast<InsertElementInst>(i);
-    ref<Expr> vec = eval(ki, 0, state).value;
-    ref<Expr> newElt = eval(ki, 1, state).value;
-    ref<Expr> idx = eval(ki, 2, state).value;
+    ref<Expr> vec = eval(ki, 0, state).getValue();
+    ref<Expr> newElt = eval(ki, 1, state).getValue();
+    ref<Expr> idx = eval(ki, 2, state).getValue();
 
     assert(isa<ConstantExpr>(idx) && "symbolic index unsupported");
     ConstantExpr *cIdx = cast<ConstantExpr>(idx);
@@ -2532,8 +2835,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::ShuffleVector: {
     ShuffleVectorInst *svi = cast<ShuffleVectorInst>(i);
 
-    ref<Expr> vec1 = eval(ki, 0, state).value;
-    ref<Expr> vec2 = eval(ki, 1, state).value;
+    ref<Expr> vec1 = eval(ki, 0, state).getValue();
+    ref<Expr> vec2 = eval(ki, 1, state).getValue();
     const llvm::VectorType *vt = svi->getType();
     unsigned EltBits = getWidthForLLVMType(kmodule(state), vt->getElementType());
 
@@ -2562,8 +2865,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::InsertValue: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
 
-    ref<Expr> agg = eval(ki, 0, state).value;
-    ref<Expr> val = eval(ki, 1, state).value;
+    ref<Expr> agg = eval(ki, 0, state).getValue();
+    ref<Expr> val = eval(ki, 1, state).getValue();
 
     ref<Expr> l = NULL, r = NULL;
     unsigned lOffset = kgepi->offset*8, rOffset = kgepi->offset*8 + val->getWidth();
@@ -2589,7 +2892,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::ExtractValue: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
 
-    ref<Expr> agg = eval(ki, 0, state).value;
+    ref<Expr> agg = eval(ki, 0, state).getValue();
 
     ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, getWidthForLLVMType(kmodule(state), i->getType()));
 
@@ -2688,7 +2991,7 @@ void Executor::bindModuleConstants(KModule *kmodule) {
   kmodule->constantTable = new Cell[kmodule->constants.size()];
   for (unsigned i=0; i<kmodule->constants.size(); ++i) {
     Cell &c = kmodule->constantTable[i];
-    c.value = evalConstant(kmodule, kmodule->constants[i]);
+    c.setValue(evalConstant(kmodule, kmodule->constants[i]));
   }
 }
 
@@ -2776,6 +3079,11 @@ void Executor::run(ExecutionState &initialState) {
 
   while (!states.empty() && !haltExecution) {
     ExecutionState &state = searcher->selectState();
+    if (!state.pendingCondition.isNull() && !resolvePendingCondition(state)) {
+      updateStates(&state);
+      continue;
+    }
+
     KInstruction *ki = state.pc();
     stepInstruction(state);
 
@@ -2815,6 +3123,9 @@ void Executor::run(ExecutionState &initialState) {
                         terminateStateEarly(*arr[N - 1], "memory limit");
                     }
                 }
+                // Free what the solvers keep for expressions built so
+                // far; it is rebuilt on demand.
+                ExprContext::get().clearCaches();
                 atMemoryLimit = true;
             } else {
                 atMemoryLimit = false;
@@ -2897,7 +3208,10 @@ void Executor::terminateState(ExecutionState &state) {
                         "replay did not consume all objects in test input.");
     }
 
-	interpreterHandler->incPathsExplored();
+	// A lazily forked state whose branch was never checked is not known to
+	// be a path.
+	if (state.pendingCondition.isNull())
+	  interpreterHandler->incPathsExplored();
 
 	std::set<ExecutionState*>::iterator it = addedStates.find(&state);
 	if (it == addedStates.end()) {
@@ -2918,6 +3232,9 @@ void Executor::terminateState(ExecutionState &state) {
 
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
+  if (!state.pendingCondition.isNull() && !resolvePendingCondition(state))
+    return;
+
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
@@ -3932,7 +4249,14 @@ void Executor::getConstraintLog(const ExecutionState &state,
   case STP:
   {
 	  Query query(state.constraints(), ConstantExpr::alloc(0, Expr::Bool));
-	  char *log = solver->stpSolver->getConstraintLog(query);
+	  // Without STP as the core solver, print the log with a throwaway one.
+	  char *log;
+	  if (solver->stpSolver) {
+	    log = solver->stpSolver->getConstraintLog(query);
+	  } else {
+	    STPSolver stpSolver(false, STPOptimizeDivides);
+	    log = stpSolver.getConstraintLog(query);
+	  }
 	  res = std::string(log);
 	  free(log);
   }
@@ -91,6 +91,15 @@ namespace klee {
 	  SOLVER_SMTLIB ///< Log queries passed to solver (optimised) in .smt2 (SMT-LIBv2) format
   };
 
+  ///The complete solvers that can be raced against each other
+  enum PortfolioSolverKind
+  {
+	  PORTFOLIO_STP, ///< STP
+	  PORTFOLIO_STP_FORKED, ///< STP run in a forked process
+	  PORTFOLIO_STP_NO_OPTIMIZE_DIVIDES, ///< STP without constant division optimization
+	  PORTFOLIO_SMTLIB ///< The solver given by -smtlib-solver
+  };
+
 
   /// \todo Add a context object to keep track of data only live
   /// during an instruction step. Should contain addedStates,
@@ -201,6 +210,7 @@ private:
                                     ExecutionState &state);
   
   void executeInstruction(ExecutionState &state, KInstruction *ki);
+  bool executeImmediateInstruction(ExecutionState &state, KInstruction *ki);
 
   void printFileLine(ExecutionState &state, KInstruction *ki);
 
@@ -332,6 +342,12 @@ private:
   StatePair fork(ExecutionState &current, int reason);
   ForkTag getForkTag(ExecutionState &current, int reason);
 
+  /// resolvePendingCondition - Check the branch condition a lazily forked
+  /// state was created with, and add it to the state's constraints. If it
+  /// cannot be satisfied (or the query times out) the state is terminated
+  /// and false is returned.
+  bool resolvePendingCondition(ExecutionState &state);
+
   /// Add the given (boolean) condition as a constraint on state. This
   /// function is a wrapper around the state's addConstraint function
   /// which also manages manages propogation of implied values,
@@ -103,7 +103,7 @@ StackTrace Thread::getStackTrace() const {
     for (Function::arg_iterator ai = f->arg_begin(), ae = f->arg_end();
          ai != ae; ++ai) {
 
-      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].value;
+      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].getValue();
       arguments.push_back(value);
     }
 
@@ -26,23 +26,31 @@ namespace klee {
   public:
     Solver *solver;
     STPSolver *stpSolver;
+    Solver *coreSolver;
     bool simplifyExprs;
 
   public:
     /// TimingSolver - Construct a new timing solver.
     ///
+    /// \param _stpSolver - The STP solver at the end of the chain, or null
+    /// when a different core solver is used.
+    /// \param _coreSolver - The complete solver at the end of the chain, which
+    /// timeouts are set on. Defaults to \a _stpSolver.
     /// \param _simplifyExprs - Whether expressions should be
     /// simplified (via the constraint manager interface) prior to
     /// querying.
     TimingSolver(Solver *_solver, STPSolver *_stpSolver, 
+                 Solver *_coreSolver = 0,
                  bool _simplifyExprs = true) 
-      : solver(_solver), stpSolver(_stpSolver), simplifyExprs(_simplifyExprs) {}
+      : solver(_solver), stpSolver(_stpSolver),
+        coreSolver(_coreSolver ? _coreSolver : (Solver*) _stpSolver),
+        simplifyExprs(_simplifyExprs) {}
     ~TimingSolver() {
       delete solver;
     }
 
     void setTimeout(double t) {
-      stpSolver->setTimeout(t);
+      coreSolver->setTimeout(t);
     }
 
     bool evaluate(const ExecutionState&, ref<Expr>, Solver::Validity &result);
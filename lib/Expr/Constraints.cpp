@@ -10,10 +10,13 @@
 #include "klee/Constraints.h"
 
 #include "klee/util/ExprPPrinter.h"
+#include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <set>
 
 using namespace klee;
 
@@ -43,43 +46,112 @@ public:
 
 class ExprReplaceVisitor2 : public ExprVisitor {
 private:
-  const std::map< ref<Expr>, ref<Expr> > &replacements;
+  const ImmutableMap< ref<Expr>, ref<Expr> > &replacements;
 
 public:
-  ExprReplaceVisitor2(const std::map< ref<Expr>, ref<Expr> > &_replacements) 
+  ExprReplaceVisitor2(const ImmutableMap< ref<Expr>, ref<Expr> > &_replacements)
     : ExprVisitor(true),
       replacements(_replacements) {}
 
   Action visitExprPost(const Expr &e) {
-    std::map< ref<Expr>, ref<Expr> >::const_iterator it =
-      replacements.find(ref<Expr>(const_cast<Expr*>(&e)));
-    if (it!=replacements.end()) {
-      return Action::changeTo(it->second);
+    const std::pair< ref<Expr>, ref<Expr> > *res =
+      replacements.lookup(ref<Expr>(const_cast<Expr*>(&e)));
+    if (res) {
+      return Action::changeTo(res->second);
     } else {
       return Action::doChildren();
     }
   }
 };
 
-bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintManager::constraints_ty old;
-  bool changed = false;
+/// getReadKeys - Find the array bytes \a e reads, in order and without
+/// duplicates.
+static void getReadKeys(ref<Expr> e,
+                        std::vector< std::pair<const Array*, unsigned> >
+                          &keys) {
+  std::vector< ref<ReadExpr> > reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+  for (unsigned i = 0; i != reads.size(); ++i) {
+    ReadExpr *re = reads[i].get();
+    const Array *array = re->updates.root;
 
-  constraints.swap(old);
-  for (ConstraintManager::constraints_ty::iterator 
-         it = old.begin(), ie = old.end(); it != ie; ++it) {
-    ref<Expr> &ce = *it;
+    // Reads of a constant array don't alias.
+    if (array->isConstantArray() && !re->updates.head)
+      continue;
+
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index))
+      keys.push_back(std::make_pair(array, (unsigned) CE->getZExtValue(32)));
+    else
+      keys.push_back(std::make_pair(array, ~0U));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+/// getReaders - Find the indices of the constraints which might contain
+/// \a e, in order: those which read what it reads, or all of them if it
+/// reads nothing.
+void ConstraintManager::getReaders(ref<Expr> e,
+                                   std::vector<unsigned> &result) const {
+  std::vector<ReadKey> keys;
+  getReadKeys(e, keys);
+  if (keys.empty()) {
+    for (unsigned i = 0; i != constraints.size(); ++i)
+      result.push_back(i);
+    return;
+  }
+
+  // A constraint containing e reads every byte e reads, so the readers of
+  // any one of them will do; use the one with the fewest.
+  const PersistentVector<unsigned> *best = 0;
+  for (unsigned i = 0; i != keys.size(); ++i) {
+    const std::pair<ReadKey, PersistentVector<unsigned> > *res =
+      readers.lookup(keys[i]);
+    if (!res)
+      return;
+    if (!best || res->second.size() < best->size())
+      best = &res->second;
+  }
+  result.insert(result.end(), best->begin(), best->end());
+}
+
+bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor,
+                                           ref<Expr> target) {
+  std::vector<unsigned> candidates;
+  getReaders(target, candidates);
+
+  std::vector< std::pair<unsigned, ref<Expr> > > rewritten;
+  for (unsigned i = 0; i != candidates.size(); ++i) {
+    const ref<Expr> &ce = constraints[candidates[i]];
     ref<Expr> e = visitor.visit(ce);
+    if (e != ce)
+      rewritten.push_back(std::make_pair(candidates[i], e));
+  }
+  if (rewritten.empty())
+    return false;
 
-    if (e!=ce) {
-      addConstraintInternal(e); // enable further reductions
-      changed = true;
-    } else {
-      constraints.push_back(ce);
-    }
+  // Rebuild the constraints without the rewritten ones, reusing what is
+  // known about the others, and then add the rewritten ones back.
+  constraints_ty oldConstraints;
+  PersistentVector< ref<ConstraintReads> > oldReads;
+  constraints.swap(oldConstraints);
+  constraintReads.swap(oldReads);
+  constraintsHash = 0;
+  equalities = ImmutableMap< ref<Expr>, ref<Expr> >();
+  readers = ImmutableMap< ReadKey, PersistentVector<unsigned> >();
+  partitioned = false;
+
+  unsigned next = 0;
+  for (unsigned i = 0; i != oldConstraints.size(); ++i) {
+    if (next != rewritten.size() && rewritten[next].first == i)
+      ++next;
+    else
+      pushConstraint(oldConstraints[i], oldReads[i]);
   }
+  for (unsigned i = 0; i != rewritten.size(); ++i)
+    addConstraintInternal(rewritten[i].second); // enable further reductions
 
-  return changed;
+  return true;
 }
 
 void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
@@ -87,39 +159,15 @@ void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
 }
 
 ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e) const {
-  if (isa<ConstantExpr>(e))
+  if (isa<ConstantExpr>(e) || equalities.empty())
     return e;
 
-  std::map< ref<Expr>, ref<Expr> > equalities;
-  
-  for (ConstraintManager::constraints_ty::const_iterator 
-         it = constraints.begin(), ie = constraints.end(); it != ie; ++it) {
-    if (const EqExpr *ee = dyn_cast<EqExpr>(*it)) {
-      if (isa<ConstantExpr>(ee->left)) {
-        equalities.insert(std::make_pair(ee->right,
-                                         ee->left));
-      } else {
-        equalities.insert(std::make_pair(*it,
-                                         ConstantExpr::alloc(1, Expr::Bool)));
-      }
-    } else {
-      equalities.insert(std::make_pair(*it,
-                                       ConstantExpr::alloc(1, Expr::Bool)));
-    }
-  }
-
   return ExprReplaceVisitor2(equalities).visit(e);
 }
 
 void ConstraintManager::addConstraintInternal(ref<Expr> e) {
   // rewrite any known equalities 
 
-  // XXX should profile the effects of this and the overhead.
-  // traversing the constraints looking for equalities is hardly the
-  // slowest thing we do, but it is probably nicer to have a
-  // ConstraintSet ADT which efficiently remembers obvious patterns
-  // (byte-constant comparison).
-
   switch (e->getKind()) {
   case Expr::Constant:
     assert(cast<ConstantExpr>(e)->isTrue() && 
@@ -138,14 +186,14 @@ void ConstraintManager::addConstraintInternal(ref<Expr> e) {
     BinaryExpr *be = cast<BinaryExpr>(e);
     if (isa<ConstantExpr>(be->left)) {
       ExprReplaceVisitor visitor(be->right, be->left);
-      rewriteConstraints(visitor);
+      rewriteConstraints(visitor, be->right);
     }
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
     
   default:
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
 }
@@ -155,6 +203,164 @@ void ConstraintManager::addConstraint(ref<Expr> e) {
   addConstraintInternal(e);
 }
 
+void ConstraintManager::pushConstraint(ref<Expr> e) {
+  ref<ConstraintReads> reads = new ConstraintReads();
+  getReadKeys(e, reads->keys);
+  pushConstraint(e, reads);
+}
+
+void ConstraintManager::pushConstraint(ref<Expr> e,
+                                       const ref<ConstraintReads> &reads) {
+  unsigned index = constraints.size();
+  constraints.push_back(e);
+  constraintReads.push_back(reads);
+  constraintsHash += e->hash();
+
+  const EqExpr *ee = dyn_cast<EqExpr>(e);
+  if (ee && isa<ConstantExpr>(ee->left))
+    equalities = equalities.insert(std::make_pair(ee->right, ee->left));
+  else
+    equalities = equalities.insert(
+      std::make_pair(e, ConstantExpr::alloc(1, Expr::Bool)));
+
+  for (unsigned i = 0; i != reads->keys.size(); ++i) {
+    const std::pair<ReadKey, PersistentVector<unsigned> > *res =
+      readers.lookup(reads->keys[i]);
+    PersistentVector<unsigned> indices;
+    if (res)
+      indices = res->second;
+    indices.push_back(index);
+    readers = readers.replace(std::make_pair(reads->keys[i], indices));
+  }
+
+  if (partitioned)
+    addToPartition(index);
+}
+
+/***/
+
+unsigned ConstraintManager::findFactor(unsigned index) const {
+  while (const std::pair<unsigned, unsigned> *res = factorParent.lookup(index))
+    index = res->second;
+  return index;
+}
+
+void ConstraintManager::unionFactors(unsigned a, unsigned b) const {
+  a = findFactor(a);
+  b = findFactor(b);
+  if (a == b)
+    return;
+
+  // Keep the larger factor's root.
+  PersistentVector<unsigned> membersA = factorMembers.lookup(a)->second;
+  PersistentVector<unsigned> membersB = factorMembers.lookup(b)->second;
+  if (membersA.size() < membersB.size()) {
+    std::swap(a, b);
+    membersA.swap(membersB);
+  }
+  factorParent = factorParent.insert(std::make_pair(b, a));
+  for (PersistentVector<unsigned>::const_iterator it = membersB.begin(),
+         ie = membersB.end(); it != ie; ++it)
+    membersA.push_back(*it);
+  factorMembers = factorMembers.remove(b);
+  factorMembers = factorMembers.replace(std::make_pair(a, membersA));
+}
+
+/// addToPartition - Add the constraint at \a index, which must be the last
+/// one not yet in the partition, to the factors of the bytes it reads.
+void ConstraintManager::addToPartition(unsigned index) const {
+  PersistentVector<unsigned> members;
+  members.push_back(index);
+  factorMembers = factorMembers.insert(std::make_pair(index, members));
+
+  const std::vector<ReadKey> &keys = constraintReads[index]->keys;
+  for (unsigned i = 0; i != keys.size(); ++i) {
+    const Array *array = keys[i].first;
+    unsigned byte = keys[i].second;
+
+    const std::pair<const Array*, unsigned> *whole =
+      wholeReaders.lookup(array);
+    if (byte != ~0U) {
+      if (whole) {
+        unionFactors(index, whole->second);
+      } else {
+        const std::pair<ReadKey, unsigned> *res = byteReaders.lookup(keys[i]);
+        if (res)
+          unionFactors(index, res->second);
+        else
+          byteReaders = byteReaders.insert(std::make_pair(keys[i], index));
+      }
+    } else {
+      if (whole)
+        unionFactors(index, whole->second);
+      else
+        wholeReaders = wholeReaders.insert(std::make_pair(array, index));
+
+      // Every byte of the array now belongs to this factor.
+      std::vector<ReadKey> bytes;
+      for (ImmutableMap<ReadKey, unsigned>::iterator
+             it = byteReaders.lower_bound(ReadKey(array, 0)),
+             ie = byteReaders.end(); it != ie && it->first.first == array;
+           ++it) {
+        unionFactors(index, it->second);
+        bytes.push_back(it->first);
+      }
+      for (unsigned j = 0; j != bytes.size(); ++j)
+        byteReaders = byteReaders.remove(bytes[j]);
+    }
+  }
+}
+
+void ConstraintManager::getIndependentConstraints(ref<Expr> e,
+                                                  std::vector< ref<Expr> >
+                                                    &result) const {
+  if (!partitioned) {
+    factorParent = ImmutableMap<unsigned, unsigned>();
+    factorMembers = ImmutableMap<unsigned, PersistentVector<unsigned> >();
+    byteReaders = ImmutableMap<ReadKey, unsigned>();
+    wholeReaders = ImmutableMap<const Array*, unsigned>();
+    for (unsigned i = 0; i != constraints.size(); ++i)
+      addToPartition(i);
+    partitioned = true;
+  }
+
+  std::set<unsigned> factors;
+  std::vector<ReadKey> keys;
+  getReadKeys(e, keys);
+  for (unsigned i = 0; i != keys.size(); ++i) {
+    const Array *array = keys[i].first;
+    unsigned byte = keys[i].second;
+
+    const std::pair<const Array*, unsigned> *whole =
+      wholeReaders.lookup(array);
+    if (whole)
+      factors.insert(findFactor(whole->second));
+
+    if (byte != ~0U) {
+      const std::pair<ReadKey, unsigned> *res = byteReaders.lookup(keys[i]);
+      if (res)
+        factors.insert(findFactor(res->second));
+    } else {
+      for (ImmutableMap<ReadKey, unsigned>::iterator
+             it = byteReaders.lower_bound(ReadKey(array, 0)),
+             ie = byteReaders.end(); it != ie && it->first.first == array;
+           ++it)
+        factors.insert(findFactor(it->second));
+    }
+  }
+
+  std::vector<unsigned> members;
+  for (std::set<unsigned>::iterator it = factors.begin(), ie = factors.end();
+       it != ie; ++it) {
+    const PersistentVector<unsigned> &factor =
+      factorMembers.lookup(*it)->second;
+    members.insert(members.end(), factor.begin(), factor.end());
+  }
+  std::sort(members.begin(), members.end());
+  for (unsigned i = 0; i != members.size(); ++i)
+    result.push_back(constraints[members[i]]);
+}
+
 void ConstraintManager::dump(std::ostream &out) const {
   int count = 0;
   for (const_iterator i = constraints.begin(); i != constraints.end(); ++i) {
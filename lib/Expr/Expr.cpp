@@ -44,8 +44,19 @@ namespace {
   AssumeFPAssoc("assume-fp-assoc", 
                 llvm::cl::desc("Assume floating point operations are associative"),
                 llvm::cl::init(false));
+
+  cl::opt<bool>
+  RelaxedFP("relaxed-fp",
+            llvm::cl::desc("Apply floating point simplifications which do not hold for all IEEE 754 values (implies -assume-finite, -assume-positive-zero and -assume-fp-assoc)"),
+            llvm::cl::init(false));
 }
 
+/// The floating point assumptions in effect. Without them only the
+/// simplifications exact under IEEE 754 are applied.
+static bool assumeFinite() { return AssumeFinite || RelaxedFP; }
+static bool assumePositiveZero() { return AssumePositiveZero || RelaxedFP; }
+static bool assumeFPAssoc() { return AssumeFPAssoc || RelaxedFP; }
+
 /***/
 
 unsigned Expr::count = 0;
@@ -97,19 +108,9 @@ ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
 }
 
 // returns 0 if b is structurally equal to *this
-int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
+int Expr::compare(const Expr &b) const {
   if (this == &b) return 0;
 
-  const Expr *ap, *bp;
-  if (this < &b) {
-    ap = this; bp = &b;
-  } else {
-    ap = &b; bp = this;
-  }
-
-  if (equivs.count(std::make_pair(ap, bp)))
-    return 0;
-
   Kind ak = getKind(), bk = b.getKind();
   if (ak!=bk)
     return (ak < bk) ? -1 : 1;
@@ -120,12 +121,15 @@ int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
   if (int res = compareContents(b)) 
     return res;
 
+  // Equal kids are the same expression, so only the first kids which
+  // differ need to be compared.
   unsigned aN = getNumKids();
-  for (unsigned i=0; i<aN; i++)
-    if (int res = getKid(i)->compare(*b.getKid(i), equivs))
-      return res;
+  for (unsigned i=0; i<aN; i++) {
+    ref<Expr> aKid = getKid(i), bKid = b.getKid(i);
+    if (aKid.get() != bKid.get())
+      return aKid->compare(*bKid);
+  }
 
-  equivs.insert(std::make_pair(ap, bp));
   return 0;
 }
 
@@ -196,9 +200,11 @@ void Expr::printKind(std::ostream &os, Kind k) {
 unsigned Expr::computeHash() {
   unsigned res = getKind() * Expr::MAGIC_HASH_CONSTANT;
 
+  // Rotate rather than shift, so the hashes of deep kids are not shifted
+  // out: chains of the same shape would all hash alike past a few levels.
   int n = getNumKids();
   for (int i = 0; i < n; i++) {
-    res <<= 1;
+    res = (res << 1) | (res >> 31);
     res ^= getKid(i)->hash() * Expr::MAGIC_HASH_CONSTANT;
   }
   
@@ -714,14 +720,8 @@ ref<Expr>  NotOptimizedExpr::create(ref<Expr> src) {
 
 /***/
 
-extern "C" void vc_DeleteExpr(void*);
-
 Array::~Array() {
-  // FIXME: This shouldn't be necessary.
-  if (stpInitialArray) {
-    ::vc_DeleteExpr(stpInitialArray);
-    stpInitialArray = 0;
-  }
+  ExprContext::get().forgetArray(this);
 }
 
 /***/
@@ -736,6 +736,22 @@ ref<Expr> ReadExpr::create(const UpdateList &ul, ref<Expr> index) {
   // a smart UpdateList so it is not worth rescanning.
 
   const UpdateNode *un = ul.head;
+
+  // A read at a concrete index resolves through the latest write at that
+  // index, or else skips the writes at the other concrete indices.
+  const UpdateNode *start = un;
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(index);
+  if (un && CE && CE->getWidth() <= 64) {
+    uint64_t concreteIndex = CE->getZExtValue();
+    if (const UpdateNode *write = un->findConcreteWrite(concreteIndex, start))
+      return write->value;
+
+    if (!start && ul.root->isConstantArray() &&
+        concreteIndex < ul.root->size)
+      return ul.root->constantValues[concreteIndex];
+    un = start;
+  }
+
   for (; un; un=un->next) {
     ref<Expr> cond = EqExpr::create(index, un->index);
     
@@ -747,6 +763,8 @@ ref<Expr> ReadExpr::create(const UpdateList &ul, ref<Expr> index) {
     }
   }
 
+  if (start != ul.head)
+    return ReadExpr::alloc(UpdateList(ul.root, start), index);
   return ReadExpr::alloc(ul, index);
 }
 
@@ -958,10 +976,43 @@ ref<Expr> _e_op::create(const ref<Expr> &e, const fltSemantics *sem, bool isIEEE
   } else if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {                        \
     return CE->_op(sem, isIEEE);                                                    \
   } else {                                                                          \
-    return _e_op::alloc(e, sem, isIEEE);                                            \
+    return _e_op ## _create(e, sem, isIEEE);                                        \
   }                                                                                 \
 }
 
+static ref<Expr> FPExtExpr_create(const ref<Expr> &e, const fltSemantics *sem,
+                                  bool isIEEE) {
+  // FPExt(FPExt(X)) ==> FPExt(X), as both are exact
+  if (FPExtExpr *fe = dyn_cast<FPExtExpr>(e))
+    if (!SemMismatch(isIEEE, fe->getSemantics()))
+      return FPExtExpr::create(fe->src, sem, fe->fromIsIEEE());
+  return FPExtExpr::alloc(e, sem, isIEEE);
+}
+
+static ref<Expr> FPTruncExpr_create(const ref<Expr> &e, const fltSemantics *sem,
+                                    bool isIEEE) {
+  // FPTrunc(FPExt(X)) ==> X, FPExt(X) or FPTrunc(X), as the extension is
+  // exact. The double-double format is left alone as its values are not
+  // ordered by width against the others.
+  if (FPExtExpr *fe = dyn_cast<FPExtExpr>(e))
+    if (!SemMismatch(isIEEE, fe->getSemantics()) &&
+        fe->getSemantics() != &APFloat::PPCDoubleDouble &&
+        sem != &APFloat::PPCDoubleDouble &&
+        !(fe->src->getWidth() == 128 && !fe->fromIsIEEE())) {
+      if (fe->src->getWidth() <= WidthForSemantics(*sem))
+        return FPExtExpr::create(fe->src, sem, fe->fromIsIEEE());
+      return FPTruncExpr::create(fe->src, sem, fe->fromIsIEEE());
+    }
+
+  // FPTrunc(FPTrunc(X)) ==> FPTrunc(X), which rounds once rather than twice
+  if (RelaxedFP)
+    if (FPTruncExpr *ft = dyn_cast<FPTruncExpr>(e))
+      if (!SemMismatch(isIEEE, ft->getSemantics()))
+        return FPTruncExpr::create(ft->src, sem, ft->fromIsIEEE());
+
+  return FPTruncExpr::alloc(e, sem, isIEEE);
+}
+
 FCCREATE(FPExtExpr, FPExt)
 FCCREATE(FPTruncExpr, FPTrunc)
 
@@ -1316,7 +1367,7 @@ static ref<Expr> reassociate(ref<Expr> (*ctor)(const ref<Expr> &l,
                                                bool isIEEE),
                              Expr::Kind kind, ref<Expr> l, ref<Expr> r,
                              bool isIEEE) {
-   if (AssumeFPAssoc && r->getKind() == kind) {
+   if (assumeFPAssoc() && r->getKind() == kind) {
      FBinaryExpr *br = cast<FBinaryExpr>(r);
      if (isIEEE == br->isIEEE())
        return ctor(ctor(l, br->getKid(0), isIEEE), br->getKid(1), isIEEE);
@@ -1324,17 +1375,37 @@ static ref<Expr> reassociate(ref<Expr> (*ctor)(const ref<Expr> &l,
    return ref<Expr>();
 }
 
+/// getNegatedOperand - If \a e is the negation (0 - X) of some X, return
+/// X. Only -0 - X negates exactly; +0 - X does for positive zeros.
+static ref<Expr> getNegatedOperand(const ref<Expr> &e, bool isIEEE) {
+  if (FSubExpr *fs = dyn_cast<FSubExpr>(e))
+    if (fs->isIEEE() == isIEEE)
+      if (ConstantExpr *cl = dyn_cast<ConstantExpr>(fs->left)) {
+        APFloat apf = cl->getAPFloatValue(isIEEE);
+        if (apf.isZero() && (apf.isNegative() || assumePositiveZero()))
+          return fs->right;
+      }
+  return ref<Expr>();
+}
+
 static ref<Expr> FAddExpr_create(const ref<Expr> &l, const ref<Expr> &r, bool isIEEE) {
   if (ConstantExpr *cl = dyn_cast<ConstantExpr>(l)) {
     APFloat apf = cl->getAPFloatValue(isIEEE);
-    if (apf.isZero() && (apf.isNegative() || AssumePositiveZero))
+    if (apf.isZero() && (apf.isNegative() || assumePositiveZero()))
       return r;
   }
   if (ConstantExpr *cr = dyn_cast<ConstantExpr>(r)) {
     APFloat apf = cr->getAPFloatValue(isIEEE);
-    if (apf.isZero() && (apf.isNegative() || AssumePositiveZero))
+    if (apf.isZero() && (apf.isNegative() || assumePositiveZero()))
       return l;
   }
+  // X + -Y ==> X - Y, and -X + Y ==> Y - X
+  ref<Expr> nr = getNegatedOperand(r, isIEEE);
+  if (!nr.isNull())
+    return FSubExpr::create(l, nr, isIEEE);
+  ref<Expr> nl = getNegatedOperand(l, isIEEE);
+  if (!nl.isNull())
+    return FSubExpr::create(r, nl, isIEEE);
   ref<Expr> res = reassociate(FAddExpr::create, Expr::FAdd, l, r, isIEEE);
   if (!res.isNull())
     return res;
@@ -1344,9 +1415,17 @@ static ref<Expr> FAddExpr_create(const ref<Expr> &l, const ref<Expr> &r, bool is
 static ref<Expr> FSubExpr_create(const ref<Expr> &l, const ref<Expr> &r, bool isIEEE) {
   if (ConstantExpr *cr = dyn_cast<ConstantExpr>(r)) {
     APFloat apf = cr->getAPFloatValue(isIEEE);
-    if (apf.isZero() && !apf.isNegative())
+    if (apf.isZero() && (!apf.isNegative() || assumePositiveZero()))
       return l;
   }
+  // X - -Y ==> X + Y (which also removes double negations)
+  ref<Expr> nr = getNegatedOperand(r, isIEEE);
+  if (!nr.isNull())
+    return FAddExpr::create(l, nr, isIEEE);
+  // X - X ==> +0, unless X is infinite or NaN
+  if (l == r && assumeFinite())
+    return ConstantExpr::create(
+      ConstantExpr::alloc(0, l->getWidth())->getAPFloatValue(isIEEE));
   return FSubExpr::alloc(l, r, isIEEE);
 }
 
@@ -1355,16 +1434,20 @@ static ref<Expr> FMulExpr_create(const ref<Expr> &l, const ref<Expr> &r, bool is
     APFloat apf = cl->getAPFloatValue(isIEEE);
     if (isOne(apf))
       return r;
-    if (AssumeFinite && AssumePositiveZero && apf.isZero())
+    if (assumeFinite() && assumePositiveZero() && apf.isZero())
       return l;
   }
   if (ConstantExpr *cr = dyn_cast<ConstantExpr>(r)) {
     APFloat apf = cr->getAPFloatValue(isIEEE);
     if (isOne(apf))
       return l;
-    if (AssumeFinite && AssumePositiveZero && apf.isZero())
+    if (assumeFinite() && assumePositiveZero() && apf.isZero())
       return r;
   }
+  // -X * -Y ==> X * Y
+  ref<Expr> nl = getNegatedOperand(l, isIEEE), nr = getNegatedOperand(r, isIEEE);
+  if (!nl.isNull() && !nr.isNull())
+    return FMulExpr::create(nl, nr, isIEEE);
   ref<Expr> res = reassociate(FMulExpr::create, Expr::FMul, l, r, isIEEE);
   if (!res.isNull())
     return res;
@@ -1372,6 +1455,13 @@ static ref<Expr> FMulExpr_create(const ref<Expr> &l, const ref<Expr> &r, bool is
 }
 
 static ref<Expr> FDivExpr_create(const ref<Expr> &l, const ref<Expr> &r, bool isIEEE) {
+  if (ConstantExpr *cr = dyn_cast<ConstantExpr>(r))
+    if (isOne(cr->getAPFloatValue(isIEEE)))
+      return l;
+  // -X / -Y ==> X / Y
+  ref<Expr> nl = getNegatedOperand(l, isIEEE), nr = getNegatedOperand(r, isIEEE);
+  if (!nl.isNull() && !nr.isNull())
+    return FDivExpr::create(nl, nr, isIEEE);
   return FDivExpr::alloc(l, r, isIEEE);
 }
 
@@ -1911,6 +2001,46 @@ static SimplifyResult simplifyTRUE(const ref<Expr> &l, const ref<Expr> &r, Expr:
   return srTrue;
 }
 
+static bool isIToFP(const Expr *e) {
+  return isa<UIToFPExpr>(e) || isa<SIToFPExpr>(e);
+}
+
+/// isExactIToFP - Whether \a e converts an integer to floating point
+/// without rounding.
+static bool isExactIToFP(const Expr *e, bool isIEEE) {
+  if (!isIToFP(e))
+    return false;
+  const FConvertExpr *ifc = cast<FConvertExpr>(e);
+  if (SemMismatch(isIEEE, ifc->getSemantics()))
+    return false;
+  unsigned precision = APFloat::semanticsPrecision(*ifc->getSemantics());
+  return precision + isa<SIToFPExpr>(e) >= ifc->src->getWidth();
+}
+
+/// createIntCmp - Create the comparison of the integers \a l and \a r
+/// which holds iff the ordered part of the predicate \a p does.
+static ref<Expr> createIntCmp(unsigned p, const ref<Expr> &l,
+                              const ref<Expr> &r, bool isSigned) {
+  switch (p & FCmpExpr::ORD) {
+  case FCmpExpr::FALSE:
+    return ConstantExpr::create(0, Expr::Bool);
+  case FCmpExpr::OEQ:
+    return EqExpr::create(l, r);
+  case FCmpExpr::OGT:
+    return isSigned ? SltExpr::create(r, l) : UltExpr::create(r, l);
+  case FCmpExpr::OGE:
+    return isSigned ? SleExpr::create(r, l) : UleExpr::create(r, l);
+  case FCmpExpr::OLT:
+    return isSigned ? SltExpr::create(l, r) : UltExpr::create(l, r);
+  case FCmpExpr::OLE:
+    return isSigned ? SleExpr::create(l, r) : UleExpr::create(l, r);
+  case FCmpExpr::ONE:
+    return Expr::createIsZero(EqExpr::create(l, r));
+  default:
+    return ConstantExpr::create(1, Expr::Bool);
+  }
+}
+
 static ref<Expr> FCmpExpr_create(const ref<Expr> &l, const ref<Expr> &r, const ref<Expr> &pred, bool isIEEE) {
   unsigned p = dyn_cast<ConstantExpr>(pred)->getZExtValue();
   if ((p & (FCmpExpr::OLT | FCmpExpr::OGT)) == FCmpExpr::OGT) {
@@ -1918,6 +2048,26 @@ static ref<Expr> FCmpExpr_create(const ref<Expr> &l, const ref<Expr> &r, const r
     return FCmpExpr::create(r, l, ConstantExpr::create(p, 4), isIEEE);
   }
 
+  // X <pred> X holds iff X is ordered and pred includes equality, or X is
+  // a NaN and pred includes unordered
+  if (l == r) {
+    bool eq = p & FCmpExpr::OEQ, uno = p & FCmpExpr::UNO;
+    if (eq == uno)
+      return ConstantExpr::create(eq, Expr::Bool);
+    ref<Expr> ord = FOrd1Expr::create(l, isIEEE);
+    return eq ? ord : Expr::createIsZero(ord);
+  }
+
+  // F<pred>(?IToFP(X), ?IToFP(Y)) ==> <pred>(X, Y), when both convert
+  // alike and exactly (and so never give a NaN)
+  if (l->getKind() == r->getKind() && isExactIToFP(l.get(), isIEEE) &&
+      isExactIToFP(r.get(), isIEEE)) {
+    FConvertExpr *fl = cast<FConvertExpr>(l), *fr = cast<FConvertExpr>(r);
+    if (fl->getSemantics() == fr->getSemantics() &&
+        fl->src->getWidth() == fr->src->getWidth())
+      return createIntCmp(p, fl->src, fr->src, isa<SIToFPExpr>(l));
+  }
+
   unsigned pMin = p, pMax = p;
 
   Expr::FPCategories lcat = l->getCategories(isIEEE),
@@ -1960,6 +2110,9 @@ static bool simplifyFeq(const ref<ConstantExpr> &cl, Expr *r, const ref<Expr> &p
    * F{O,U}eq(?IToFP(X), Const)    to    Eq(X, FPTo?I(Const))
    * thus permitting STP to examine the expression X.
    */
+  if (!isIToFP(r))
+    return false;
+
   if (FConvertExpr *ifc = dyn_cast<FConvertExpr>(r))
     if (!SemMismatch(isIEEE, ifc->getSemantics())) {
       /* First, check that the constant has no fractional component,
@@ -1969,8 +2122,8 @@ static bool simplifyFeq(const ref<ConstantExpr> &cl, Expr *r, const ref<Expr> &p
       ref<Expr> kid = ifc->getKid(0);
       ref<ConstantExpr> clint = isSigned ? cl->FPToSI(kid->getWidth(), isIEEE, false)
                                          : cl->FPToUI(kid->getWidth(), isIEEE, false);
-      ref<ConstantExpr> clf = isSigned ? cl->SIToFP(ifc->getSemantics())
-                                       : cl->UIToFP(ifc->getSemantics());
+      ref<ConstantExpr> clf = isSigned ? clint->SIToFP(ifc->getSemantics())
+                                       : clint->UIToFP(ifc->getSemantics());
       if (cl->FCmp(clf, ConstantExpr::create(FCmpExpr::OEQ, 4), isIEEE)->isOne()) {
         /* Second, check that the conversion for the non-constant operand will
          * not be rounded, or that even if it is rounded, the result would not
@@ -2005,11 +2158,72 @@ static bool simplifyFeq(const ref<ConstantExpr> &cl, Expr *r, const ref<Expr> &p
   return false;
 }
 
+/* Where the conversion is exact, we can reduce any
+ *   F<pred>(?IToFP(X), Const)    to    <pred>(X, Bound)
+ * where Bound is the integer nearest the constant on the side the predicate
+ * needs (or to a constant if the constant is out of range of X).
+ */
+static bool simplifyFCmpIToFP(Expr *l, const ref<ConstantExpr> &cr, unsigned p, bool isIEEE, ref<Expr> &result) {
+  if (!isExactIToFP(l, isIEEE))
+    return false;
+
+  APFloat c = cr->getAPFloatValue(isIEEE);
+  // Leave NaNs and infinities to the category based simplification.
+  if (c.isNaN() || c.isInfinity())
+    return false;
+
+  FConvertExpr *ifc = cast<FConvertExpr>(l);
+  bool isSigned = isa<SIToFPExpr>(l);
+  ref<Expr> kid = ifc->src;
+  Expr::Width w = kid->getWidth();
+
+  APInt min = isSigned ? APInt::getSignedMinValue(w) : APInt::getMinValue(w);
+  APInt max = isSigned ? APInt::getSignedMaxValue(w) : APInt::getMaxValue(w);
+  ref<ConstantExpr> cmin = ConstantExpr::alloc(min), cmax = ConstantExpr::alloc(max);
+  const fltSemantics *sem = ifc->getSemantics();
+  ref<ConstantExpr> fmin = isSigned ? cmin->SIToFP(sem) : cmin->UIToFP(sem);
+  ref<ConstantExpr> fmax = isSigned ? cmax->SIToFP(sem) : cmax->UIToFP(sem);
+  if (c.compare(fmin->getAPFloatValue(isIEEE)) == APFloat::cmpLessThan) {
+    result = ConstantExpr::create((p & FCmpExpr::OGT) != 0, Expr::Bool);
+    return true;
+  }
+  if (c.compare(fmax->getAPFloatValue(isIEEE)) == APFloat::cmpGreaterThan) {
+    result = ConstantExpr::create((p & FCmpExpr::OLT) != 0, Expr::Bool);
+    return true;
+  }
+
+  // X < C iff X < ceil(C), X <= C iff X <= floor(C), and so on.
+  unsigned ord = p & FCmpExpr::ORD;
+  bool roundDown = ord == FCmpExpr::OLE || ord == FCmpExpr::OGT;
+  uint64_t bits[2];
+  bool isExact;
+  c.convertToInteger(bits, w, isSigned,
+                     roundDown ? APFloat::rmTowardNegative
+                               : APFloat::rmTowardPositive,
+                     &isExact);
+  ref<ConstantExpr> bound = ConstantExpr::alloc(APInt(w, 2, bits));
+
+  // A constant with a fractional part equals no integer.
+  if (!isExact && (ord == FCmpExpr::OEQ || ord == FCmpExpr::ONE)) {
+    result = ConstantExpr::create(ord == FCmpExpr::ONE, Expr::Bool);
+    return true;
+  }
+
+  result = createIntCmp(p, kid, bound, isSigned);
+  return true;
+}
+
 static ref<Expr> FCmpExpr_createPartialR(const ref<ConstantExpr> &cl, Expr *r, const ref<Expr> &pred, bool isIEEE) {
   ref<Expr> sr;
   if (simplifyFeq(cl, r, pred, isIEEE, sr))
     return sr;
 
+  // Const <pred> X is X <swapped pred> Const
+  FCmpExpr::Predicate p =
+    (FCmpExpr::Predicate) cast<ConstantExpr>(pred)->getZExtValue();
+  if (simplifyFCmpIToFP(r, cl, FCmpExpr::getSwappedPredicate(p), isIEEE, sr))
+    return sr;
+
   return FCmpExpr_create(cl, r, pred, isIEEE);
 }
 
@@ -2018,6 +2232,9 @@ static ref<Expr> FCmpExpr_createPartial(Expr *l, const ref<ConstantExpr> &cr, co
   if (simplifyFeq(cr, l, pred, isIEEE, sr))
     return sr;
 
+  if (simplifyFCmpIToFP(l, cr, cast<ConstantExpr>(pred)->getZExtValue(), isIEEE, sr))
+    return sr;
+
   return FCmpExpr_create(l, cr, pred, isIEEE);
 }
 
@@ -9,6 +9,9 @@
 
 #include "klee/ExprBuilder.h"
 
+#include "klee/util/Bits.h"
+#include "klee/util/ValueFacts.h"
+
 using namespace klee;
 
 ExprBuilder::ExprBuilder() {
@@ -982,10 +985,87 @@ namespace {
     ConstantFoldingExprBuilder;
 
   class SimplifyingBuilder : public ChainedBuilder {
+    /// Decide - Return the value of the binary expression of kind \a K
+    /// and width \a W on \a LHS and \a RHS, if the facts about them fix
+    /// it, and null otherwise.
+    ref<Expr> Decide(Expr::Kind K, const ref<Expr> &LHS,
+                     const ref<Expr> &RHS, Expr::Width W) {
+      uint64_t Value;
+      if (ValueFacts::eval(K, getValueFacts(LHS.get()),
+                           getValueFacts(RHS.get()), W).getConstant(Value))
+        return Builder->Constant(Value, W);
+      return 0;
+    }
+
+    /// isRedundantMask - Whether \a Mask clears only bits of \a E which
+    /// are in \a Known (its known zeros, for an and).
+    static bool isRedundantMask(const ref<ConstantExpr> &Mask,
+                                const ref<Expr> &E, uint64_t Known) {
+      if (!getValueFacts(E.get()).isTracked())
+        return false;
+      return !(~Mask->getZExtValue() & ~Known &
+               bits64::maxValueOfNBits(E->getWidth()));
+    }
+
   public:
     SimplifyingBuilder(ExprBuilder *Builder, ExprBuilder *Base)
       : ChainedBuilder(Builder, Base) {}
 
+    ref<Expr> Select(const ref<NonConstantExpr> &Cond,
+                     const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // Select with a condition the facts fix ==> that side
+      uint64_t Value;
+      if (getValueFacts(Cond.get()).getConstant(Value))
+        return Value ? LHS : RHS;
+
+      return Base->Select(Cond, LHS, RHS);
+    }
+
+    ref<Expr> Extract(const ref<NonConstantExpr> &LHS,
+                      unsigned Offset, Expr::Width W) {
+      // Extract of known bits ==> constant
+      const ValueFacts &Facts = getValueFacts(LHS.get());
+      if (Facts.isTracked()) {
+        uint64_t Mask = bits64::maxValueOfNBits(W) << Offset;
+        if (((Facts.knownZero | Facts.knownOne) & Mask) == Mask)
+          return Builder->Constant((Facts.knownOne & Mask) >> Offset, W);
+      }
+
+      return Base->Extract(LHS, Offset, W);
+    }
+
+    ref<Expr> And(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      ref<Expr> Res = Decide(Expr::And, LHS, RHS, LHS->getWidth());
+      if (!Res.isNull())
+        return Res;
+
+      // C & X ==> X, when X is zero wherever C is
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        if (isRedundantMask(CE, RHS, getValueFacts(RHS.get()).knownZero))
+          return RHS;
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(RHS))
+        if (isRedundantMask(CE, LHS, getValueFacts(LHS.get()).knownZero))
+          return LHS;
+
+      return Base->And(LHS, RHS);
+    }
+
+    ref<Expr> Or(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      ref<Expr> Res = Decide(Expr::Or, LHS, RHS, LHS->getWidth());
+      if (!Res.isNull())
+        return Res;
+
+      // C | X ==> X, when X is one wherever C is
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS))
+        if (isRedundantMask(CE->Not(), RHS, getValueFacts(RHS.get()).knownOne))
+          return RHS;
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(RHS))
+        if (isRedundantMask(CE->Not(), LHS, getValueFacts(LHS.get()).knownOne))
+          return LHS;
+
+      return Base->Or(LHS, RHS);
+    }
+
     ref<Expr> Eq(const ref<ConstantExpr> &LHS, 
                  const ref<NonConstantExpr> &RHS) {
       Expr::Width Width = LHS->getWidth();
@@ -999,6 +1079,10 @@ namespace {
 	return Base->Not(RHS);
       }
 
+      ref<Expr> Res = Decide(Expr::Eq, LHS, RHS, Expr::Bool);
+      if (!Res.isNull())
+        return Res;
+
       return Base->Eq(LHS, RHS);
     }
 
@@ -1013,6 +1097,10 @@ namespace {
       if (LHS == RHS)
           return Builder->True();
 
+      ref<Expr> Res = Decide(Expr::Eq, LHS, RHS, Expr::Bool);
+      if (!Res.isNull())
+        return Res;
+
       return Base->Eq(LHS, RHS);
     }
 
@@ -1029,6 +1117,34 @@ namespace {
       return Builder->Not(Builder->Eq(LHS, RHS));
     }
 
+    ref<Expr> Ult(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      ref<Expr> Res = Decide(Expr::Ult, LHS, RHS, Expr::Bool);
+      if (!Res.isNull())
+        return Res;
+      return Base->Ult(LHS, RHS);
+    }
+
+    ref<Expr> Ule(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      ref<Expr> Res = Decide(Expr::Ule, LHS, RHS, Expr::Bool);
+      if (!Res.isNull())
+        return Res;
+      return Base->Ule(LHS, RHS);
+    }
+
+    ref<Expr> Slt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      ref<Expr> Res = Decide(Expr::Slt, LHS, RHS, Expr::Bool);
+      if (!Res.isNull())
+        return Res;
+      return Base->Slt(LHS, RHS);
+    }
+
+    ref<Expr> Sle(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      ref<Expr> Res = Decide(Expr::Sle, LHS, RHS, Expr::Bool);
+      if (!Res.isNull())
+        return Res;
+      return Base->Sle(LHS, RHS);
+    }
+
     ref<Expr> Ugt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
       // X u> Y ==> Y u< X
       return Builder->Ult(RHS, LHS);
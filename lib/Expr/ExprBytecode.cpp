@@ -0,0 +1,563 @@
+//===-- ExprBytecode.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ExprBytecode.h"
+
+#include "klee/util/Assignment.h"
+#include "klee/util/Bits.h"
+#include "klee/Internal/Support/IntEvaluation.h"
+
+#include <math.h>
+#include <string.h>
+
+using namespace klee;
+
+/// isHostFP - Whether floating point values of width \a w are evaluated on
+/// the host (as float or double).
+static bool isHostFP(Expr::Width w) {
+  return w == Expr::Int32 || w == Expr::Int64;
+}
+
+void ExprBytecode::compileRoot(const ref<Expr> &root) {
+  std::vector<std::pair<const Expr*, bool> > stack;
+  stack.push_back(std::make_pair(root.get(), false));
+
+  // Emit the nodes in post-order, so operands are defined before use.
+  while (!stack.empty()) {
+    const Expr *e = stack.back().first;
+    bool expanded = stack.back().second;
+    stack.pop_back();
+
+    if (values.count(e))
+      continue;
+
+    if (expanded) {
+      if (!emit(e)) {
+        valid = false;
+        return;
+      }
+      continue;
+    }
+
+    stack.push_back(std::make_pair(e, true));
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      stack.push_back(std::make_pair(re->index.get(), false));
+      for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+        stack.push_back(std::make_pair(un->index.get(), false));
+        stack.push_back(std::make_pair(un->value.get(), false));
+      }
+    } else {
+      // FCmp has its predicate as a third kid; it is kept as an immediate.
+      unsigned numKids = isa<FCmpExpr>(e) ? 2 : e->getNumKids();
+      for (unsigned i = 0; i != numKids; ++i)
+        stack.push_back(std::make_pair(e->getKid(i).get(), false));
+    }
+  }
+
+  code[values[root.get()]].check = true;
+}
+
+unsigned ExprBytecode::getArraySlot(const Array *array) {
+  std::map<const Array*, unsigned>::iterator it = arraySlots.find(array);
+  if (it != arraySlots.end())
+    return it->second;
+
+  unsigned slot = arrays.size();
+  arrays.push_back(array);
+  constantTables.push_back(std::vector<unsigned char>());
+  if (array->isConstantArray()) {
+    std::vector<unsigned char> &table = constantTables.back();
+    table.reserve(array->size);
+    for (unsigned i = 0; i != array->size; ++i)
+      table.push_back(array->constantValues[i]->getZExtValue(8));
+  }
+  arraySlots.insert(std::make_pair(array, slot));
+  return slot;
+}
+
+/// emit - Emit the instruction computing \a e, whose operands have been
+/// emitted. Returns false if \a e is not supported.
+bool ExprBytecode::emit(const Expr *e) {
+  Expr::Width w = e->getWidth();
+  if (w > Expr::Int64)
+    return false;
+
+  Instruction I;
+  I.op = e->getKind();
+  I.numArgs = 0;
+  I.check = false;
+  I.width = w;
+  I.opWidth = w;
+  I.dst = 0;
+  I.imm = 0;
+
+  switch (e->getKind()) {
+  case Expr::Constant:
+    I.imm = cast<ConstantExpr>(e)->getZExtValue();
+    break;
+
+    // These do not change the value; the node is the same as its kid.
+  case Expr::NotOptimized:
+  case Expr::ZExt:
+    values.insert(std::make_pair(e, values[e->getKid(0).get()]));
+    return true;
+
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    const Array *array = re->updates.root;
+    if (array->getRange() != Expr::Int8)
+      return false;
+    I.numArgs = 1;
+    I.args[0] = values[re->index.get()];
+    I.args[1] = updateArgs.size();
+    I.args[2] = 0;
+    for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+      updateArgs.push_back(values[un->index.get()]);
+      updateArgs.push_back(values[un->value.get()]);
+      ++I.args[2];
+    }
+    I.opWidth = re->index->getWidth();
+    I.imm = getArraySlot(array);
+    break;
+  }
+
+  case Expr::Extract:
+    I.imm = cast<ExtractExpr>(e)->offset;
+    break;
+
+  case Expr::Concat:
+    I.imm = e->getKid(1)->getWidth();
+    break;
+
+  case Expr::FCmp:
+    I.imm = cast<FCmpExpr>(e)->getPredicate();
+    // FALLTHROUGH
+  case Expr::FOrd1:
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+    if (!isHostFP(e->getKid(0)->getWidth()))
+      return false;
+    if (const F2IConvertExpr *fe = dyn_cast<F2IConvertExpr>(e))
+      I.imm = fe->roundNearest();
+    if (isa<F2FConvertExpr>(e) && !isHostFP(w))
+      return false;
+    break;
+
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FSqrt:
+  case Expr::FCos:
+  case Expr::FSin:
+    if (!isHostFP(w))
+      return false;
+    break;
+
+  case Expr::Select:
+  case Expr::SExt:
+  case Expr::Add:
+  case Expr::Sub:
+  case Expr::Mul:
+  case Expr::UDiv:
+  case Expr::SDiv:
+  case Expr::URem:
+  case Expr::SRem:
+  case Expr::Not:
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor:
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr:
+  case Expr::Eq:
+  case Expr::Ne:
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Ugt:
+  case Expr::Uge:
+  case Expr::Slt:
+  case Expr::Sle:
+  case Expr::Sgt:
+  case Expr::Sge:
+    break;
+
+    // FRem is left to APFloat, whose mod does not always agree with the
+    // host's fmod.
+  default:
+    return false;
+  }
+
+  if (e->getKind() != Expr::Read) {
+    I.numArgs = isa<FCmpExpr>(e) ? 2 : e->getNumKids();
+    for (unsigned i = 0; i != I.numArgs; ++i)
+      I.args[i] = values[e->getKid(i).get()];
+    if (I.numArgs)
+      I.opWidth = e->getKid(0)->getWidth();
+  }
+
+  values.insert(std::make_pair(e, code.size()));
+  code.push_back(I);
+  return true;
+}
+
+void ExprBytecode::getOperands(Instruction &I, std::vector<unsigned*> &res) {
+  res.clear();
+  for (unsigned i = 0; i != I.numArgs; ++i)
+    res.push_back(&I.args[i]);
+  if (I.op == Expr::Read)
+    for (unsigned i = 0, e = 2 * I.args[2]; i != e; ++i)
+      res.push_back(&updateArgs[I.args[1] + i]);
+}
+
+/// allocateRegisters - Replace the values (the instructions defining them)
+/// by registers, reusing the register of a value after its last use.
+void ExprBytecode::allocateRegisters() {
+  unsigned n = code.size();
+  std::vector<unsigned*> operands;
+
+  std::vector<unsigned> lastUse(n);
+  for (unsigned i = 0; i != n; ++i) {
+    lastUse[i] = i;
+    getOperands(code[i], operands);
+    for (unsigned j = 0; j != operands.size(); ++j)
+      lastUse[*operands[j]] = i;
+  }
+
+  std::vector<unsigned> registers(n);
+  std::vector<unsigned> freeRegisters;
+  for (unsigned i = 0; i != n; ++i) {
+    Instruction &I = code[i];
+
+    // The operands are read before the result is written, so the result
+    // may take the register of an operand dying here.
+    getOperands(I, operands);
+    for (unsigned j = 0; j != operands.size(); ++j) {
+      unsigned value = *operands[j];
+      *operands[j] = registers[value];
+      if (lastUse[value] == i) {
+        freeRegisters.push_back(registers[value]);
+        lastUse[value] = n;
+      }
+    }
+
+    if (freeRegisters.empty()) {
+      I.dst = numRegisters++;
+    } else {
+      I.dst = freeRegisters.back();
+      freeRegisters.pop_back();
+    }
+    registers[i] = I.dst;
+
+    // Constraints used by no other node are dead at once.
+    if (lastUse[i] == i)
+      freeRegisters.push_back(I.dst);
+  }
+}
+
+/***/
+
+static float toFloat(uint64_t bits) {
+  uint32_t b = bits;
+  float res;
+  memcpy(&res, &b, sizeof res);
+  return res;
+}
+
+static double toDouble(uint64_t bits) {
+  double res;
+  memcpy(&res, &bits, sizeof res);
+  return res;
+}
+
+static uint64_t fromFloat(float f) {
+  uint32_t res;
+  memcpy(&res, &f, sizeof res);
+  return res;
+}
+
+static uint64_t fromDouble(double d) {
+  uint64_t res;
+  memcpy(&res, &d, sizeof res);
+  return res;
+}
+
+/// toHostDouble - The value of the floating point \a bits of width \a w, as
+/// a double (which holds every float exactly).
+static double toHostDouble(uint64_t bits, Expr::Width w) {
+  return w == Expr::Int32 ? (double) toFloat(bits) : toDouble(bits);
+}
+
+/// isNaN - Whether the floating point \a bits of width \a w are a NaN.
+static bool isNaN(uint64_t bits, Expr::Width w) {
+  double d = toHostDouble(bits, w);
+  return d != d;
+}
+
+static float towardZero(float f) { return nextafterf(f, 0); }
+static double towardZero(double d) { return nextafter(d, 0); }
+
+/// unsignedToFP - Convert \a v to T, rounding toward zero as
+/// ConstantExpr::UIToFP does.
+template<typename T>
+static T unsignedToFP(uint64_t v) {
+  T res = (T) v;
+  if (res >= (T) 18446744073709551616.0 || (uint64_t) res > v)
+    res = towardZero(res);
+  return res;
+}
+
+/// signedToFP - Convert \a v to T, rounding toward zero as
+/// ConstantExpr::SIToFP does.
+template<typename T>
+static T signedToFP(int64_t v) {
+  T res = (T) v;
+  if (v >= 0 ? res >= (T) 9223372036854775808.0 || (int64_t) res > v
+             : (int64_t) res < v)
+    res = towardZero(res);
+  return res;
+}
+
+template<typename T>
+static T evalFBinary(unsigned op, T l, T r) {
+  switch (op) {
+  case Expr::FAdd: return l + r;
+  case Expr::FSub: return l - r;
+  case Expr::FMul: return l * r;
+  default: return l / r;
+  }
+}
+
+/// evalFPToI - Convert the floating point \a bits of width \a fromWidth to
+/// an integer of width \a w. Returns false if the value is out of range (or
+/// NaN), where APFloat's result is not a plain conversion.
+static bool evalFPToI(uint64_t bits, Expr::Width fromWidth, Expr::Width w,
+                      bool isSigned, bool roundNearest, uint64_t &res) {
+  double d = toHostDouble(bits, fromWidth);
+  if (d != d)
+    return false;
+  if (roundNearest)
+    d = rint(d);
+  else
+    d = d < 0 ? ceil(d) : floor(d);
+
+  if (isSigned) {
+    double bound = ldexp(1.0, w - 1);
+    if (d < -bound || d >= bound)
+      return false;
+    res = bits64::truncateToNBits((uint64_t) (int64_t) d, w);
+  } else {
+    if (d < 0 || d >= ldexp(1.0, w))
+      return false;
+    res = (uint64_t) d;
+  }
+  return true;
+}
+
+ExprBytecode::Result ExprBytecode::evaluate(const Assignment &a) const {
+  if (!valid)
+    return Unknown;
+
+  std::vector<const std::vector<unsigned char>*> bound(arrays.size());
+  for (unsigned i = 0; i != arrays.size(); ++i) {
+    Assignment::bindings_ty::const_iterator it = a.bindings.find(arrays[i]);
+    bound[i] = it == a.bindings.end() ? 0 : &it->second;
+  }
+
+  std::vector<uint64_t> regs(numRegisters);
+  // Set when a value could not be computed exactly; the constraints
+  // checked afterwards are then unknown.
+  bool failed = false;
+
+  for (std::vector<Instruction>::const_iterator it = code.begin(),
+         ie = code.end(); it != ie; ++it) {
+    const Instruction &I = *it;
+    uint64_t l = I.numArgs > 0 ? regs[I.args[0]] : 0;
+    uint64_t r = I.numArgs > 1 ? regs[I.args[1]] : 0;
+    Expr::Width w = I.opWidth;
+    uint64_t res = 0;
+
+    switch (I.op) {
+    case Expr::Constant: res = I.imm; break;
+
+    case Expr::Read: {
+      const unsigned *u = &updateArgs[I.args[1]];
+      const unsigned *ue = u + 2 * I.args[2];
+      for (; u != ue; u += 2)
+        if (regs[u[0]] == l)
+          break;
+      if (u != ue) {
+        res = regs[u[1]];
+        break;
+      }
+
+      // As Assignment::evaluate does, past the updates and the contents
+      // of constant arrays.
+      const std::vector<unsigned char> &table = constantTables[I.imm];
+      const std::vector<unsigned char> *values = bound[I.imm];
+      if (l < table.size())
+        res = table[l];
+      else if (values && l < values->size())
+        res = (*values)[l];
+      else if (a.allowFreeValues)
+        failed = true;
+      break;
+    }
+
+    case Expr::Select: res = l ? r : regs[I.args[2]]; break;
+    case Expr::Concat: res = (l << I.imm) | r; break;
+    case Expr::Extract:
+      res = bits64::truncateToNBits(l >> I.imm, I.width);
+      break;
+    case Expr::SExt: res = ints::sext(l, I.width, w); break;
+
+    case Expr::Add: res = ints::add(l, r, w); break;
+    case Expr::Sub: res = ints::sub(l, r, w); break;
+    case Expr::Mul: res = ints::mul(l, r, w); break;
+
+      // As ExprEvaluator does, division by zero is left unevaluated.
+    case Expr::UDiv:
+    case Expr::URem:
+      if (!r) {
+        failed = true;
+        break;
+      }
+      res = I.op == Expr::UDiv ? ints::udiv(l, r, w) : ints::urem(l, r, w);
+      break;
+    case Expr::SDiv:
+    case Expr::SRem:
+      if (!r) {
+        failed = true;
+        break;
+      }
+      // Dividing by -1 may overflow on the host.
+      if (r == bits64::maxValueOfNBits(w))
+        res = I.op == Expr::SDiv ? ints::sub(0, l, w) : 0;
+      else
+        res = I.op == Expr::SDiv ? ints::sdiv(l, r, w) : ints::srem(l, r, w);
+      break;
+
+    case Expr::Not: res = bits64::truncateToNBits(~l, w); break;
+    case Expr::And: res = l & r; break;
+    case Expr::Or: res = l | r; break;
+    case Expr::Xor: res = l ^ r; break;
+
+      // As APInt does, shifting by the width or more shifts out every bit.
+    case Expr::Shl: res = r >= w ? 0 : ints::shl(l, r, w); break;
+    case Expr::LShr: res = r >= w ? 0 : ints::lshr(l, r, w); break;
+    case Expr::AShr: res = ints::ashr(l, r >= w ? w - 1 : r, w); break;
+
+    case Expr::Eq: res = l == r; break;
+    case Expr::Ne: res = l != r; break;
+    case Expr::Ult: res = ints::ult(l, r, w); break;
+    case Expr::Ule: res = ints::ule(l, r, w); break;
+    case Expr::Ugt: res = ints::ugt(l, r, w); break;
+    case Expr::Uge: res = ints::uge(l, r, w); break;
+    case Expr::Slt: res = ints::slt(l, r, w); break;
+    case Expr::Sle: res = ints::sle(l, r, w); break;
+    case Expr::Sgt: res = ints::sgt(l, r, w); break;
+    case Expr::Sge: res = ints::sge(l, r, w); break;
+
+    case Expr::FAdd:
+    case Expr::FSub:
+    case Expr::FMul:
+    case Expr::FDiv:
+      if (w == Expr::Int32)
+        res = fromFloat(evalFBinary(I.op, toFloat(l), toFloat(r)));
+      else
+        res = fromDouble(evalFBinary(I.op, toDouble(l), toDouble(r)));
+      // The host and APFloat disagree on the sign and payload of NaN
+      // results, which compare by their bits.
+      if (isNaN(res, w))
+        failed = true;
+      break;
+
+    case Expr::FCmp: {
+      double dl = toHostDouble(l, w), dr = toHostDouble(r, w);
+      unsigned p;
+      if (dl != dl || dr != dr)
+        p = FCmpExpr::UNO;
+      else if (dl == dr)
+        p = FCmpExpr::OEQ;
+      else
+        p = dl > dr ? FCmpExpr::OGT : FCmpExpr::OLT;
+      res = (I.imm & p) != 0;
+      break;
+    }
+
+    case Expr::FOrd1: {
+      double d = toHostDouble(l, w);
+      res = d == d;
+      break;
+    }
+
+    case Expr::FSqrt:
+      res = w == Expr::Int32 ? fromFloat(sqrtf(toFloat(l)))
+                             : fromDouble(sqrt(toDouble(l)));
+      break;
+    case Expr::FCos:
+      res = w == Expr::Int32 ? fromFloat(cosf(toFloat(l)))
+                             : fromDouble(cos(toDouble(l)));
+      break;
+    case Expr::FSin:
+      res = w == Expr::Int32 ? fromFloat(sinf(toFloat(l)))
+                             : fromDouble(sin(toDouble(l)));
+      break;
+
+    case Expr::FPExt:
+    case Expr::FPTrunc:
+      // As above, the payload of a converted NaN differs.
+      if (isNaN(l, w))
+        failed = true;
+      if (I.width == Expr::Int32)
+        res = fromFloat((float) toHostDouble(l, w));
+      else
+        res = fromDouble(toHostDouble(l, w));
+      break;
+
+    case Expr::UIToFP:
+      if (I.width == Expr::Int32)
+        res = fromFloat(unsignedToFP<float>(l));
+      else
+        res = fromDouble(unsignedToFP<double>(l));
+      break;
+    case Expr::SIToFP: {
+      int64_t v = ints::sext(l, 64, w);
+      if (I.width == Expr::Int32)
+        res = fromFloat(signedToFP<float>(v));
+      else
+        res = fromDouble(signedToFP<double>(v));
+      break;
+    }
+
+    case Expr::FPToUI:
+    case Expr::FPToSI:
+      if (!evalFPToI(l, w, I.width, I.op == Expr::FPToSI, I.imm, res))
+        failed = true;
+      break;
+
+    default:
+      assert(0 && "invalid bytecode instruction");
+    }
+
+    regs[I.dst] = res;
+    if (I.check) {
+      if (failed)
+        return Unknown;
+      if (!res)
+        return False;
+    }
+  }
+
+  return True;
+}
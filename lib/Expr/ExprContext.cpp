@@ -0,0 +1,103 @@
+//===-- ExprContext.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/ExprContext.h"
+
+#include "klee/Expr.h"
+#include "klee/ExprBuilder.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+/// isSameNode - Whether \a a and \a b are equal, given that their kids are
+/// interned (so equal kids are the same object).
+static bool isSameNode(const Expr *a, const Expr *b) {
+  if (a->getKind() != b->getKind() || a->getWidth() != b->getWidth())
+    return false;
+
+  unsigned numKids = a->getNumKids();
+  for (unsigned i = 0; i != numKids; ++i)
+    if (a->getKid(i).get() != b->getKid(i).get())
+      return false;
+
+  return a->compareContents(*b) == 0;
+}
+
+Expr *ExprContext::internExpr(Expr *e) {
+  unsigned hash = e->computeHash();
+
+  std::pair<UniqueTable::iterator, UniqueTable::iterator> range =
+    uniqueTable.equal_range(hash);
+  for (UniqueTable::iterator it = range.first; it != range.second; ++it) {
+    if (isSameNode(it->second, e)) {
+      delete e;
+      return it->second;
+    }
+  }
+
+  uniqueTable.insert(std::make_pair(hash, e));
+  return e;
+}
+
+void *ExprContext::allocateSlow(size_t size) {
+  size_t sizeClass = (size + Granularity - 1) / Granularity;
+  if (sizeClass >= NumSizeClasses)
+    return ::operator new(size);
+
+  // Carve a block from the slab; what is left of a full slab is dropped.
+  size_t bytes = sizeClass * Granularity;
+  if ((size_t) (slabEnd - slabCur) < bytes) {
+    slabCur = (char*) ::operator new(SlabSize);
+    slabEnd = slabCur + SlabSize;
+  }
+  void *res = slabCur;
+  slabCur += bytes;
+  return res;
+}
+
+ConstantExpr *ExprContext::createSmallConstant(uint64_t value,
+                                               unsigned width) {
+  ConstantExpr *res = intern(new ConstantExpr(llvm::APInt(width, value)));
+  // Keep it alive for good.
+  ++res->refCount;
+  return res;
+}
+
+void ExprContext::remove(const Expr *e, unsigned hash) {
+  std::pair<UniqueTable::iterator, UniqueTable::iterator> range =
+    uniqueTable.equal_range(hash);
+  for (UniqueTable::iterator it = range.first; it != range.second; ++it) {
+    if (it->second == e) {
+      uniqueTable.erase(it);
+      return;
+    }
+  }
+}
+
+ExprBuilder &ExprContext::getBuilder() {
+  if (!builder)
+    builder = createDefaultExprBuilder();
+  return *builder;
+}
+
+void ExprContext::setBuilder(ExprBuilder *b) {
+  delete builder;
+  builder = b;
+}
+
+void ExprContext::unregisterCache(ExprCache *cache) {
+  caches.erase(std::remove(caches.begin(), caches.end(), cache),
+               caches.end());
+}
+
+void ExprContext::clearCaches() {
+  for (unsigned i = 0, e = caches.size(); i != e; ++i)
+    caches[i]->clear();
+}
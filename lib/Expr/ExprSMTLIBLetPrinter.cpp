@@ -46,6 +46,7 @@ namespace klee
 		printOptions();
 		printSetLogic();
 		printArrayDeclarations();
+		printFloatDeclarations();
 		printLetExpression();
 		printAction();
 		printExit();
@@ -78,6 +79,8 @@ namespace klee
 
 			}
 
+			scanFloat(e);
+
 			//recurse into the children
 			Expr* ep = e.get();
 			for(unsigned int i=0; i < ep->getNumKids(); i++)
@@ -166,7 +169,7 @@ namespace klee
 				//Disable abbreviations so none are used here.
 				disablePrintedAbbreviations=true;
 
-				//We can abbreviate SORT_BOOL or SORT_BITVECTOR in let expressions
+				//We can abbreviate any sort in let expressions
 				printExpression(i->first,getSort(i->first));
 
 				p->popIndent();
@@ -184,10 +187,21 @@ namespace klee
 
 		}
 
+		/* The definitions of floating point bridge constants may use the
+		 * abbreviations so they are and-ed with the constraints.
+		 */
+		for(map<const ref<Expr>, unsigned int>::const_iterator i= floatBridges.begin();
+				i!=floatBridges.end(); ++i)
+		{
+			*p << "(and"; p->pushIndent(); printSeperator();
+			printFloatBridge(i->first,i->second);
+			printSeperator();
+		}
+
 		//print out Expressions with abbreviations.
 		unsigned int numberOfItems= query->constraints.size() +1; //+1 for query
 		unsigned int itemsLeft=numberOfItems;
-		vector<ref<Expr> >::const_iterator constraint=query->constraints.begin();
+		ConstraintManager::const_iterator constraint=query->constraints.begin();
 
 		/* Produce nested (and () () statements. If the constraint set
 		 * is empty then we will only print the "queryAssert".
@@ -221,6 +235,13 @@ namespace klee
 			*p << ")";
 		}
 
+		//close the "and statements" for the floating point bridges
+		for(unsigned int bridge=0; bridge != floatBridges.size(); ++bridge)
+		{
+			p->popIndent(); printSeperator();
+			*p << ")";
+		}
+
 
 
 		if(bindings.size() !=0)
@@ -7,7 +7,9 @@
 //
 //===----------------------------------------------------------------------===//
 #include <iostream>
+#include <sstream>
 
+#include "llvm/ADT/APFloat.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
 #include "klee/util/ExprSMTLIBPrinter.h"
@@ -41,9 +43,11 @@ namespace ExprSMTLIBOptions
 
 namespace klee
 {
+	const char ExprSMTLIBPrinter::FLOAT_BRIDGE_PREFIX[] = "klee_fpbits";
 
 	ExprSMTLIBPrinter::ExprSMTLIBPrinter() :
-		usedArrays(), o(NULL), query(NULL), p(NULL), haveConstantArray(false), logicToUse(QF_AUFBV),
+		usedArrays(), o(NULL), query(NULL), p(NULL), haveConstantArray(false), haveFloatingPoint(false),
+		haveUnsupportedFloat(false), floatBridges(), usedFloatFunctions(), logicToUse(QF_AUFBV),
 		humanReadable(ExprSMTLIBOptions::humanReadableSMTLIB), smtlibBoolOptions(), arraysToCallGetValueOn(NULL)
 	{
 		setConstantDisplayMode(ExprSMTLIBOptions::argConstantDisplayMode);
@@ -76,6 +80,10 @@ namespace klee
 	{
 		usedArrays.clear();
 		haveConstantArray=false;
+		haveFloatingPoint=false;
+		haveUnsupportedFloat=false;
+		floatBridges.clear();
+		usedFloatFunctions.clear();
 
 		/* Clear the PRODUCE_MODELS option if it was automatically set.
 		 * We need to do this because the next query might not need the
@@ -121,6 +129,15 @@ namespace klee
 
 		/* Handle bitvector constants */
 
+		/* Floating point constants can only be converted to a decimal string
+		 * of their value, but here we want their bits.
+		 */
+		if(e->isFloat())
+		{
+			printConstant(ConstantExpr::alloc(e->getAPValue()));
+			return;
+		}
+
 		std::string value;
 
 		/* SMTLIBv2 deduces the bit-width (should be 8-bits in our case)
@@ -212,8 +229,11 @@ namespace klee
 				/* The "=" operator is special in that it can take any sort but we must
 				 * enforce that both arguments are the same type. We do this a lazy way
 				 * by enforcing the second argument is of the same type as the first.
+				 *
+				 * Floating point values are compared as bitvectors because "=" does not
+				 * distinguish between NaNs.
 				 */
-				printSortArgsExpr(e,getSort(e->getKid(0)));
+				printSortArgsExpr(e,(getSort(e->getKid(0))==SORT_FLOAT)?SORT_BITVECTOR:getSort(e->getKid(0)));
 
 				return;
 
@@ -229,6 +249,31 @@ namespace klee
 
 				return;
 
+			case Expr::FCmp:
+				printFCmpExpr(cast<FCmpExpr>(e));
+				return;
+
+			case Expr::FRem:
+				printFRemExpr(cast<FRemExpr>(e));
+				return;
+
+			case Expr::FAdd:
+			case Expr::FSub:
+			case Expr::FMul:
+			case Expr::FDiv:
+			case Expr::FSqrt:
+			case Expr::FSin:
+			case Expr::FCos:
+			case Expr::FOrd1:
+			case Expr::UIToFP:
+			case Expr::SIToFP:
+			case Expr::FPExt:
+			case Expr::FPTrunc:
+			case Expr::FPToUI:
+			case Expr::FPToSI:
+				printFloatExpr(e);
+				return;
+
 
 			default:
 				/* The remaining operators (Add,Sub...,Ult,Ule,..)
@@ -319,9 +364,11 @@ namespace klee
 
 		/* The "=" operators allows both sorts. We assume
 		 * that the second argument sort should be forced to be the same sort as the
-		 * first argument
+		 * first argument. Floating point values are compared as bitvectors.
 		 */
 		SMTLIB_SORT s = getSort(e->getKid(0));
+		if(s == SORT_FLOAT)
+			s = SORT_BITVECTOR;
 
 		printExpression(e->getKid(0),s);
 		printSeperator();
@@ -440,6 +487,8 @@ namespace klee
 		printOptions();
 		printSetLogic();
 		printArrayDeclarations();
+		printFloatDeclarations();
+		printFloatBridges();
 		printConstraints();
 		printQuery();
 		printAction();
@@ -451,9 +500,14 @@ namespace klee
 		*o << "(set-logic ";
 		switch(logicToUse)
 		{
-		case QF_ABV: *o << "QF_ABV"; break;
+		case QF_ABV:
+			//FSin and FCos need uninterpreted functions
+			*o << (usedFloatFunctions.empty()?"QF_ABV":"QF_AUFBV");
+			break;
 		case QF_AUFBV: *o << "QF_AUFBV" ; break;
 		}
+		if(haveFloatingPoint)
+			*o << "FP";
 		*o << " )" << std::endl;
 	}
 
@@ -599,6 +653,8 @@ namespace klee
 
 		}
 
+		scanFloat(e);
+
 		//recurse into the children
 		Expr* ep = e.get();
 		for(unsigned int i=0; i < ep->getNumKids(); i++)
@@ -610,12 +666,124 @@ namespace klee
 	{
 		while(un != NULL)
 		{
+			//Array contents are bitvectors
+			if(getSort(un->value) == SORT_FLOAT)
+				addFloatBridge(un->value);
+
 			scan(un->index);
 			scan(un->value);
 			un= un->next;
 		}
 	}
 
+	bool ExprSMTLIBPrinter::hasFloatKid(const ref<Expr>& e, unsigned int kid)
+	{
+		Expr::Kind k = e->getKind();
+
+		if(k == Expr::FCmp)
+			return kid < 2; //the third kid is the predicate
+
+		return (Expr::FBinaryKindFirst <= k && k <= Expr::FBinaryKindLast) ||
+		       (Expr::FUnaryKindFirst <= k && k <= Expr::FUnaryKindLast) ||
+		       (Expr::F2FConvertKindFirst <= k && k <= Expr::F2FConvertKindLast) ||
+		       (Expr::F2IConvertKindFirst <= k && k <= Expr::F2IConvertKindLast) ||
+		       k == Expr::FOrd1;
+	}
+
+	void ExprSMTLIBPrinter::addFloatBridge(const ref<Expr>& e)
+	{
+		unsigned int id = floatBridges.size();
+		floatBridges.insert(std::make_pair(e,id));
+	}
+
+	void ExprSMTLIBPrinter::scanFloat(const ref<Expr>& e)
+	{
+		Expr* ep = e.get();
+		bool isIEEE = true;
+
+		switch(e->getKind())
+		{
+			case Expr::FSin:
+			case Expr::FCos:
+				usedFloatFunctions.insert(std::make_pair(e->getKind(),e->getWidth()));
+				// Fall through
+			case Expr::FSqrt:
+				isIEEE = cast<FUnaryExpr>(e)->isIEEE();
+				break;
+			case Expr::FAdd:
+			case Expr::FSub:
+			case Expr::FMul:
+			case Expr::FDiv:
+			case Expr::FRem:
+				isIEEE = cast<FBinaryExpr>(e)->isIEEE();
+				break;
+			case Expr::FCmp:
+				isIEEE = cast<FCmpExpr>(e)->isIEEE();
+				break;
+			case Expr::FOrd1:
+				isIEEE = cast<FOrd1Expr>(e)->isIEEE();
+				break;
+			case Expr::FPExt:
+			case Expr::FPTrunc:
+				isIEEE = cast<F2FConvertExpr>(e)->fromIsIEEE() &&
+				         cast<F2FConvertExpr>(e)->getSemantics() != &llvm::APFloat::PPCDoubleDouble;
+				break;
+			case Expr::UIToFP:
+			case Expr::SIToFP:
+				isIEEE = cast<FConvertExpr>(e)->getSemantics() != &llvm::APFloat::PPCDoubleDouble;
+				break;
+			case Expr::FPToUI:
+			case Expr::FPToSI:
+				isIEEE = cast<F2IConvertExpr>(e)->fromIsIEEE();
+				break;
+			default:
+				isIEEE = true;
+		}
+
+		unsigned int eb, sb;
+		if(getSort(e) == SORT_FLOAT)
+		{
+			haveFloatingPoint = true;
+			if(!getFloatFormat(e->getWidth(),eb,sb))
+				haveUnsupportedFloat = true;
+		}
+
+		for(unsigned int i=0; i < ep->getNumKids(); i++)
+		{
+			ref<Expr> kid = ep->getKid(i);
+			if(hasFloatKid(e,i))
+			{
+				haveFloatingPoint = true;
+				if(!getFloatFormat(kid->getWidth(),eb,sb))
+					haveUnsupportedFloat = true;
+			}
+			else if(getSort(kid) == SORT_FLOAT)
+			{
+				//This floating point value is used as a bitvector
+				addFloatBridge(kid);
+			}
+		}
+
+		//PowerPC double-double has the same width as an IEEE quad
+		if(!isIEEE)
+			haveUnsupportedFloat = true;
+	}
+
+	bool ExprSMTLIBPrinter::getFloatFormat(Expr::Width w, unsigned &eb, unsigned &sb)
+	{
+		switch(w)
+		{
+			case 16: eb = 5; sb = 11; return true;
+			case 32: eb = 8; sb = 24; return true;
+			case 64: eb = 11; sb = 53; return true;
+			case 128: eb = 15; sb = 113; return true;
+			default:
+				//x87 long double has an explicit integer bit, so to_fp can't be used
+				eb = 15; sb = 64;
+				return false;
+		}
+	}
+
 
 	void ExprSMTLIBPrinter::printExit()
 	{
@@ -687,7 +855,17 @@ namespace klee
 		 * but this seems more elegant.
 		 */
 
-		if(e->getKind() == Expr::Extract)
+		Expr::Kind k = e->getKind();
+		if((Expr::FBinaryKindFirst <= k && k <= Expr::FBinaryKindLast) ||
+		   (Expr::FUnaryKindFirst <= k && k <= Expr::FUnaryKindLast) ||
+		   (Expr::FConvertKindFirst <= k && k <= Expr::FConvertKindLast))
+		{
+			//Floating point results. Note that the arguments of the FP->int conversions
+			//are floating point but their result is a bitvector.
+			return SORT_FLOAT;
+		}
+
+		if(k == Expr::Extract)
 		{
 			/* This is a special corner case. In most cases if a node in the expression tree
 			 * is of width 1 it should be considered as SORT_BOOL. However it is possible to
@@ -704,7 +882,30 @@ namespace klee
 	{
 		switch(sort)
 		{
+			case SORT_FLOAT:
+			{
+				//We assume e is a bitvector holding the bits of a floating point value.
+				unsigned int eb, sb;
+				getFloatFormat(e->getWidth(),eb,sb);
+				*p << "((_ to_fp " << eb << " " << sb << ")"; p->pushIndent(); printSeperator();
+				printExpression(e,SORT_BITVECTOR); p->popIndent(); printSeperator();
+				*p << ")";
+			}
+				break;
 			case SORT_BITVECTOR:
+				if(getSort(e) == SORT_FLOAT)
+				{
+					/* There is no conversion from a FloatingPoint to its bits in SMTLIBv2
+					 * so we use the constant that scan() bound the value to.
+					 */
+					std::map<const ref<Expr>,unsigned int>::const_iterator i = floatBridges.find(e);
+					if(i == floatBridges.end())
+						std::cerr << "ExprSMTLIBPrinter : Floating point expression used as a bitvector was not found by scan()!" << std::endl;
+					else
+						*p << FLOAT_BRIDGE_PREFIX << i->second;
+					break;
+				}
+
 				if(humanReadable)
 				{
 					p->breakLineI(); *p << ";Performing implicit bool to bitvector cast"; p->breakLine();
@@ -888,6 +1089,273 @@ namespace klee
 
 	}
 
+	void ExprSMTLIBPrinter::printFloatDeclarations()
+	{
+		//Assume scan() has been called
+		if(humanReadable && (!floatBridges.empty() || !usedFloatFunctions.empty()))
+			*o << "; Floating point declarations" << endl;
+
+		unsigned int eb, sb;
+
+		//declare the uninterpreted functions used for FSin and FCos
+		for(set<pair<Expr::Kind,Expr::Width> >::const_iterator it = usedFloatFunctions.begin();
+				it != usedFloatFunctions.end(); it++)
+		{
+			getFloatFormat(it->second,eb,sb);
+			*o << "(declare-fun " << getFloatFunctionName(it->first,it->second) <<
+			      " ((_ FloatingPoint " << eb << " " << sb << ")) "
+			      "(_ FloatingPoint " << eb << " " << sb << ") )" << endl;
+		}
+
+		//declare the bitvector constants that floating point results used as bitvectors are bound to
+		for(map<const ref<Expr>,unsigned int>::const_iterator it = floatBridges.begin();
+				it != floatBridges.end(); it++)
+		{
+			*o << "(declare-fun " << FLOAT_BRIDGE_PREFIX << it->second << " () "
+			      "(_ BitVec " << it->first->getWidth() << ") )" << endl;
+		}
+	}
+
+	void ExprSMTLIBPrinter::printFloatBridges()
+	{
+		if(humanReadable && !floatBridges.empty())
+			*o << "; Floating point values used as bitvectors" << endl;
+
+		for(map<const ref<Expr>,unsigned int>::const_iterator it = floatBridges.begin();
+				it != floatBridges.end(); it++)
+		{
+			*p << "(assert ";
+			p->pushIndent();
+			printSeperator();
+
+			printFloatBridge(it->first,it->second);
+
+			p->popIndent();
+			printSeperator();
+			*p << ")"; p->breakLineI();
+		}
+	}
+
+	void ExprSMTLIBPrinter::printFloatBridge(const ref<Expr>& e, unsigned int id)
+	{
+		/* Any bit pattern of a NaN satisfies this equality because SMTLIBv2
+		 * has only one NaN. Otherwise the bits are uniquely determined.
+		 */
+		unsigned int eb, sb;
+		getFloatFormat(e->getWidth(),eb,sb);
+
+		*p << "(= ";
+		p->pushIndent();
+		printSeperator();
+		*p << "((_ to_fp " << eb << " " << sb << ") " << FLOAT_BRIDGE_PREFIX << id << ")";
+		printSeperator();
+		printExpression(e,SORT_FLOAT);
+		p->popIndent();
+		printSeperator();
+		*p << ")";
+	}
+
+	std::string ExprSMTLIBPrinter::getFloatFunctionName(Expr::Kind k, Expr::Width w)
+	{
+		std::ostringstream name;
+		name << ((k == Expr::FSin)?"klee_fsin":"klee_fcos") << w;
+		return name.str();
+	}
+
+	void ExprSMTLIBPrinter::printFloatApplication(const std::string& op, const ref<Expr>& a,
+	                                              const ref<Expr>& b, ExprSMTLIBPrinter::SMTLIB_SORT s)
+	{
+		*p << "(" << op << " ";
+		p->pushIndent(); //add indent for recursive call
+
+		printSeperator();
+		printExpression(a,s);
+
+		if(!b.isNull())
+		{
+			printSeperator();
+			printExpression(b,s);
+		}
+
+		p->popIndent(); //pop indent added for recursive call
+		printSeperator();
+		*p << ")";
+	}
+
+	void ExprSMTLIBPrinter::printFloatExpr(const ref<Expr>& e)
+	{
+		/* KLEE rounds to nearest (ties to even) apart from the FP->int conversions
+		 * which may truncate.
+		 */
+		std::ostringstream op;
+		unsigned int eb, sb;
+		getFloatFormat(e->getWidth(),eb,sb);
+
+		switch(e->getKind())
+		{
+			case Expr::FAdd:
+				printFloatApplication("fp.add RNE",e->getKid(0),e->getKid(1));
+				return;
+			case Expr::FSub:
+				printFloatApplication("fp.sub RNE",e->getKid(0),e->getKid(1));
+				return;
+			case Expr::FMul:
+				printFloatApplication("fp.mul RNE",e->getKid(0),e->getKid(1));
+				return;
+			case Expr::FDiv:
+				printFloatApplication("fp.div RNE",e->getKid(0),e->getKid(1));
+				return;
+			case Expr::FSqrt:
+				printFloatApplication("fp.sqrt RNE",e->getKid(0));
+				return;
+			case Expr::FSin:
+			case Expr::FCos:
+				printFloatApplication(getFloatFunctionName(e->getKind(),e->getWidth()),e->getKid(0));
+				return;
+			case Expr::FOrd1:
+				*p << "(not ";
+				p->pushIndent();
+				printSeperator();
+				printFloatApplication("fp.isNaN",e->getKid(0));
+				p->popIndent();
+				printSeperator();
+				*p << ")";
+				return;
+			case Expr::UIToFP:
+				op << "(_ to_fp_unsigned " << eb << " " << sb << ") RNE";
+				printFloatApplication(op.str(),e->getKid(0),ref<Expr>(),SORT_BITVECTOR);
+				return;
+			case Expr::SIToFP:
+			case Expr::FPExt:
+			case Expr::FPTrunc:
+				//to_fp converts both signed bitvectors and FloatingPoints
+				op << "(_ to_fp " << eb << " " << sb << ") RNE";
+				printFloatApplication(op.str(),e->getKid(0),ref<Expr>(),
+				                      (e->getKind() == Expr::SIToFP)?SORT_BITVECTOR:SORT_FLOAT);
+				return;
+			case Expr::FPToUI:
+			case Expr::FPToSI:
+				op << "(_ " << ((e->getKind() == Expr::FPToUI)?"fp.to_ubv":"fp.to_sbv") << " " << e->getWidth() << ") " <<
+				      (cast<F2IConvertExpr>(e)->roundNearest()?"RNE":"RTZ");
+				printFloatApplication(op.str(),e->getKid(0));
+				return;
+			default:
+				std::cerr << "ExprSMTLIBPrinter::printFloatExpr() : Unexpected expression kind" << std::endl;
+				*p << "<error>";
+		}
+	}
+
+	void ExprSMTLIBPrinter::printOrderedFCmp(unsigned int pred, const ref<Expr>& l, const ref<Expr>& r)
+	{
+		switch(pred)
+		{
+			case FCmpExpr::OEQ: printFloatApplication("fp.eq",l,r); return;
+			case FCmpExpr::OGT: printFloatApplication("fp.gt",l,r); return;
+			case FCmpExpr::OGE: printFloatApplication("fp.geq",l,r); return;
+			case FCmpExpr::OLT: printFloatApplication("fp.lt",l,r); return;
+			case FCmpExpr::OLE: printFloatApplication("fp.leq",l,r); return;
+			case FCmpExpr::ONE:
+			case FCmpExpr::ORD:
+				//(or (fp.lt l r) (fp.gt l r)) or (not (or (fp.isNaN l) (fp.isNaN r)))
+				*p << ((pred == FCmpExpr::ONE)?"(or ":"(not (or ");
+				p->pushIndent();
+				printSeperator();
+				printFloatApplication((pred == FCmpExpr::ONE)?"fp.lt":"fp.isNaN",l,
+				                      (pred == FCmpExpr::ONE)?r:ref<Expr>());
+				printSeperator();
+				if(pred == FCmpExpr::ONE)
+					printFloatApplication("fp.gt",l,r);
+				else
+					printFloatApplication("fp.isNaN",r);
+				p->popIndent();
+				printSeperator();
+				*p << ((pred == FCmpExpr::ONE)?")":"))");
+				return;
+			default:
+				std::cerr << "ExprSMTLIBPrinter::printOrderedFCmp() : Unexpected predicate" << std::endl;
+				*p << "<error>";
+		}
+	}
+
+	void ExprSMTLIBPrinter::printFCmpExpr(const ref<FCmpExpr>& e)
+	{
+		/* The predicate is a set of outcomes (equal, greater than, less than and
+		 * unordered) for which the comparison is true. An unordered predicate is
+		 * printed as the negation of the ordered predicate with the other outcomes.
+		 */
+		unsigned int pred = e->getPredicate();
+
+		switch(pred)
+		{
+			case FCmpExpr::FALSE:
+				*p << "false";
+				return;
+			case FCmpExpr::TRUE:
+				*p << "true";
+				return;
+			case FCmpExpr::UNO:
+				*p << "(or ";
+				p->pushIndent();
+				printSeperator();
+				printFloatApplication("fp.isNaN",e->left);
+				printSeperator();
+				printFloatApplication("fp.isNaN",e->right);
+				p->popIndent();
+				printSeperator();
+				*p << ")";
+				return;
+			default:
+				break;
+		}
+
+		if(pred & FCmpExpr::UNO)
+		{
+			*p << "(not ";
+			p->pushIndent();
+			printSeperator();
+			printOrderedFCmp(pred ^ FCmpExpr::TRUE,e->left,e->right);
+			p->popIndent();
+			printSeperator();
+			*p << ")";
+		}
+		else
+			printOrderedFCmp(pred,e->left,e->right);
+	}
+
+	void ExprSMTLIBPrinter::printFRemExpr(const ref<FRemExpr>& e)
+	{
+		/* fp.rem is the IEEE-754 remainder, which rounds the quotient to nearest,
+		 * but FRem is fmod(), which truncates the quotient. They differ by the
+		 * divisor when their signs differ, and fmod() has the sign of the dividend.
+		 *
+		 * (let ((?FA a) (?FB b)) (let ((?FR (fp.rem ?FA ?FB)))
+		 *   (ite (or (fp.isZero ?FR) (= (fp.isNegative ?FR) (fp.isNegative ?FA)))
+		 *     ?FR
+		 *     (fp.add RNE ?FR (ite (fp.isNegative ?FA) (fp.neg (fp.abs ?FB)) (fp.abs ?FB))))))
+		 */
+		*p << "(let ((?FA ";
+		p->pushIndent();
+		printSeperator();
+		printExpression(e->left,SORT_FLOAT);
+		*p << ")";
+		printSeperator();
+		*p << "(?FB ";
+		printSeperator();
+		printExpression(e->right,SORT_FLOAT);
+		*p << "))";
+		printSeperator();
+		*p << "(let ((?FR (fp.rem ?FA ?FB)))";
+		printSeperator();
+		*p << "(ite (or (fp.isZero ?FR) (= (fp.isNegative ?FR) (fp.isNegative ?FA)))";
+		printSeperator();
+		*p << "?FR";
+		printSeperator();
+		*p << "(fp.add RNE ?FR (ite (fp.isNegative ?FA) (fp.neg (fp.abs ?FB)) (fp.abs ?FB)))))";
+		p->popIndent();
+		printSeperator();
+		*p << ")";
+	}
+
 const char* ExprSMTLIBPrinter::getSMTLIBOptionString(ExprSMTLIBPrinter::SMTLIBboolOptions option)
 {
 	switch(option)
@@ -83,10 +83,16 @@ protected:
   Action visitRead(const ReadExpr &re) {
     const UpdateList &ul = re.updates;
 
-    // XXX should we memo better than what ExprVisitor is doing for us?
+    // The visitor memoizes expressions, but not update lists, which are
+    // shared by many reads; queue the expressions of each one once,
+    // stopping at the part already queued for another read. They are
+    // visited by find(), as visiting them from here would recurse once per
+    // level of reads nested in update values.
     for (const UpdateNode *un=ul.head; un; un=un->next) {
-      visit(un->index);
-      visit(un->value);
+      if (!updates.insert(un).second)
+        break;
+      pending.push_back(un->value);
+      pending.push_back(un->index);
     }
 
     if (ul.root->isSymbolicArray())
@@ -96,12 +102,26 @@ protected:
     return Action::doChildren();
   }
 
+  std::set<const UpdateNode*> updates;
+  /// The update expressions still to visit, the next one last.
+  std::vector< ref<Expr> > pending;
+
 public:
   std::set<const Array*> results;
   std::vector<const Array*> &objects;
   
   SymbolicObjectFinder(std::vector<const Array*> &_objects)
     : objects(_objects) {}
+
+  /// find - Visit \a e and the update lists of the reads in it.
+  void find(const ref<Expr> &e) {
+    visit(e);
+    while (!pending.empty()) {
+      ref<Expr> next = pending.back();
+      pending.pop_back();
+      visit(next);
+    }
+  }
 };
 
 }
@@ -112,7 +132,7 @@ void klee::findSymbolicObjects(InputIterator begin,
                                std::vector<const Array*> &results) {
   SymbolicObjectFinder of(results);
   for (; begin!=end; ++begin)
-    of.visit(*begin);
+    of.find(*begin);
 }
 
 void klee::findSymbolicObjects(ref<Expr> e,
@@ -10,132 +10,162 @@
 #include "klee/Expr.h"
 #include "klee/util/ExprVisitor.h"
 
-#include "llvm/Support/CommandLine.h"
+using namespace klee;
 
-namespace {
-  llvm::cl::opt<bool>
-  UseVisitorHash("use-visitor-hash", 
-                 llvm::cl::desc("Use hash-consing during expr visitation."),
-                 llvm::cl::init(true));
+/// dispatch - Call the visit method for the kind of \a e.
+ExprVisitor::Action ExprVisitor::dispatch(const Expr &e) {
+  switch(e.getKind()) {
+  case Expr::NotOptimized: return visitNotOptimized(static_cast<const NotOptimizedExpr&>(e));
+  case Expr::Read: return visitRead(static_cast<const ReadExpr&>(e));
+  case Expr::Select: return visitSelect(static_cast<const SelectExpr&>(e));
+  case Expr::Concat: return visitConcat(static_cast<const ConcatExpr&>(e));
+  case Expr::Extract: return visitExtract(static_cast<const ExtractExpr&>(e));
+  case Expr::ZExt: return visitZExt(static_cast<const ZExtExpr&>(e));
+  case Expr::SExt: return visitSExt(static_cast<const SExtExpr&>(e));
+  case Expr::FPExt: return visitFPExt(static_cast<const FPExtExpr&>(e));
+  case Expr::FPTrunc: return visitFPTrunc(static_cast<const FPTruncExpr&>(e));
+  case Expr::UIToFP: return visitUIToFP(static_cast<const UIToFPExpr&>(e));
+  case Expr::SIToFP: return visitSIToFP(static_cast<const SIToFPExpr&>(e));
+  case Expr::FPToUI: return visitFPToUI(static_cast<const FPToUIExpr&>(e));
+  case Expr::FPToSI: return visitFPToSI(static_cast<const FPToSIExpr&>(e));
+  case Expr::FOrd1: return visitFOrd1(static_cast<const FOrd1Expr&>(e));
+  case Expr::FSqrt: return visitFSqrt(static_cast<const FSqrtExpr&>(e));
+  case Expr::FCos: return visitFCos(static_cast<const FCosExpr&>(e));
+  case Expr::FSin: return visitFSin(static_cast<const FSinExpr&>(e));
+  case Expr::Add: return visitAdd(static_cast<const AddExpr&>(e));
+  case Expr::Sub: return visitSub(static_cast<const SubExpr&>(e));
+  case Expr::Mul: return visitMul(static_cast<const MulExpr&>(e));
+  case Expr::UDiv: return visitUDiv(static_cast<const UDivExpr&>(e));
+  case Expr::SDiv: return visitSDiv(static_cast<const SDivExpr&>(e));
+  case Expr::URem: return visitURem(static_cast<const URemExpr&>(e));
+  case Expr::SRem: return visitSRem(static_cast<const SRemExpr&>(e));
+  case Expr::FAdd: return visitFAdd(static_cast<const FAddExpr&>(e));
+  case Expr::FSub: return visitFSub(static_cast<const FSubExpr&>(e));
+  case Expr::FMul: return visitFMul(static_cast<const FMulExpr&>(e));
+  case Expr::FDiv: return visitFDiv(static_cast<const FDivExpr&>(e));
+  case Expr::FRem: return visitFRem(static_cast<const FRemExpr&>(e));
+  case Expr::Not: return visitNot(static_cast<const NotExpr&>(e));
+  case Expr::And: return visitAnd(static_cast<const AndExpr&>(e));
+  case Expr::Or: return visitOr(static_cast<const OrExpr&>(e));
+  case Expr::Xor: return visitXor(static_cast<const XorExpr&>(e));
+  case Expr::Shl: return visitShl(static_cast<const ShlExpr&>(e));
+  case Expr::LShr: return visitLShr(static_cast<const LShrExpr&>(e));
+  case Expr::AShr: return visitAShr(static_cast<const AShrExpr&>(e));
+  case Expr::Eq: return visitEq(static_cast<const EqExpr&>(e));
+  case Expr::Ne: return visitNe(static_cast<const NeExpr&>(e));
+  case Expr::Ult: return visitUlt(static_cast<const UltExpr&>(e));
+  case Expr::Ule: return visitUle(static_cast<const UleExpr&>(e));
+  case Expr::Ugt: return visitUgt(static_cast<const UgtExpr&>(e));
+  case Expr::Uge: return visitUge(static_cast<const UgeExpr&>(e));
+  case Expr::Slt: return visitSlt(static_cast<const SltExpr&>(e));
+  case Expr::Sle: return visitSle(static_cast<const SleExpr&>(e));
+  case Expr::Sgt: return visitSgt(static_cast<const SgtExpr&>(e));
+  case Expr::Sge: return visitSge(static_cast<const SgeExpr&>(e));
+  case Expr::FCmp: return visitFCmp(static_cast<const FCmpExpr&>(e));
+  case Expr::Constant:
+  default:
+    assert(0 && "invalid expression kind");
+    return Action::skipChildren();
+  }
 }
 
-using namespace klee;
+/// enter - Start visiting \a e. Returns true, with \a result set, if that
+/// is done without visiting its kids; otherwise a frame for it is pushed
+/// on \a stack.
+bool ExprVisitor::enter(const ref<Expr> &e, std::vector<Frame> &stack,
+                        ref<Expr> &result) {
+  if (isa<ConstantExpr>(e) || isa<AnyExpr>(e)) {
+    result = e;
+    return true;
+  }
 
-ref<Expr> ExprVisitor::visit(const ref<Expr> &e) {
-  if (!UseVisitorHash || isa<ConstantExpr>(e) || isa<AnyExpr>(e)) {
-    return visitActual(e);
-  } else {
-    visited_ty::iterator it = visited.find(e);
+  visited_ty::iterator it = visited.find(e);
+  if (it != visited.end()) {
+    result = it->second;
+    return true;
+  }
 
-    if (it!=visited.end()) {
-      return it->second;
-    } else {
-      ref<Expr> res = visitActual(e);
-      visited.insert(std::make_pair(e, res));
-      return res;
-    }
+  Action res = visitExpr(*e.get());
+  if (res.kind == Action::DoChildren)
+    res = dispatch(*e.get());
+
+  switch(res.kind) {
+  default:
+    assert(0 && "invalid kind");
+  case Action::DoChildren:
+    stack.push_back(Frame(e));
+    return false;
+  case Action::SkipChildren:
+    result = e;
+    break;
+  case Action::ChangeTo:
+    result = res.argument;
+    break;
   }
+
+  visited.insert(std::make_pair(e, result));
+  return true;
 }
 
-ref<Expr> ExprVisitor::visitActual(const ref<Expr> &e) {
-  if (isa<ConstantExpr>(e) || isa<AnyExpr>(e)) {    
-    return e;
-  } else {
-    Expr &ep = *e.get();
+ref<Expr> ExprVisitor::visit(const ref<Expr> &root) {
+  std::vector<Frame> stack;
+  ref<Expr> result;
+  if (enter(root, stack, result))
+    return result;
 
-    Action res = visitExpr(ep);
-    switch(res.kind) {
-    case Action::DoChildren:
-      // continue with normal action
-      break;
-    case Action::SkipChildren:
-      return e;
-    case Action::ChangeTo:
-      return res.argument;
-    }
+  for (;;) {
+    Frame &f = stack.back();
 
-    switch(ep.getKind()) {
-    case Expr::NotOptimized: res = visitNotOptimized(static_cast<NotOptimizedExpr&>(ep)); break;
-    case Expr::Read: res = visitRead(static_cast<ReadExpr&>(ep)); break;
-    case Expr::Select: res = visitSelect(static_cast<SelectExpr&>(ep)); break;
-    case Expr::Concat: res = visitConcat(static_cast<ConcatExpr&>(ep)); break;
-    case Expr::Extract: res = visitExtract(static_cast<ExtractExpr&>(ep)); break;
-    case Expr::ZExt: res = visitZExt(static_cast<ZExtExpr&>(ep)); break;
-    case Expr::SExt: res = visitSExt(static_cast<SExtExpr&>(ep)); break;
-    case Expr::FPExt: res = visitFPExt(static_cast<FPExtExpr&>(ep)); break;
-    case Expr::FPTrunc: res = visitFPTrunc(static_cast<FPTruncExpr&>(ep)); break;
-    case Expr::UIToFP: res = visitUIToFP(static_cast<UIToFPExpr&>(ep)); break;
-    case Expr::SIToFP: res = visitSIToFP(static_cast<SIToFPExpr&>(ep)); break;
-    case Expr::FPToUI: res = visitFPToUI(static_cast<FPToUIExpr&>(ep)); break;
-    case Expr::FPToSI: res = visitFPToSI(static_cast<FPToSIExpr&>(ep)); break;
-    case Expr::FOrd1: res = visitFOrd1(static_cast<FOrd1Expr&>(ep)); break;
-    case Expr::FSqrt: res = visitFSqrt(static_cast<FSqrtExpr&>(ep)); break;
-    case Expr::FCos: res = visitFCos(static_cast<FCosExpr&>(ep)); break;
-    case Expr::FSin: res = visitFSin(static_cast<FSinExpr&>(ep)); break;
-    case Expr::Add: res = visitAdd(static_cast<AddExpr&>(ep)); break;
-    case Expr::Sub: res = visitSub(static_cast<SubExpr&>(ep)); break;
-    case Expr::Mul: res = visitMul(static_cast<MulExpr&>(ep)); break;
-    case Expr::UDiv: res = visitUDiv(static_cast<UDivExpr&>(ep)); break;
-    case Expr::SDiv: res = visitSDiv(static_cast<SDivExpr&>(ep)); break;
-    case Expr::URem: res = visitURem(static_cast<URemExpr&>(ep)); break;
-    case Expr::SRem: res = visitSRem(static_cast<SRemExpr&>(ep)); break;
-    case Expr::FAdd: res = visitFAdd(static_cast<FAddExpr&>(ep)); break;
-    case Expr::FSub: res = visitFSub(static_cast<FSubExpr&>(ep)); break;
-    case Expr::FMul: res = visitFMul(static_cast<FMulExpr&>(ep)); break;
-    case Expr::FDiv: res = visitFDiv(static_cast<FDivExpr&>(ep)); break;
-    case Expr::FRem: res = visitFRem(static_cast<FRemExpr&>(ep)); break;
-    case Expr::Not: res = visitNot(static_cast<NotExpr&>(ep)); break;
-    case Expr::And: res = visitAnd(static_cast<AndExpr&>(ep)); break;
-    case Expr::Or: res = visitOr(static_cast<OrExpr&>(ep)); break;
-    case Expr::Xor: res = visitXor(static_cast<XorExpr&>(ep)); break;
-    case Expr::Shl: res = visitShl(static_cast<ShlExpr&>(ep)); break;
-    case Expr::LShr: res = visitLShr(static_cast<LShrExpr&>(ep)); break;
-    case Expr::AShr: res = visitAShr(static_cast<AShrExpr&>(ep)); break;
-    case Expr::Eq: res = visitEq(static_cast<EqExpr&>(ep)); break;
-    case Expr::Ne: res = visitNe(static_cast<NeExpr&>(ep)); break;
-    case Expr::Ult: res = visitUlt(static_cast<UltExpr&>(ep)); break;
-    case Expr::Ule: res = visitUle(static_cast<UleExpr&>(ep)); break;
-    case Expr::Ugt: res = visitUgt(static_cast<UgtExpr&>(ep)); break;
-    case Expr::Uge: res = visitUge(static_cast<UgeExpr&>(ep)); break;
-    case Expr::Slt: res = visitSlt(static_cast<SltExpr&>(ep)); break;
-    case Expr::Sle: res = visitSle(static_cast<SleExpr&>(ep)); break;
-    case Expr::Sgt: res = visitSgt(static_cast<SgtExpr&>(ep)); break;
-    case Expr::Sge: res = visitSge(static_cast<SgeExpr&>(ep)); break;
-    case Expr::FCmp: res = visitFCmp(static_cast<FCmpExpr&>(ep)); break;
-    case Expr::Constant:
-    default:
-      assert(0 && "invalid expression kind");
+    // Visit the next kid; if it needs its own kids visited, come back to
+    // this frame once it is done.
+    if (!f.awaitingRebuilt && f.next != f.e->getNumKids()) {
+      ref<Expr> kid;
+      if (enter(f.e->getKid(f.next), stack, kid)) {
+        f.kids[f.next] = kid;
+        ++f.next;
+      }
+      continue;
     }
 
-    switch(res.kind) {
-    default:
-      assert(0 && "invalid kind");
-    case Action::DoChildren: {  
+    ref<Expr> e = f.e;
+    if (f.awaitingRebuilt) {
+      e = f.rebuilt;
+    } else {
       bool rebuild = false;
-      ref<Expr> e(&ep), kids[8];
-      unsigned count = ep.getNumKids();
-      for (unsigned i=0; i<count; i++) {
-        ref<Expr> kid = ep.getKid(i);
-        kids[i] = visit(kid);
-        if (kids[i] != kid)
+      for (unsigned i = 0; i != f.next; ++i)
+        if (f.kids[i] != f.e->getKid(i))
           rebuild = true;
-      }
+
       if (rebuild) {
-        e = ep.rebuild(kids);
-        if (recursive)
-          e = visit(e);
+        e = f.e->rebuild(f.kids);
+        if (recursive) {
+          f.awaitingRebuilt = true;
+          ref<Expr> res;
+          if (!enter(e, stack, res))
+            continue;
+          e = res;
+        }
       }
-      if (!isa<ConstantExpr>(e)) {
-        res = visitExprPost(*e.get());
-        if (res.kind==Action::ChangeTo)
-          e = res.argument;
-      }
-      return e;
     }
-    case Action::SkipChildren:
+
+    if (!isa<ConstantExpr>(e)) {
+      Action res = visitExprPost(*e.get());
+      if (res.kind == Action::ChangeTo)
+        e = res.argument;
+    }
+
+    visited.insert(std::make_pair(stack.back().e, e));
+    stack.pop_back();
+    if (stack.empty())
       return e;
-    case Action::ChangeTo:
-      return res.argument;
+
+    // Hand the result to the expression waiting for it.
+    Frame &parent = stack.back();
+    if (parent.awaitingRebuilt) {
+      parent.rebuilt = e;
+    } else {
+      parent.kids[parent.next] = e;
+      ++parent.next;
     }
   }
 }
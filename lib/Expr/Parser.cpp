@@ -869,6 +869,26 @@ static bool LookupExprInfo(const Token &Tok, unsigned &Kind,
       return SetOK(Expr::SExt, false, 1);
     if (memcmp(Tok.start, "ZExt", 4) == 0)
       return SetOK(Expr::ZExt, false, 1);
+
+    if (memcmp(Tok.start, "FAdd", 4) == 0)
+      return SetOK(Expr::FAdd, true, 2);
+    if (memcmp(Tok.start, "FSub", 4) == 0)
+      return SetOK(Expr::FSub, true, 2);
+    if (memcmp(Tok.start, "FMul", 4) == 0)
+      return SetOK(Expr::FMul, true, 2);
+    if (memcmp(Tok.start, "FDiv", 4) == 0)
+      return SetOK(Expr::FDiv, true, 2);
+    if (memcmp(Tok.start, "FRem", 4) == 0)
+      return SetOK(Expr::FRem, true, 2);
+    if (memcmp(Tok.start, "FCos", 4) == 0)
+      return SetOK(Expr::FCos, true, 1);
+    if (memcmp(Tok.start, "FSin", 4) == 0)
+      return SetOK(Expr::FSin, true, 1);
+    break;
+
+  case 5:
+    if (memcmp(Tok.start, "FSqrt", 5) == 0)
+      return SetOK(Expr::FSqrt, true, 1);
     break;
     
   case 6:
@@ -1026,6 +1046,14 @@ ExprResult ParserImpl::ParseUnaryParenExpr(const Token &Name,
   case Expr::ZExt:
     // FIXME: Type check arguments.
     return Builder->ZExt(E, ResTy);
+  // FIXME: Use builder! The IEEE flag only tells the 128 bit formats apart
+  // and is not printed.
+  case Expr::FSqrt:
+    return FSqrtExpr::create(E, false);
+  case Expr::FCos:
+    return FCosExpr::create(E, false);
+  case Expr::FSin:
+    return FSinExpr::create(E, false);
   default:
     Error("internal error, unhandled kind.", Name);
     return Builder->Constant(0, ResTy);
@@ -1132,6 +1160,13 @@ ExprResult ParserImpl::ParseBinaryParenExpr(const Token &Name,
   case Expr::Sle: return Builder->Sle(LHS_E, RHS_E);
   case Expr::Sgt: return Builder->Sgt(LHS_E, RHS_E);
   case Expr::Sge: return Builder->Sge(LHS_E, RHS_E);
+
+  // FIXME: Use builder!
+  case Expr::FAdd: return FAddExpr::create(LHS_E, RHS_E, false);
+  case Expr::FSub: return FSubExpr::create(LHS_E, RHS_E, false);
+  case Expr::FMul: return FMulExpr::create(LHS_E, RHS_E, false);
+  case Expr::FDiv: return FDivExpr::create(LHS_E, RHS_E, false);
+  case Expr::FRem: return FRemExpr::create(LHS_E, RHS_E, false);
   default:
     Error("FIXME: unhandled kind.", Name);
     return Builder->Constant(0, ResTy);
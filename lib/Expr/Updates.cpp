@@ -10,33 +10,97 @@
 #include "klee/Expr.h"
 
 #include <cassert>
+#include <vector>
 
 using namespace klee;
 
+/// The number of consecutive updates at concrete indices from which the
+/// overwritten ones are dropped.
+static const unsigned CompactionThreshold = 16;
+
+/// getConcreteIndex - Get the index of \a un if it is concrete.
+static bool getConcreteIndex(const UpdateNode *un, uint64_t &index) {
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(un->index);
+  if (!CE || CE->getWidth() > 64)
+    return false;
+  index = CE->getZExtValue();
+  return true;
+}
+
 ///
 
 UpdateNode::UpdateNode(const UpdateNode *_next, 
                        const ref<Expr> &_index, 
                        const ref<Expr> &_value) 
   : refCount(0),
-    stpArray(0),
     next(_next),
     index(_index),
-    value(_value) {
+    value(_value),
+    indexed(false),
+    numConcreteIndices(0),
+    concreteEnd(0) {
   computeHash();
   if (next) {
     ++next->refCount;
     size = 1 + next->size;
   }
   else size = 1;
-}
 
-extern "C" void vc_DeleteExpr(void*);
+  uint64_t concreteIndex;
+  if (getConcreteIndex(this, concreteIndex))
+    concreteSize = 1 + (next ? next->concreteSize : 0);
+  else
+    concreteSize = 0;
+}
 
 UpdateNode::~UpdateNode() {
-  // XXX gross
-  if (stpArray)
-    ::vc_DeleteExpr(stpArray);
+  ExprContext::get().forgetUpdate(this);
+}
+
+void UpdateNode::buildIndex() const {
+  // Find the updates to index, up to one which is indexed or is not at a
+  // concrete index.
+  std::vector<const UpdateNode*> pending;
+  const UpdateNode *un = this;
+  for (; un && un->concreteSize && !un->indexed; un = un->next)
+    pending.push_back(un);
+
+  ImmutableMap<uint64_t, const UpdateNode*> writes;
+  unsigned numIndices = 0;
+  const UpdateNode *end = un;
+  if (un && un->concreteSize) {
+    writes = un->concreteWrites;
+    numIndices = un->numConcreteIndices;
+    end = un->concreteEnd;
+  }
+
+  for (unsigned i = pending.size(); i != 0;) {
+    const UpdateNode *p = pending[--i];
+    uint64_t index;
+    getConcreteIndex(p, index);
+    if (!writes.count(index))
+      ++numIndices;
+    writes = writes.replace(std::make_pair(index, p));
+    p->concreteWrites = writes;
+    p->numConcreteIndices = numIndices;
+    p->concreteEnd = end;
+    p->indexed = true;
+  }
+}
+
+const UpdateNode *UpdateNode::findConcreteWrite(uint64_t index,
+                                                const UpdateNode *&rest) const {
+  if (!concreteSize) {
+    rest = this;
+    return 0;
+  }
+
+  if (!indexed)
+    buildIndex();
+  rest = concreteEnd;
+  const std::pair<uint64_t, const UpdateNode*> *res =
+    concreteWrites.lookup(index);
+  return res ? res->second : 0;
 }
 
 int UpdateNode::compare(const UpdateNode &b) const {
@@ -46,7 +110,9 @@ int UpdateNode::compare(const UpdateNode &b) const {
 }
 
 unsigned UpdateNode::computeHash() {
-  hashValue = index->hash() ^ value->hash();
+  // The value is mixed in, not just xor'ed: a read of an update list whose
+  // value is a read of a similar list would otherwise cancel its hash out.
+  hashValue = index->hash() ^ value->hash() * Expr::MAGIC_HASH_CONSTANT;
   if (next)
     hashValue ^= next->hash();
   return hashValue;
@@ -89,6 +155,33 @@ void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
   if (head) --head->refCount;
   head = new UpdateNode(head, index, value);
   ++head->refCount;
+
+  if (head->concreteSize >= CompactionThreshold) {
+    head->buildIndex();
+    if (head->concreteSize > 2 * head->numConcreteIndices)
+      compact();
+  }
+}
+
+/// compact - Drop the updates at concrete indices at the head which are
+/// overwritten by later ones.
+void UpdateList::compact() {
+  std::vector<const UpdateNode*> live;
+  for (const UpdateNode *un = head; un != head->concreteEnd; un = un->next) {
+    uint64_t index;
+    getConcreteIndex(un, index);
+    if (head->concreteWrites.lookup(index)->second == un)
+      live.push_back(un);
+  }
+
+  // The updates are at distinct concrete indices, so the result is not
+  // compacted again.
+  UpdateList res(root, head->concreteEnd);
+  for (unsigned i = live.size(); i != 0;) {
+    --i;
+    res.extend(live[i]->index, live[i]->value);
+  }
+  *this = res;
 }
 
 int UpdateList::compare(const UpdateList &b) const {
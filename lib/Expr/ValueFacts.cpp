@@ -0,0 +1,491 @@
+//===-- ValueFacts.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ValueFacts.h"
+
+#include "klee/util/Bits.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+using namespace klee;
+
+static uint64_t signBit(Expr::Width w) {
+  return (uint64_t) 1 << (w - 1);
+}
+
+static int64_t toSigned(uint64_t value, Expr::Width w) {
+  return (int64_t) (value << (64 - w)) >> (64 - w);
+}
+
+static uint64_t fromSigned(int64_t value, Expr::Width w) {
+  return bits64::truncateToNBits((uint64_t) value, w);
+}
+
+/// commonPrefix - The bits of width \a w above the highest bit in which \a
+/// a and \a b differ.
+static uint64_t commonPrefix(uint64_t a, uint64_t b, Expr::Width w) {
+  uint64_t below = a ^ b;
+  below |= below >> 1;
+  below |= below >> 2;
+  below |= below >> 4;
+  below |= below >> 8;
+  below |= below >> 16;
+  below |= below >> 32;
+  return bits64::maxValueOfNBits(w) & ~below;
+}
+
+static unsigned countTrailingOnes(uint64_t x) {
+  unsigned res = 0;
+  for (; x & 1; x >>= 1)
+    ++res;
+  return res;
+}
+
+ValueFacts ValueFacts::unknown(Expr::Width w) {
+  ValueFacts res;
+  if (w == 0 || w > 64) {
+    res.width = 0;
+    res.knownZero = res.knownOne = res.umin = res.umax = 0;
+    res.smin = res.smax = 0;
+    return res;
+  }
+
+  res.width = w;
+  res.knownZero = res.knownOne = 0;
+  res.umin = 0;
+  res.umax = bits64::maxValueOfNBits(w);
+  res.smin = toSigned(signBit(w), w);
+  res.smax = (int64_t) (signBit(w) - 1);
+  return res;
+}
+
+ValueFacts ValueFacts::constant(uint64_t value, Expr::Width w) {
+  ValueFacts res = unknown(w);
+  if (!res.width)
+    return res;
+
+  value = bits64::truncateToNBits(value, w);
+  res.knownOne = value;
+  res.knownZero = ~value & bits64::maxValueOfNBits(w);
+  res.umin = res.umax = value;
+  res.smin = res.smax = toSigned(value, w);
+  return res;
+}
+
+/// normalize - Tighten each of the facts by the others.
+void ValueFacts::normalize() {
+  uint64_t mask = bits64::maxValueOfNBits(width), sign = signBit(width);
+
+  // Twice, as the facts derived last may tighten those derived first.
+  for (unsigned i = 0; i != 2; ++i) {
+    // The known bits bound the intervals.
+    uint64_t lo = knownOne, hi = mask & ~knownZero;
+    umin = std::max(umin, lo);
+    umax = std::min(umax, hi);
+    if (!((knownZero | knownOne) & sign)) {
+      lo |= sign;
+      hi &= ~sign;
+    }
+    smin = std::max(smin, toSigned(lo, width));
+    smax = std::min(smax, toSigned(hi, width));
+
+    // The intervals bound each other where the values have one sign.
+    if (umax < sign) {
+      smin = std::max(smin, (int64_t) umin);
+      smax = std::min(smax, (int64_t) umax);
+    } else if (umin >= sign) {
+      smin = std::max(smin, toSigned(umin, width));
+      smax = std::min(smax, toSigned(umax, width));
+    }
+    if (smin >= 0 || smax < 0) {
+      umin = std::max(umin, fromSigned(smin, width));
+      umax = std::min(umax, fromSigned(smax, width));
+    }
+
+    // The values in an interval share the bits above the highest bit in
+    // which its bounds differ.
+    uint64_t prefix = commonPrefix(umin, umax, width);
+    knownOne |= umin & prefix;
+    knownZero |= ~umin & prefix;
+  }
+
+  assert(!(knownZero & knownOne) && umin <= umax && smin <= smax &&
+         "inconsistent value facts");
+}
+
+bool ValueFacts::usesKids(Expr::Kind k) {
+  switch (k) {
+  case Expr::NotOptimized:
+  case Expr::Select:
+  case Expr::Concat:
+  case Expr::Extract:
+  case Expr::ZExt:
+  case Expr::SExt:
+  case Expr::Add:
+  case Expr::Sub:
+  case Expr::Mul:
+  case Expr::UDiv:
+  case Expr::URem:
+  case Expr::Not:
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor:
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr:
+  case Expr::Eq:
+  case Expr::Ne:
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Ugt:
+  case Expr::Uge:
+  case Expr::Slt:
+  case Expr::Sle:
+  case Expr::Sgt:
+  case Expr::Sge:
+    return true;
+  default:
+    return false;
+  }
+}
+
+ValueFacts ValueFacts::compute(const Expr *e, const ValueFacts *kids[]) {
+  Expr::Width w = e->getWidth();
+  ValueFacts res = unknown(w);
+  if (!res.width)
+    return res;
+  uint64_t mask = bits64::maxValueOfNBits(w);
+
+  switch (e->getKind()) {
+  case Expr::Constant:
+    return constant(cast<ConstantExpr>(e)->getZExtValue(), w);
+
+  case Expr::NotOptimized:
+    return *kids[0];
+
+  case Expr::Select: {
+    uint64_t cond;
+    if (kids[0]->getConstant(cond))
+      return cond ? *kids[1] : *kids[2];
+
+    const ValueFacts &t = *kids[1], &f = *kids[2];
+    res.knownZero = t.knownZero & f.knownZero;
+    res.knownOne = t.knownOne & f.knownOne;
+    res.umin = std::min(t.umin, f.umin);
+    res.umax = std::max(t.umax, f.umax);
+    res.smin = std::min(t.smin, f.smin);
+    res.smax = std::max(t.smax, f.smax);
+    break;
+  }
+
+  case Expr::Concat: {
+    const ValueFacts &l = *kids[0], &r = *kids[1];
+    unsigned shift = r.width;
+    res.knownZero = (l.knownZero << shift) | r.knownZero;
+    res.knownOne = (l.knownOne << shift) | r.knownOne;
+    res.umin = (l.umin << shift) | r.umin;
+    res.umax = (l.umax << shift) | r.umax;
+    break;
+  }
+
+  case Expr::Extract: {
+    const ValueFacts &src = *kids[0];
+    if (!src.width)
+      break;
+    unsigned offset = cast<ExtractExpr>(e)->offset;
+    res.knownZero = (src.knownZero >> offset) & mask;
+    res.knownOne = (src.knownOne >> offset) & mask;
+    if (offset == 0 && src.umax <= mask) {
+      res.umin = src.umin;
+      res.umax = src.umax;
+    }
+    break;
+  }
+
+  case Expr::ZExt: {
+    const ValueFacts &src = *kids[0];
+    if (src.width > w)
+      break;
+    res.knownZero = src.knownZero | (mask & ~bits64::maxValueOfNBits(src.width));
+    res.knownOne = src.knownOne;
+    res.umin = src.umin;
+    res.umax = src.umax;
+    break;
+  }
+
+  case Expr::SExt: {
+    const ValueFacts &src = *kids[0];
+    if (src.width > w)
+      break;
+    uint64_t ext = mask & ~bits64::maxValueOfNBits(src.width);
+    res.knownZero = src.knownZero;
+    res.knownOne = src.knownOne;
+    if (src.knownZero & signBit(src.width))
+      res.knownZero |= ext;
+    if (src.knownOne & signBit(src.width))
+      res.knownOne |= ext;
+    res.smin = src.smin;
+    res.smax = src.smax;
+    break;
+  }
+
+  case Expr::Not: {
+    const ValueFacts &src = *kids[0];
+    res.knownZero = src.knownOne;
+    res.knownOne = src.knownZero;
+    res.umin = mask - src.umax;
+    res.umax = mask - src.umin;
+    res.smin = -1 - src.smax;
+    res.smax = -1 - src.smin;
+    break;
+  }
+
+  default:
+    if (usesKids(e->getKind()))
+      return eval(e->getKind(), *kids[0], *kids[1], w);
+    return res;
+  }
+
+  res.normalize();
+  return res;
+}
+
+ValueFacts ValueFacts::eval(Expr::Kind k, const ValueFacts &a,
+                            const ValueFacts &b, Expr::Width w) {
+  ValueFacts res = unknown(w);
+  if (!res.width || !a.width || !b.width)
+    return res;
+  uint64_t mask = bits64::maxValueOfNBits(w);
+
+  switch (k) {
+  case Expr::Add:
+  case Expr::Sub: {
+    // The low bits known in both kids fix those of the result, as carries
+    // (and borrows) only go up.
+    unsigned n = countTrailingOnes((a.knownZero | a.knownOne) &
+                                   (b.knownZero | b.knownOne));
+    uint64_t low = bits64::maxValueOfNBits(n);
+    uint64_t value;
+    if (k == Expr::Add) {
+      value = a.knownOne + b.knownOne;
+      if (a.umax <= mask - b.umax) {
+        res.umin = a.umin + b.umin;
+        res.umax = a.umax + b.umax;
+      }
+    } else {
+      value = a.knownOne - b.knownOne;
+      if (a.umin >= b.umax) {
+        res.umin = a.umin - b.umax;
+        res.umax = a.umax - b.umin;
+      }
+    }
+    res.knownOne = value & low;
+    res.knownZero = ~value & low;
+
+    // Below 64 bits the signed bounds cannot overflow an int64_t.
+    if (w < 64) {
+      int64_t lo, hi;
+      if (k == Expr::Add) {
+        lo = a.smin + b.smin;
+        hi = a.smax + b.smax;
+      } else {
+        lo = a.smin - b.smax;
+        hi = a.smax - b.smin;
+      }
+      if (lo >= res.smin && hi <= res.smax) {
+        res.smin = lo;
+        res.smax = hi;
+      }
+    }
+    break;
+  }
+
+  case Expr::Mul: {
+    unsigned n = countTrailingOnes((a.knownZero | a.knownOne) &
+                                   (b.knownZero | b.knownOne));
+    uint64_t low = bits64::maxValueOfNBits(n);
+    uint64_t value = a.knownOne * b.knownOne;
+    unsigned zeros = std::min(countTrailingOnes(a.knownZero) +
+                              countTrailingOnes(b.knownZero), w);
+    res.knownOne = value & low;
+    res.knownZero = (~value & low) | bits64::maxValueOfNBits(zeros);
+    if (a.umax == 0 || b.umax <= mask / a.umax) {
+      res.umin = a.umin * b.umin;
+      res.umax = a.umax * b.umax;
+    }
+    break;
+  }
+
+  case Expr::UDiv:
+    if (b.umin) {
+      res.umin = a.umin / b.umax;
+      res.umax = a.umax / b.umin;
+    }
+    break;
+
+  case Expr::URem:
+    if (b.umin) {
+      if (a.umax < b.umin)
+        return a;
+      res.umax = std::min(a.umax, b.umax - 1);
+    }
+    break;
+
+  case Expr::And:
+    res.knownZero = a.knownZero | b.knownZero;
+    res.knownOne = a.knownOne & b.knownOne;
+    res.umax = std::min(a.umax, b.umax);
+    break;
+
+  case Expr::Or:
+    res.knownZero = a.knownZero & b.knownZero;
+    res.knownOne = a.knownOne | b.knownOne;
+    res.umin = std::max(a.umin, b.umin);
+    break;
+
+  case Expr::Xor:
+    res.knownZero = (a.knownZero & b.knownZero) | (a.knownOne & b.knownOne);
+    res.knownOne = (a.knownZero & b.knownOne) | (a.knownOne & b.knownZero);
+    break;
+
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr: {
+    uint64_t shift;
+    if (!b.getConstant(shift) || shift >= w)
+      break;
+
+    if (k == Expr::Shl) {
+      res.knownZero = ((a.knownZero << shift) |
+                       bits64::maxValueOfNBits(shift)) & mask;
+      res.knownOne = (a.knownOne << shift) & mask;
+      if (a.umax <= (mask >> shift)) {
+        res.umin = a.umin << shift;
+        res.umax = a.umax << shift;
+      }
+    } else if (k == Expr::LShr) {
+      res.knownZero = (a.knownZero >> shift) | (mask & ~(mask >> shift));
+      res.knownOne = a.knownOne >> shift;
+      res.umin = a.umin >> shift;
+      res.umax = a.umax >> shift;
+    } else {
+      uint64_t high = mask & ~(mask >> shift);
+      res.knownZero = a.knownZero >> shift;
+      res.knownOne = a.knownOne >> shift;
+      if (a.knownZero & signBit(w))
+        res.knownZero |= high;
+      if (a.knownOne & signBit(w))
+        res.knownOne |= high;
+      res.smin = a.smin >> shift;
+      res.smax = a.smax >> shift;
+    }
+    break;
+  }
+
+  case Expr::Eq:
+  case Expr::Ne: {
+    uint64_t va, vb;
+    bool disjoint = (a.knownZero & b.knownOne) || (a.knownOne & b.knownZero) ||
+      a.umax < b.umin || b.umax < a.umin ||
+      a.smax < b.smin || b.smax < a.smin;
+    if (disjoint)
+      return constant(k == Expr::Ne, w);
+    if (a.getConstant(va) && b.getConstant(vb))
+      return constant(k == Expr::Eq, w);
+    return res;
+  }
+
+  case Expr::Ult:
+    if (a.umax < b.umin)
+      return constant(1, w);
+    if (a.umin >= b.umax)
+      return constant(0, w);
+    return res;
+
+  case Expr::Ule:
+    if (a.umax <= b.umin)
+      return constant(1, w);
+    if (a.umin > b.umax)
+      return constant(0, w);
+    return res;
+
+  case Expr::Slt:
+    if (a.smax < b.smin)
+      return constant(1, w);
+    if (a.smin >= b.smax)
+      return constant(0, w);
+    return res;
+
+  case Expr::Sle:
+    if (a.smax <= b.smin)
+      return constant(1, w);
+    if (a.smin > b.smax)
+      return constant(0, w);
+    return res;
+
+  case Expr::Ugt:
+    return eval(Expr::Ult, b, a, w);
+  case Expr::Uge:
+    return eval(Expr::Ule, b, a, w);
+  case Expr::Sgt:
+    return eval(Expr::Slt, b, a, w);
+  case Expr::Sge:
+    return eval(Expr::Sle, b, a, w);
+
+  default:
+    return res;
+  }
+
+  res.normalize();
+  return res;
+}
+
+const ValueFacts &klee::getValueFacts(const Expr *e) {
+  if (e->facts)
+    return *e->facts;
+
+  // Expressions may be deep, so the facts of the kids are computed first
+  // from an explicit stack rather than by recursion.
+  std::vector<const Expr*> stack(1, e);
+  while (!stack.empty()) {
+    const Expr *top = stack.back();
+    if (top->facts) {
+      stack.pop_back();
+      continue;
+    }
+
+    unsigned numKids =
+      ValueFacts::usesKids(top->getKind()) ? top->getNumKids() : 0;
+    bool ready = true;
+    for (unsigned i = 0; i != numKids; ++i) {
+      const Expr *kid = top->getKid(i).get();
+      if (!kid->facts) {
+        stack.push_back(kid);
+        ready = false;
+      }
+    }
+    if (!ready)
+      continue;
+
+    const ValueFacts *kids[3];
+    assert(numKids <= 3 && "unexpected number of kids");
+    for (unsigned i = 0; i != numKids; ++i)
+      kids[i] = top->getKid(i)->facts;
+    top->facts = new ValueFacts(ValueFacts::compute(top, kids));
+    stack.pop_back();
+  }
+
+  return *e->facts;
+}
+
+void klee::destroyValueFacts(ValueFacts *facts) {
+  delete facts;
+}
@@ -14,6 +14,7 @@
 #include "klee/SolverImpl.h"
 #include "klee/TimerStatIncrementer.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/ExprBytecode.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 #include "klee/Internal/ADT/MapOfSets.h"
@@ -37,12 +38,28 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<unsigned>
+  CexCacheLookupLimit("cex-cache-lookup-limit",
+                      cl::desc("Number of cache nodes a subset or superset "
+                               "search may visit, 0 is unlimited "
+                               "(default=10000)"),
+                      cl::init(10000));
+
 }
 
 ///
 
 typedef std::set< ref<Expr> > KeyType;
 
+namespace klee {
+  template<>
+  struct MapOfSetsTraits< ref<Expr> > {
+    static uint64_t getSignature(const ref<Expr> &e) {
+      return 1ULL << (e->hash() % 64);
+    }
+  };
+}
+
 struct AssignmentLessThan {
   bool operator()(const Assignment *a, const Assignment *b) {
     return a->bindings < b->bindings;
@@ -72,7 +89,9 @@ class CexCachingSolver : public SolverImpl {
   bool getAssignment(const Query& query, Assignment *&result);
   
 public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
+  CexCachingSolver(Solver *_solver) : solver(_solver) {
+    cache.setLookupLimit(CexCacheLookupLimit);
+  }
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
@@ -95,13 +114,26 @@ struct NonNullAssignment {
   bool operator()(Assignment *a) const { return a!=0; }
 };
 
+/// satisfiesKey - Whether \a a satisfies \a key, using its compiled form
+/// \a code when it decides.
+static bool satisfiesKey(Assignment *a, const ExprBytecode &code,
+                         KeyType &key) {
+  switch (code.evaluate(*a)) {
+  case ExprBytecode::True: return true;
+  case ExprBytecode::False: return false;
+  default: return a->satisfies(key.begin(), key.end());
+  }
+}
+
 struct NullOrSatisfyingAssignment {
   KeyType &key;
+  const ExprBytecode &code;
   
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+  NullOrSatisfyingAssignment(KeyType &_key, const ExprBytecode &_code)
+    : key(_key), code(_code) {}
 
   bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+    return !a || satisfiesKey(a, code, key); 
   }
 };
 
@@ -115,6 +147,7 @@ struct NullOrSatisfyingAssignment {
 bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
   Assignment * const *lookup = cache.lookup(key);
   if (lookup) {
+    ++stats::cexCacheHits;
     result = *lookup;
     return true;
   }
@@ -123,23 +156,30 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // Look for a satisfying assignment for a superset, which is trivially an
     // assignment for any subset.
     Assignment **lookup = cache.findSuperset(key, NonNullAssignment());
+    stats::cexCacheLookupNodes += cache.getLookupNodes();
     
     // Otherwise, look for a subset which is unsatisfiable, see below.
-    if (!lookup) 
+    if (!lookup) {
       lookup = cache.findSubset(key, NullAssignment());
+      stats::cexCacheLookupNodes += cache.getLookupNodes();
+    }
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
+      ++stats::cexCacheHits;
       result = *lookup;
       return true;
     }
 
     // Otherwise, iterate through the set of current assignments to see if one
-    // of them satisfies the query.
+    // of them satisfies the query. The query is compiled once for all of
+    // them.
+    ExprBytecode code(key.begin(), key.end());
     for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
            ie = assignmentsTable.end(); it != ie; ++it) {
       Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
+      if (satisfiesKey(a, code, key)) {
+        ++stats::cexCacheHits;
         result = a;
         return true;
       }
@@ -150,22 +190,28 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // Look for a satisfying assignment for a superset, which is trivially an
     // assignment for any subset.
     Assignment **lookup = cache.findSuperset(key, NonNullAssignment());
+    stats::cexCacheLookupNodes += cache.getLookupNodes();
 
     // Otherwise, look for a subset which is unsatisfiable -- if the subset is
     // unsatisfiable then no additional constraints can produce a valid
     // assignment. While searching subsets, we also explicitly the solutions for
     // satisfiable subsets to see if they solve the current query and return
     // them if so. This is cheap and frequently succeeds.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+    if (!lookup) {
+      ExprBytecode code(key.begin(), key.end());
+      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key, code));
+      stats::cexCacheLookupNodes += cache.getLookupNodes();
+    }
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
+      ++stats::cexCacheHits;
       result = *lookup;
       return true;
     }
   }
   
+  ++stats::cexCacheMisses;
   return false;
 }
 
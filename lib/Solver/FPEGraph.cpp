@@ -0,0 +1,437 @@
+//===-- FPEGraph.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FPEGraph.h"
+
+#include <cassert>
+
+using namespace klee;
+using namespace llvm;
+
+/***/
+
+bool FPEGraph::ENode::operator<(const ENode &b) const {
+  if (kind != b.kind) return kind < b.kind;
+  if (width != b.width) return width < b.width;
+  if (sem != b.sem) return sem < b.sem;
+  if (flags != b.flags) return flags < b.flags;
+  return kids < b.kids;
+}
+
+FPEGraph::FPEGraph(bool _relaxed, unsigned _maxNodes)
+  : relaxed(_relaxed), maxNodes(_maxNodes), version(0) {}
+
+FPEGraph::ClassId FPEGraph::find(ClassId c) {
+  while (parent[c] != c) {
+    parent[c] = parent[parent[c]];
+    c = parent[c];
+  }
+  return c;
+}
+
+void FPEGraph::canonicalize(ENode &n) {
+  for (unsigned i = 0; i != n.kids.size(); ++i)
+    n.kids[i] = find(n.kids[i]);
+}
+
+FPEGraph::ClassId FPEGraph::addNode(ENode n) {
+  canonicalize(n);
+  std::map<ENode, unsigned>::iterator it = memo.find(n);
+  if (it != memo.end())
+    return find(nodeClass[it->second]);
+
+  unsigned id = nodes.size();
+  ClassId c = parent.size();
+  nodes.push_back(n);
+  nodeClass.push_back(c);
+  parent.push_back(c);
+  classNodes.push_back(std::vector<unsigned>(1, id));
+  memo.insert(std::make_pair(n, id));
+  ++version;
+  return c;
+}
+
+FPEGraph::ClassId FPEGraph::addLeaf(const ref<Expr> &e) {
+  ExprHashMap<unsigned>::iterator it = leafIndices.find(e);
+  unsigned index;
+  if (it != leafIndices.end()) {
+    index = it->second;
+  } else {
+    index = leafExprs.size();
+    leafExprs.push_back(e);
+    leafIndices.insert(std::make_pair(e, index));
+  }
+  return addNode(ENode(e->getKind(), e->getWidth(), index));
+}
+
+bool FPEGraph::merge(ClassId a, ClassId b) {
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return false;
+
+  if (classNodes[a].size() < classNodes[b].size())
+    std::swap(a, b);
+  parent[b] = a;
+  classNodes[a].insert(classNodes[a].end(),
+                       classNodes[b].begin(), classNodes[b].end());
+  classNodes[b].clear();
+  ++version;
+  return true;
+}
+
+/// rebuild - Restore the congruence invariant after merges: nodes whose kids
+/// have become equal are themselves merged, until nothing changes.
+void FPEGraph::rebuild() {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::map<ENode, unsigned> newMemo;
+    for (unsigned i = 0; i != nodes.size(); ++i) {
+      canonicalize(nodes[i]);
+      std::pair<std::map<ENode, unsigned>::iterator, bool> res =
+        newMemo.insert(std::make_pair(nodes[i], i));
+      if (!res.second && merge(nodeClass[i], nodeClass[res.first->second]))
+        changed = true;
+    }
+    memo.swap(newMemo);
+  }
+}
+
+FPEGraph::ClassId FPEGraph::add(const ref<Expr> &e) {
+  ExprHashMap<ClassId>::iterator it = added.find(e);
+  if (it != added.end())
+    return find(it->second);
+
+  ClassId res;
+  ref<Expr> neg;
+  Expr::Kind k = e->getKind();
+  if (k == Expr::Eq && e->isNotExpr(neg)) {
+    ENode n(Expr::Not, Expr::Bool);
+    n.kids.push_back(add(neg));
+    res = addNode(n);
+  } else if (isa<ConstantExpr>(e) || k == Expr::Read || k == Expr::Any ||
+             k == Expr::NotOptimized) {
+    res = addLeaf(e);
+  } else {
+    ENode n(k, e->getWidth());
+    unsigned numKids = e->getNumKids();
+    if (const FBinaryExpr *fb = dyn_cast<FBinaryExpr>(e)) {
+      n.flags = fb->isIEEE();
+    } else if (const FCmpExpr *fc = dyn_cast<FCmpExpr>(e)) {
+      n.flags = fc->getPredicate() | (fc->isIEEE() << 4);
+      numKids = 2;
+    } else if (const FUnaryExpr *fu = dyn_cast<FUnaryExpr>(e)) {
+      n.flags = fu->isIEEE();
+    } else if (const FOrd1Expr *fo = dyn_cast<FOrd1Expr>(e)) {
+      n.flags = fo->isIEEE();
+    } else if (const F2FConvertExpr *ff = dyn_cast<F2FConvertExpr>(e)) {
+      n.sem = ff->getSemantics();
+      n.flags = ff->fromIsIEEE();
+    } else if (const FConvertExpr *fc = dyn_cast<FConvertExpr>(e)) {
+      n.sem = fc->getSemantics();
+    } else if (const F2IConvertExpr *fi = dyn_cast<F2IConvertExpr>(e)) {
+      n.flags = fi->fromIsIEEE() | (fi->roundNearest() << 1);
+    } else if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e)) {
+      n.flags = ee->offset;
+    }
+    for (unsigned i = 0; i != numKids; ++i)
+      n.kids.push_back(add(e->getKid(i)));
+    res = addNode(n);
+  }
+
+  added.insert(std::make_pair(e, res));
+  return res;
+}
+
+/***/
+
+bool FPEGraph::hasConstant(ClassId c, const ref<ConstantExpr> &value) {
+  const std::vector<unsigned> &cn = classNodes[find(c)];
+  for (unsigned i = 0; i != cn.size(); ++i) {
+    const ENode &n = nodes[cn[i]];
+    if (n.kind != Expr::Constant || n.width != value->getWidth())
+      continue;
+    if (cast<ConstantExpr>(leafExprs[n.flags])->getAPValue() ==
+        value->getAPValue())
+      return true;
+  }
+  return false;
+}
+
+bool FPEGraph::isNegativeZero(ClassId c, Expr::Width w) {
+  return hasConstant(c, ConstantExpr::alloc(APInt::getSignedMinValue(w)));
+}
+
+bool FPEGraph::isOne(ClassId c, Expr::Width w) {
+  if (w == Expr::Int32)
+    return hasConstant(c, ConstantExpr::alloc(0x3F800000ULL, w));
+  if (w == Expr::Int64)
+    return hasConstant(c, ConstantExpr::alloc(0x3FF0000000000000ULL, w));
+  return false;
+}
+
+/// negate - Return the class of -c, expressed as (-0 - c), which is exact.
+FPEGraph::ClassId FPEGraph::negate(ClassId c, Expr::Width w,
+                                   unsigned isIEEE) {
+  ENode n(Expr::FSub, w, isIEEE);
+  n.kids.push_back(addLeaf(ConstantExpr::alloc(APInt::getSignedMinValue(w))));
+  n.kids.push_back(c);
+  return addNode(n);
+}
+
+void FPEGraph::applyRules(unsigned i) {
+  ENode n = nodes[i];
+  canonicalize(n);
+  ClassId c = find(nodeClass[i]);
+
+  switch (n.kind) {
+  case Expr::Add:
+  case Expr::Mul:
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor:
+  case Expr::Eq: {
+    ENode s(n);
+    std::swap(s.kids[0], s.kids[1]);
+    merge(c, addNode(s));
+    break;
+  }
+
+  case Expr::FAdd:
+  case Expr::FMul: {
+    // a op b == b op a
+    ENode s(n);
+    std::swap(s.kids[0], s.kids[1]);
+    merge(c, addNode(s));
+
+    // x + -0 == x, and x * 1 == x
+    if (n.kind == Expr::FAdd ? isNegativeZero(n.kids[1], n.width)
+                             : isOne(n.kids[1], n.width))
+      merge(c, n.kids[0]);
+
+    // -a * b == -(a * b)
+    if (n.kind == Expr::FMul) {
+      const std::vector<unsigned> kn = classNodes[find(n.kids[0])];
+      for (unsigned j = 0; j != kn.size(); ++j) {
+        const ENode m = nodes[kn[j]];
+        if (m.kind == Expr::FSub && m.flags == n.flags &&
+            isNegativeZero(m.kids[0], n.width)) {
+          ENode p(n);
+          p.kids[0] = m.kids[1];
+          merge(c, negate(addNode(p), n.width, n.flags));
+        }
+      }
+    }
+
+    if (!relaxed)
+      break;
+
+    // x + +0 == x, ignoring the sign of zero
+    if (n.kind == Expr::FAdd &&
+        hasConstant(n.kids[1], ConstantExpr::alloc(0, n.width)))
+      merge(c, n.kids[0]);
+
+    // (a op b) op c == a op (b op c)
+    const std::vector<unsigned> kn = classNodes[find(n.kids[0])];
+    for (unsigned j = 0; j != kn.size(); ++j) {
+      const ENode m = nodes[kn[j]];
+      if (m.kind != n.kind || m.flags != n.flags)
+        continue;
+      ENode inner(n);
+      inner.kids[0] = m.kids[1];
+      ENode outer(n);
+      outer.kids[0] = m.kids[0];
+      outer.kids[1] = addNode(inner);
+      merge(c, addNode(outer));
+    }
+
+    // a * (b + c) == a * b + a * c
+    if (n.kind == Expr::FMul) {
+      const std::vector<unsigned> rn = classNodes[find(n.kids[1])];
+      for (unsigned j = 0; j != rn.size(); ++j) {
+        const ENode m = nodes[rn[j]];
+        if (m.kind != Expr::FAdd || m.flags != n.flags)
+          continue;
+        ENode l(n), r(n);
+        l.kids[1] = m.kids[0];
+        r.kids[1] = m.kids[1];
+        ENode sum(m);
+        sum.kids[0] = addNode(l);
+        sum.kids[1] = addNode(r);
+        merge(c, addNode(sum));
+      }
+    }
+    break;
+  }
+
+  case Expr::FSub: {
+    if (!isNegativeZero(n.kids[0], n.width)) {
+      // a - b == a + -b
+      ENode s(Expr::FAdd, n.width, n.flags);
+      s.kids.push_back(n.kids[0]);
+      s.kids.push_back(negate(n.kids[1], n.width, n.flags));
+      merge(c, addNode(s));
+      break;
+    }
+
+    // -(-x) == x
+    const std::vector<unsigned> kn = classNodes[find(n.kids[1])];
+    for (unsigned j = 0; j != kn.size(); ++j) {
+      const ENode m = nodes[kn[j]];
+      if (m.kind == Expr::FSub && isNegativeZero(m.kids[0], n.width))
+        merge(c, m.kids[1]);
+    }
+    break;
+  }
+
+  case Expr::FDiv: {
+    // x / 1 == x
+    if (isOne(n.kids[1], n.width))
+      merge(c, n.kids[0]);
+
+    // -a / b == -(a / b) == a / -b
+    for (unsigned k = 0; k != 2; ++k) {
+      const std::vector<unsigned> kn = classNodes[find(n.kids[k])];
+      for (unsigned j = 0; j != kn.size(); ++j) {
+        const ENode m = nodes[kn[j]];
+        if (m.kind == Expr::FSub && m.flags == n.flags &&
+            isNegativeZero(m.kids[0], n.width)) {
+          ENode p(n);
+          p.kids[k] = m.kids[1];
+          merge(c, negate(addNode(p), n.width, n.flags));
+        }
+      }
+    }
+    break;
+  }
+
+  case Expr::FCmp: {
+    FCmpExpr::Predicate pred = (FCmpExpr::Predicate) (n.flags & 15);
+    unsigned ieee = n.flags & ~15U;
+
+    // a < b == b > a
+    ENode s(n);
+    std::swap(s.kids[0], s.kids[1]);
+    s.flags = FCmpExpr::getSwappedPredicate(pred) | ieee;
+    merge(c, addNode(s));
+
+    // Ordered and unordered forms only differ on NaNs.
+    if (relaxed && (pred & 7) != 0 && (pred & 7) != 7) {
+      ENode u(n);
+      u.flags = (pred ^ FCmpExpr::UNO) | ieee;
+      merge(c, addNode(u));
+    }
+    break;
+  }
+
+  case Expr::Not: {
+    const std::vector<unsigned> kn = classNodes[find(n.kids[0])];
+    for (unsigned j = 0; j != kn.size(); ++j) {
+      const ENode m = nodes[kn[j]];
+      if (m.kind == Expr::Not) {
+        // !!x == x
+        merge(c, m.kids[0]);
+      } else if (m.kind == Expr::FCmp) {
+        // !(a P b) == a !P b, where !P includes the unordered case
+        ENode inv(m);
+        inv.flags = m.flags ^ FCmpExpr::TRUE;
+        merge(c, addNode(inv));
+      }
+    }
+    break;
+  }
+
+  case Expr::Select: {
+    // c ? x : x == x
+    if (find(n.kids[1]) == find(n.kids[2]))
+      merge(c, n.kids[1]);
+
+    // c ? x : y == !c ? y : x
+    ENode notCond(Expr::Not, Expr::Bool);
+    notCond.kids.push_back(n.kids[0]);
+    ENode s(n);
+    s.kids[0] = addNode(notCond);
+    std::swap(s.kids[1], s.kids[2]);
+    merge(c, addNode(s));
+
+    if (!relaxed)
+      break;
+
+    // Min and max pick the same value on a tie, whichever way it is broken,
+    // ignoring the sign of zero.
+    const std::vector<unsigned> cn = classNodes[find(n.kids[0])];
+    for (unsigned j = 0; j != cn.size(); ++j) {
+      const ENode m = nodes[cn[j]];
+      if (m.kind != Expr::FCmp)
+        continue;
+      unsigned pred = m.flags & 15;
+      if (pred != FCmpExpr::OLT && pred != FCmpExpr::OLE &&
+          pred != FCmpExpr::OGT && pred != FCmpExpr::OGE)
+        continue;
+      ClassId a = find(m.kids[0]), b = find(m.kids[1]);
+      ClassId x = find(n.kids[1]), y = find(n.kids[2]);
+      if (!((a == x && b == y) || (a == y && b == x)))
+        continue;
+      ENode tie(m);
+      tie.flags = m.flags ^ FCmpExpr::OEQ;
+      ENode t(n);
+      t.kids[0] = addNode(tie);
+      merge(c, addNode(t));
+    }
+    break;
+  }
+
+  case Expr::FPExt:
+  case Expr::FPTrunc: {
+    const std::vector<unsigned> kn = classNodes[find(n.kids[0])];
+    for (unsigned j = 0; j != kn.size(); ++j) {
+      const ENode m = nodes[kn[j]];
+      if (m.kind != Expr::FPExt)
+        continue;
+      if (n.kind == Expr::FPExt) {
+        // Extending twice is exact, so it is the same as extending once.
+        ENode e(n);
+        e.kids[0] = m.kids[0];
+        e.flags = m.flags;
+        merge(c, addNode(e));
+      } else {
+        // Truncating an extended value back to its own format is exact.
+        // Formats are identified by width, so leave the ambiguous 128 bit
+        // formats alone.
+        ClassId x = find(m.kids[0]);
+        if (n.width != 128 && nodes[classNodes[x][0]].width == n.width)
+          merge(c, x);
+      }
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+bool FPEGraph::saturate(unsigned maxIterations) {
+  rebuild();
+  for (unsigned iteration = 0; iteration != maxIterations; ++iteration) {
+    unsigned before = version;
+    for (unsigned i = 0, e = nodes.size(); i != e; ++i) {
+      if (nodes.size() >= maxNodes)
+        break;
+      applyRules(i);
+    }
+    rebuild();
+    if (version == before)
+      return true;
+    if (nodes.size() >= maxNodes)
+      return false;
+  }
+  return false;
+}
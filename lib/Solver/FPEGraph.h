@@ -0,0 +1,110 @@
+//===-- FPEGraph.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FPEGRAPH_H
+#define KLEE_FPEGRAPH_H
+
+#include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <map>
+#include <vector>
+
+namespace llvm {
+  struct fltSemantics;
+}
+
+namespace klee {
+
+/// FPEGraph - An e-graph over expressions, used to decide equalities between
+/// floating point expressions by equality saturation.
+///
+/// Expressions are added to the graph, a fixed set of rewrite rules is
+/// applied until no rule adds anything new (or a size limit is reached), and
+/// two expressions are then known to be equal if they ended up in the same
+/// equivalence class. The default rules are sound under IEEE semantics
+/// (commutativity, negation, fpext/fptrunc round trips, select and fcmp
+/// forms); relaxed mode additionally applies reassociation, distribution and
+/// rules which ignore NaNs and signed zeros.
+class FPEGraph {
+public:
+  typedef unsigned ClassId;
+
+private:
+  /// ENode - An operator applied to equivalence classes. Expressions the
+  /// graph does not model are leaves, with no kids and the index of the
+  /// expression in \a leafExprs stored in \a flags.
+  struct ENode {
+    Expr::Kind kind;
+    Expr::Width width;
+    const llvm::fltSemantics *sem;
+    unsigned flags;
+    std::vector<ClassId> kids;
+
+    ENode(Expr::Kind _kind, Expr::Width _width, unsigned _flags = 0,
+          const llvm::fltSemantics *_sem = 0)
+      : kind(_kind), width(_width), sem(_sem), flags(_flags) {}
+
+    bool operator<(const ENode &b) const;
+  };
+
+  bool relaxed;
+  unsigned maxNodes;
+
+  std::vector<ENode> nodes;
+  /// The class each node was added to (not necessarily canonical).
+  std::vector<ClassId> nodeClass;
+  /// Union-find parents, indexed by class.
+  std::vector<ClassId> parent;
+  /// The nodes of each canonical class.
+  std::vector< std::vector<unsigned> > classNodes;
+  /// Hash-consing table from canonical nodes to node indices.
+  std::map<ENode, unsigned> memo;
+
+  std::vector< ref<Expr> > leafExprs;
+  ExprHashMap<unsigned> leafIndices;
+  ExprHashMap<ClassId> added;
+
+  /// Incremented whenever a node is created or two classes are merged, so
+  /// that saturation can tell when a round of rules changed nothing.
+  unsigned version;
+
+  void canonicalize(ENode &n);
+  ClassId addNode(ENode n);
+  ClassId addLeaf(const ref<Expr> &e);
+  bool merge(ClassId a, ClassId b);
+  void rebuild();
+
+  ClassId negate(ClassId c, Expr::Width w, unsigned isIEEE);
+  bool hasConstant(ClassId c, const ref<ConstantExpr> &value);
+  bool isNegativeZero(ClassId c, Expr::Width w);
+  bool isOne(ClassId c, Expr::Width w);
+
+  void applyRules(unsigned node);
+
+public:
+  FPEGraph(bool _relaxed, unsigned _maxNodes);
+
+  /// add - Add an expression to the graph and return its class.
+  ClassId add(const ref<Expr> &e);
+
+  /// saturate - Apply the rewrite rules until nothing changes, at most \a
+  /// maxIterations times. Returns true if the graph was saturated.
+  bool saturate(unsigned maxIterations);
+
+  ClassId find(ClassId c);
+
+  bool equivalent(ClassId a, ClassId b) { return find(a) == find(b); }
+
+  unsigned getNumNodes() const { return nodes.size(); }
+};
+
+}
+
+#endif
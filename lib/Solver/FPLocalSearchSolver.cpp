@@ -0,0 +1,497 @@
+//===-- FPLocalSearchSolver.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/Internal/ADT/RNG.h"
+
+#include "SolverStats.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cassert>
+#include <cmath>
+#include <set>
+#include <vector>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+  cl::opt<unsigned>
+  FPLocalSearchSteps("fp-local-search-steps",
+                     cl::desc("Number of candidate assignments the FP local "
+                              "search may evaluate per query (default=2000)"),
+                     cl::init(2000));
+
+  cl::opt<unsigned>
+  FPLocalSearchRestart("fp-local-search-restart",
+                       cl::desc("Restart the FP local search after this many "
+                                "steps without improvement (default=200)"),
+                       cl::init(200));
+}
+
+/***/
+
+/// isFPExprKind - Whether an expression of the given kind operates on
+/// floating point values.
+static bool isFPExprKind(Expr::Kind k) {
+  return (Expr::FConvertKindFirst <= k && k <= Expr::FConvertKindLast) ||
+         (Expr::F2IConvertKindFirst <= k && k <= Expr::F2IConvertKindLast) ||
+         (Expr::FUnaryKindFirst <= k && k <= Expr::FUnaryKindLast) ||
+         (Expr::FBinaryKindFirst <= k && k <= Expr::FBinaryKindLast) ||
+         k == Expr::FOrd1 || k == Expr::FCmp;
+}
+
+/// isFPWidth - Whether the search knows how to step a value of this width in
+/// ULPs.
+static bool isFPWidth(Expr::Width w) {
+  return w == Expr::Int32 || w == Expr::Int64;
+}
+
+static bool isNaN(uint64_t bits, Expr::Width w) {
+  if (w == Expr::Int32)
+    return (bits & 0x7F800000ULL) == 0x7F800000ULL && (bits & 0x007FFFFFULL);
+  return (bits & 0x7FF0000000000000ULL) == 0x7FF0000000000000ULL &&
+         (bits & 0x000FFFFFFFFFFFFFULL);
+}
+
+/// toOrdered - Map an IEEE bit pattern onto a signed integer such that
+/// adjacent floating point values are adjacent integers (+0 and -0 both map
+/// to 0).
+static int64_t toOrdered(uint64_t bits, Expr::Width w) {
+  uint64_t sign = 1ULL << (w - 1);
+  int64_t mag = (int64_t) (bits & (sign - 1));
+  return (bits & sign) ? -mag : mag;
+}
+
+/// stepULPs - Move an IEEE bit pattern \a delta ULPs, saturating at the
+/// infinities' neighbours rather than wrapping.
+static uint64_t stepULPs(uint64_t bits, int64_t delta, Expr::Width w) {
+  int64_t max = (int64_t) ((1ULL << (w - 1)) - 1);
+  int64_t ord = toOrdered(bits, w);
+  if (delta > 0)
+    ord = ord > max - delta ? max : ord + delta;
+  else
+    ord = ord < -max - delta ? -max : ord + delta;
+  return ord < 0 ? ((1ULL << (w - 1)) | (uint64_t) -ord) : (uint64_t) ord;
+}
+
+/***/
+
+namespace {
+
+/// FPSearchContext - The per-query state of a local search: the symbolic
+/// objects being searched over and the widths and constants which appear as
+/// floating point operands, which guide mutation.
+struct FPSearchContext {
+  std::vector<const Array*> objects;
+  std::set<Expr::Width> fpWidths;
+  std::vector< ref<ConstantExpr> > constants;
+  bool hasFP;
+
+  FPSearchContext() : hasFP(false) {}
+
+  void scan(const ref<Expr> &e, ExprHashSet &visited);
+};
+
+}
+
+void FPSearchContext::scan(const ref<Expr> &e, ExprHashSet &visited) {
+  if (!visited.insert(e).second)
+    return;
+
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    if (isFPWidth(CE->getWidth()))
+      constants.push_back(CE);
+    return;
+  }
+
+  if (isFPExprKind(e->getKind())) {
+    hasFP = true;
+    // The operand of an integer to FP conversion is an integer; only its
+    // result is a floating point value.
+    Expr::Kind k = e->getKind();
+    Expr::Width w = (k == Expr::UIToFP || k == Expr::SIToFP) ?
+      e->getWidth() : e->getKid(0)->getWidth();
+    if (isFPWidth(w))
+      fpWidths.insert(w);
+  }
+
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+      scan(un->index, visited);
+      scan(un->value, visited);
+    }
+  }
+
+  for (unsigned i = 0, N = e->getNumKids(); i != N; ++i)
+    scan(e->getKid(i), visited);
+}
+
+/***/
+
+/// FPLocalSearchSolver - An incomplete solver which looks for satisfying
+/// assignments by evaluating candidate inputs concretely, hill climbing on a
+/// branch distance which measures FP comparisons in ULPs.
+///
+/// The solver can only ever find models, so it never claims validity; when
+/// the search gives up the query falls through to the secondary solver.
+class FPLocalSearchSolver : public IncompleteSolver {
+  RNG rng;
+
+  /// distance - Return how far the current assignment is from making \a e
+  /// evaluate to \a wanted, or 0 if it already does.
+  double distance(AssignmentEvaluator &ev, const ref<Expr> &e, bool wanted);
+  double cost(Assignment &a, const std::vector< ref<Expr> > &constraints);
+
+  void mutate(Assignment &a, const FPSearchContext &ctx);
+
+  /// search - Look for an assignment to the objects of \a ctx which satisfies
+  /// every expression in \a constraints.
+  bool search(const std::vector< ref<Expr> > &constraints,
+              const FPSearchContext &ctx, Assignment &result);
+
+  /// findModel - Search for an assignment satisfying the constraints of \a
+  /// query and, if \a negateExpr is set, the negation of its expression.
+  bool findModel(const Query &query, bool negateExpr, Assignment &result);
+
+public:
+  FPLocalSearchSolver() {}
+  ~FPLocalSearchSolver() {}
+
+  IncompleteSolver::PartialValidity computeTruth(const Query&);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+};
+
+/// Distance charged when a comparison needs a NaN operand to flip, or can
+/// never flip at all. Stepping through ULPs will not help there, so these are
+/// only reached through the random mutations.
+static const double NaNDistance = 4294967296.0;
+
+static double intDistance(const ref<ConstantExpr> &a,
+                          const ref<ConstantExpr> &b, bool isSigned) {
+  if (a->getWidth() > 64)
+    return 1;
+  if (isSigned) {
+    int64_t x = a->getAPValue().getSExtValue(), y = b->getAPValue().getSExtValue();
+    return std::fabs((double) x - (double) y);
+  }
+  return std::fabs((double) a->getZExtValue() - (double) b->getZExtValue());
+}
+
+double FPLocalSearchSolver::distance(AssignmentEvaluator &ev,
+                                     const ref<Expr> &e, bool wanted) {
+  ref<Expr> value = ev.visit(e);
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(value);
+  if (!CE)
+    return 1;
+  if (CE->isTrue() == wanted)
+    return 0;
+
+  switch (e->getKind()) {
+  case Expr::And:
+  case Expr::Or: {
+    if (e->getWidth() != Expr::Bool)
+      break;
+    double l = distance(ev, e->getKid(0), wanted);
+    double r = distance(ev, e->getKid(1), wanted);
+    // A true And (or a false Or) needs both sides, otherwise either will do.
+    if ((e->getKind() == Expr::And) == wanted)
+      return l + r;
+    return std::min(l, r);
+  }
+
+  case Expr::Not:
+    if (e->getWidth() == Expr::Bool)
+      return distance(ev, e->getKid(0), !wanted);
+    break;
+
+  case Expr::Eq: {
+    ref<Expr> neg;
+    if (e->isNotExpr(neg))
+      return distance(ev, neg, !wanted);
+    if (e->getKid(0)->getWidth() == Expr::Bool)
+      break;
+    if (!wanted)
+      return 1;
+    ref<ConstantExpr> l = dyn_cast<ConstantExpr>(ev.visit(e->getKid(0)));
+    ref<ConstantExpr> r = dyn_cast<ConstantExpr>(ev.visit(e->getKid(1)));
+    if (l.isNull() || r.isNull())
+      break;
+    return intDistance(l, r, false);
+  }
+
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Slt:
+  case Expr::Sle: {
+    ref<ConstantExpr> l = dyn_cast<ConstantExpr>(ev.visit(e->getKid(0)));
+    ref<ConstantExpr> r = dyn_cast<ConstantExpr>(ev.visit(e->getKid(1)));
+    if (l.isNull() || r.isNull())
+      break;
+    bool isStrict = e->getKind() == Expr::Ult || e->getKind() == Expr::Slt;
+    bool isSigned = e->getKind() == Expr::Slt || e->getKind() == Expr::Sle;
+    // Making a strict comparison true, or a non-strict one false, needs one
+    // more step than closing the gap.
+    return intDistance(l, r, isSigned) + (isStrict == wanted ? 1 : 0);
+  }
+
+  case Expr::FCmp: {
+    const FCmpExpr *fe = cast<FCmpExpr>(e);
+    ref<ConstantExpr> l = dyn_cast<ConstantExpr>(ev.visit(fe->getKid(0)));
+    ref<ConstantExpr> r = dyn_cast<ConstantExpr>(ev.visit(fe->getKid(1)));
+    Expr::Width w = fe->getKid(0)->getWidth();
+    if (l.isNull() || r.isNull() || !isFPWidth(w))
+      break;
+
+    // Falsifying a predicate is satisfying its inverse.
+    FCmpExpr::Predicate pred = fe->getPredicate();
+    if (!wanted)
+      pred = (FCmpExpr::Predicate) (pred ^ FCmpExpr::TRUE);
+
+    uint64_t lb = l->getZExtValue(), rb = r->getZExtValue();
+    if (pred == FCmpExpr::FALSE || pred == FCmpExpr::UNO ||
+        isNaN(lb, w) || isNaN(rb, w))
+      return NaNDistance;
+
+    double ulps = std::fabs((double) toOrdered(lb, w) -
+                            (double) toOrdered(rb, w));
+    switch (pred) {
+    case FCmpExpr::OEQ: case FCmpExpr::UEQ:
+    case FCmpExpr::OGE: case FCmpExpr::UGE:
+    case FCmpExpr::OLE: case FCmpExpr::ULE:
+      return ulps;
+    default:
+      return ulps + 1;
+    }
+  }
+
+  default:
+    break;
+  }
+
+  return 1;
+}
+
+/// cost - Sum the branch distances of all constraints. Distances are compared
+/// on a log scale, so that a gap of 2^60 ULPs still has a gradient and a
+/// single far-off constraint cannot drown out progress on the others.
+double FPLocalSearchSolver::cost(Assignment &a,
+                                 const std::vector< ref<Expr> > &constraints) {
+  AssignmentEvaluator ev(a);
+  double total = 0;
+  for (std::vector< ref<Expr> >::const_iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it)
+    total += std::log(1 + distance(ev, *it, true));
+  return total;
+}
+
+static uint64_t readWord(const std::vector<unsigned char> &bytes,
+                         unsigned offset, unsigned numBytes) {
+  uint64_t v = 0;
+  for (unsigned i = 0; i != numBytes; ++i)
+    v |= (uint64_t) bytes[offset + i] << (8 * i);
+  return v;
+}
+
+static void writeWord(std::vector<unsigned char> &bytes,
+                      unsigned offset, unsigned numBytes, uint64_t v) {
+  for (unsigned i = 0; i != numBytes; ++i)
+    bytes[offset + i] = (unsigned char) (v >> (8 * i));
+}
+
+void FPLocalSearchSolver::mutate(Assignment &a, const FPSearchContext &ctx) {
+  const Array *array = ctx.objects[rng.getInt32() % ctx.objects.size()];
+  std::vector<unsigned char> &bytes = a.bindings[array];
+  if (bytes.empty())
+    return;
+
+  // Prefer mutating whole floating point words when the query has any that
+  // fit in this object, assuming they are stored naturally aligned.
+  Expr::Width w = Expr::Int8;
+  if (!ctx.fpWidths.empty() && rng.getInt32() % 4) {
+    std::set<Expr::Width>::const_iterator it = ctx.fpWidths.begin();
+    std::advance(it, rng.getInt32() % ctx.fpWidths.size());
+    if (*it / 8 <= bytes.size())
+      w = *it;
+  }
+
+  unsigned numBytes = w / 8;
+  unsigned offset = (rng.getInt32() % (bytes.size() / numBytes)) * numBytes;
+  uint64_t v = readWord(bytes, offset, numBytes);
+
+  if (w == Expr::Int8) {
+    if (rng.getBool())
+      v = rng.getInt32();
+    else
+      v += rng.getBool() ? 1 : -1;
+    writeWord(bytes, offset, numBytes, v);
+    return;
+  }
+
+  switch (rng.getInt32() % 8) {
+  case 0:
+    // Random bits.
+    v = ((uint64_t) rng.getInt32() << 32) | rng.getInt32();
+    break;
+  case 1:
+    // Flip the sign.
+    v ^= 1ULL << (w - 1);
+    break;
+  case 2: {
+    // Take a constant from the query, nudged by at most one ULP.
+    std::vector<ref<ConstantExpr> > matching;
+    for (unsigned i = 0; i != ctx.constants.size(); ++i)
+      if (ctx.constants[i]->getWidth() == w)
+        matching.push_back(ctx.constants[i]);
+    if (!matching.empty()) {
+      v = matching[rng.getInt32() % matching.size()]->getZExtValue();
+      v = stepULPs(v, (int) (rng.getInt32() % 3) - 1, w);
+      break;
+    }
+  } // fall through
+  default: {
+    // Step by a random power of two ULPs, so that both far and near
+    // neighbours get explored.
+    int64_t step = 1LL << (rng.getInt32() % (w - 2));
+    v = stepULPs(v, rng.getBool() ? step : -step, w);
+    break;
+  }
+  }
+
+  writeWord(bytes, offset, numBytes, v);
+}
+
+bool FPLocalSearchSolver::search(const std::vector< ref<Expr> > &constraints,
+                                 const FPSearchContext &ctx,
+                                 Assignment &result) {
+  TimerStatIncrementer t(stats::fpLocalSearchTime);
+
+  Assignment current;
+  for (unsigned i = 0; i != ctx.objects.size(); ++i)
+    current.bindings[ctx.objects[i]] =
+      std::vector<unsigned char>(ctx.objects[i]->size, 0);
+
+  double currentCost = cost(current, constraints);
+  unsigned sinceImprovement = 0;
+  for (unsigned step = 0; currentCost != 0 && step != FPLocalSearchSteps;
+       ++step) {
+    if (sinceImprovement == FPLocalSearchRestart) {
+      for (Assignment::bindings_ty::iterator it = current.bindings.begin(),
+             ie = current.bindings.end(); it != ie; ++it)
+        for (unsigned i = 0; i != it->second.size(); ++i)
+          it->second[i] = (unsigned char) rng.getInt32();
+      currentCost = cost(current, constraints);
+      sinceImprovement = 0;
+      continue;
+    }
+
+    Assignment candidate(current);
+    mutate(candidate, ctx);
+    double candidateCost = cost(candidate, constraints);
+
+    // Accept sideways moves as well, to walk across plateaus.
+    if (candidateCost <= currentCost) {
+      sinceImprovement = candidateCost < currentCost ? 0 : sinceImprovement + 1;
+      current.bindings.swap(candidate.bindings);
+      currentCost = candidateCost;
+    } else {
+      ++sinceImprovement;
+    }
+  }
+
+  if (currentCost != 0)
+    return false;
+
+  ++stats::fpLocalSearchHits;
+  result.bindings.swap(current.bindings);
+  return true;
+}
+
+bool FPLocalSearchSolver::findModel(const Query &query, bool negateExpr,
+                                    Assignment &result) {
+  std::vector< ref<Expr> > constraints(query.constraints.begin(),
+                                       query.constraints.end());
+  if (negateExpr)
+    constraints.push_back(Expr::createIsZero(query.expr));
+
+  FPSearchContext ctx;
+  ExprHashSet visited;
+  for (unsigned i = 0; i != constraints.size(); ++i)
+    ctx.scan(constraints[i], visited);
+
+  // Integer-only queries are better served by the exact solver.
+  if (!ctx.hasFP)
+    return false;
+
+  findSymbolicObjects(constraints.begin(), constraints.end(), ctx.objects);
+  if (ctx.objects.empty())
+    return false;
+
+  return search(constraints, ctx, result);
+}
+
+IncompleteSolver::PartialValidity
+FPLocalSearchSolver::computeTruth(const Query& query) {
+  Assignment a;
+  if (findModel(query, true, a))
+    return IncompleteSolver::MayBeFalse;
+
+  return IncompleteSolver::None;
+}
+
+bool FPLocalSearchSolver::computeValue(const Query& query, ref<Expr> &result) {
+  Assignment a;
+  if (!findModel(query, false, a))
+    return false;
+
+  result = a.evaluate(query.expr);
+  return isa<ConstantExpr>(result);
+}
+
+bool
+FPLocalSearchSolver::computeInitialValues(const Query& query,
+                                          const std::vector<const Array*>
+                                            &objects,
+                                          std::vector< std::vector<unsigned char> >
+                                            &values,
+                                          bool &hasSolution) {
+  Assignment a;
+  if (!findModel(query, true, a))
+    return false;
+
+  // Objects which do not appear in the query are unconstrained.
+  for (unsigned i = 0; i != objects.size(); ++i) {
+    Assignment::bindings_ty::iterator it = a.bindings.find(objects[i]);
+    if (it != a.bindings.end())
+      values.push_back(it->second);
+    else
+      values.push_back(std::vector<unsigned char>(objects[i]->size, 0));
+  }
+  hasSolution = true;
+  return true;
+}
+
+/***/
+
+Solver *klee::createFPLocalSearchSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new FPLocalSearchSolver(), s));
+}
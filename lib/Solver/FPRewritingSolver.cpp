@@ -11,10 +11,14 @@
 
 #include "klee/Expr.h"
 #include "klee/Constraints.h"
+#include "klee/ExprContext.h"
 #include "klee/SolverImpl.h"
 
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprUtil.h"
 
+#include "FPEGraph.h"
+
 #include "llvm/Support/CommandLine.h"
 
 #include <map>
@@ -30,19 +34,68 @@ namespace {
   AssumeOrdered("assume-ordered", 
                    llvm::cl::desc("Assume all operands to floating point expressions are ordered"),
                    llvm::cl::init(false));
+
+  cl::opt<bool>
+  UseFPEGraph("fp-egraph",
+              cl::desc("Decide FP equalities in the FP rewriter by equality "
+                       "saturation (default=on)"),
+              cl::init(true));
+
+  cl::opt<bool>
+  FPEGraphRelaxed("fp-egraph-relaxed",
+                  cl::desc("Also use rewrites which are not exact under IEEE "
+                           "semantics (reassociation, distribution, ignoring "
+                           "NaNs and signed zeros)"),
+                  cl::init(false));
+
+  cl::opt<unsigned>
+  FPEGraphMaxNodes("fp-egraph-max-nodes",
+                   cl::desc("Stop saturating an FP e-graph once it has this "
+                            "many nodes (default=5000)"),
+                   cl::init(5000));
+
+  cl::opt<unsigned>
+  FPEGraphMaxIterations("fp-egraph-max-iterations",
+                        cl::desc("Maximum rounds of rewriting per FP e-graph "
+                                 "(default=8)"),
+                        cl::init(8));
 }
 
 
-class FPRewritingSolver : public SolverImpl {
+class FPRewritingSolver : public SolverImpl, public ExprCache {
 private:
   Solver *solver;
 
+  /// Path constraints change little from one query to the next, so the
+  /// rewrites are memoized across queries until the ExprContext clears its
+  /// caches: rewrittenCache maps a constraint to its rewritten form,
+  /// fusedCache maps a pair of constraints to the result of fuseConstraints
+  /// and fpCache records whether an expression contains FP operations.
+  ExprHashMap< ref<Expr> > rewrittenCache;
+  ExprHashMap< ExprHashMap< ref<Expr> > > fusedCache;
+  ExprHashMap<bool> fpCache;
+
+  bool HasFPExpr(const ref<Expr> &e);
+  ref<Expr> getFusedConstraints(const ref<Expr> &e1, const ref<Expr> &e2);
+
 public:
   FPRewritingSolver(Solver *_solver) 
-    : solver(_solver) {}
-  ~FPRewritingSolver() { delete solver; }
+    : solver(_solver) {
+    ExprContext::get().registerCache(this);
+  }
+  ~FPRewritingSolver() {
+    ExprContext::get().unregisterCache(this);
+    delete solver;
+  }
+
+  void clear() {
+    rewrittenCache.clear();
+    fusedCache.clear();
+    fpCache.clear();
+  }
 
   ref<Expr> constrainEquality(ref<Expr> lhs, ref<Expr> rhs, bool isUnordered = false);
+  ref<Expr> equalityCondition(ref<Expr> lhs, ref<Expr> rhs, bool isUnordered = false);
 
   ref<Expr> fuseConstraints(const ref<Expr> &e1, const ref<Expr> &e2);
 
@@ -257,25 +310,51 @@ ref<Expr> FPRewritingSolver::constrainEquality(ref<Expr> lhs, ref<Expr> rhs, boo
   return ConstantExpr::alloc(lhs->compare(*rhs) == 0 ? 1 : 0, Expr::Bool);
 }
 
-bool HasFPExpr(ref<Expr> e) {
+/* Like constrainEquality, but first tries to prove lhs and rhs equal by
+ * equality saturation, which finds equalities needing several rewrites that
+ * the structural matching in constrainEquality misses.
+ */
+ref<Expr> FPRewritingSolver::equalityCondition(ref<Expr> lhs, ref<Expr> rhs, bool isUnordered) {
+  if (UseFPEGraph && lhs != rhs && lhs->getWidth() == rhs->getWidth()
+      && HasFPExpr(lhs) && HasFPExpr(rhs)) {
+    FPEGraph eg(FPEGraphRelaxed, FPEGraphMaxNodes);
+    FPEGraph::ClassId l = eg.add(lhs), r = eg.add(rhs);
+    eg.saturate(FPEGraphMaxIterations);
+    if (eg.equivalent(l, r))
+      return ConstantExpr::alloc(1, Expr::Bool);
+  }
+  return constrainEquality(lhs, rhs, isUnordered);
+}
+
+bool FPRewritingSolver::HasFPExpr(const ref<Expr> &e) {
   if (isa<F2IConvertExpr>(e))
     return false;
   if (isa<FConvertExpr>(e)
    || isa<FOrd1Expr>(e)
    || isa<FBinaryExpr>(e)
    || isa<FCmpExpr>(e)) return true;
+  if (isa<ConstantExpr>(e))
+    return false;
+
+  ExprHashMap<bool>::iterator it = fpCache.find(e);
+  if (it != fpCache.end())
+    return it->second;
+
+  bool res = false;
   unsigned int numKids = e->getNumKids();
-  for (unsigned int k = 0; k < numKids; k++) {
+  for (unsigned int k = 0; k < numKids && !res; k++) {
     if (HasFPExpr(e->getKid(k)))
-      return true;
+      res = true;
   }
   if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
-    for (const UpdateNode *node = re->updates.head; node; node = node->next) {
+    for (const UpdateNode *node = re->updates.head; node && !res;
+         node = node->next) {
       if (HasFPExpr(node->index) || HasFPExpr(node->value))
-        return true;
+        res = true;
     }
   }
-  return false;
+  fpCache.insert(std::make_pair(e, res));
+  return res;
 }
 
 ref<Expr> FPRewritingSolver::_rewriteConstraint(const ref<Expr> &e, bool isNeg) {
@@ -283,9 +362,9 @@ ref<Expr> FPRewritingSolver::_rewriteConstraint(const ref<Expr> &e, bool isNeg)
     case Expr::FCmp:
       switch (cast<FCmpExpr>(e)->getPredicate()) {
         case FCmpExpr::UEQ:
-          return constrainEquality(e->getKid(0), e->getKid(1), true);
+          return equalityCondition(e->getKid(0), e->getKid(1), true);
         case FCmpExpr::ONE:
-          return Expr::createIsZero(constrainEquality(e->getKid(0), e->getKid(1), true));
+          return Expr::createIsZero(equalityCondition(e->getKid(0), e->getKid(1), true));
         default: break;
       }
       break;
@@ -298,7 +377,7 @@ ref<Expr> FPRewritingSolver::_rewriteConstraint(const ref<Expr> &e, bool isNeg)
       if (e->isNotExpr(neg))
         return Expr::createIsZero(_rewriteConstraint(neg, !isNeg));
       if (HasFPExpr(e))
-        return constrainEquality(e->getKid(0), e->getKid(1));
+        return equalityCondition(e->getKid(0), e->getKid(1));
       break;
     }
     default: break;
@@ -309,6 +388,10 @@ ref<Expr> FPRewritingSolver::_rewriteConstraint(const ref<Expr> &e, bool isNeg)
 }
 
 ref<Expr> FPRewritingSolver::rewriteConstraint(const ref<Expr> &e) {
+  ExprHashMap< ref<Expr> >::iterator it = rewrittenCache.find(e);
+  if (it != rewrittenCache.end())
+    return it->second;
+
 #ifdef DEBUG_FPRS
   std::cerr << "C+ Input constraint: ";
   e->dump();
@@ -318,19 +401,32 @@ ref<Expr> FPRewritingSolver::rewriteConstraint(const ref<Expr> &e) {
   std::cerr << "C+ Output constraint: ";
   ep->dump();
 #endif
+  rewrittenCache.insert(std::make_pair(e, ep));
   return ep;
 }
 
 ref<Expr> FPRewritingSolver::fuseConstraints(const ref<Expr> &e1, const ref<Expr> &e2) {
-  return Expr::createIsZero(constrainEquality(Expr::createIsZero(e1), e2));
+  return Expr::createIsZero(equalityCondition(Expr::createIsZero(e1), e2));
+}
+
+ref<Expr> FPRewritingSolver::getFusedConstraints(const ref<Expr> &e1,
+                                                 const ref<Expr> &e2) {
+  ExprHashMap< ref<Expr> > &fused = fusedCache[e1];
+  ExprHashMap< ref<Expr> >::iterator it = fused.find(e2);
+  if (it != fused.end())
+    return it->second;
+
+  ref<Expr> res = fuseConstraints(e1, e2);
+  fused.insert(std::make_pair(e2, res));
+  return res;
 }
 
 Query FPRewritingSolver::rewriteConstraints(const Query &q) {
   ref<Expr> notExpr = Expr::createIsZero(q.expr);
 
-  for (std::vector< ref<Expr> >::const_iterator i  = q.constraints.begin();
-                                                i != q.constraints.end();
-                                              ++i) {
+  for (ConstraintManager::const_iterator i  = q.constraints.begin();
+                                         i != q.constraints.end();
+                                       ++i) {
        ref<Expr> andExp = AndExpr::create(*i, notExpr);
        if (ConstantExpr *andConst = dyn_cast<ConstantExpr>(andExp))
          if (andConst->getZExtValue() == 0)
@@ -346,7 +442,7 @@ Query FPRewritingSolver::rewriteConstraints(const Query &q) {
     std::vector< ref<Expr> >::iterator j = i; ++j;
     for (;j != constraints.end();
         ++j) {
-      newConstraint = AndExpr::create(newConstraint, fuseConstraints(*i, *j));
+      newConstraint = AndExpr::create(newConstraint, getFusedConstraints(*i, *j));
     }
 #ifdef DEBUG_FPRS
     std::cerr << "C+ FINAL constraint: ";
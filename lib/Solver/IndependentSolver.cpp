@@ -52,6 +52,10 @@ public:
     return modified;
   }
 
+  bool contains(T x) const {
+    return s.count(x);
+  }
+
   bool intersects(const DenseSet &b) {
     for (typename set_ty::iterator it = s.begin(), ie = s.end(); 
          it != ie; ++it)
@@ -155,6 +159,27 @@ public:
     os << "}";
   }
 
+  /// mentions - Whether any byte of \a array is in the set.
+  bool mentions(const Array *array) const {
+    return wholeObjects.count(array) || elements.count(array);
+  }
+
+  /// copySolution - Copy the bytes of \a array which are in the set from
+  /// \a from to \a to.
+  void copySolution(const Array *array, const std::vector<unsigned char> &from,
+                    std::vector<unsigned char> &to) const {
+    if (wholeObjects.count(array)) {
+      to = from;
+      return;
+    }
+    elements_ty::const_iterator it = elements.find(array);
+    if (it == elements.end())
+      return;
+    for (unsigned i = 0; i != from.size() && i != to.size(); ++i)
+      if (it->second.contains(i))
+        to[i] = from[i];
+  }
+
   // more efficient when this is the smaller set
   bool intersects(const IndependentElementSet &b) {
     for (std::set<const Array*>::iterator it = wholeObjects.begin(), 
@@ -219,50 +244,40 @@ inline std::ostream &operator<<(std::ostream &os, const IndependentElementSet &i
   return os;
 }
 
-static 
-IndependentElementSet getIndependentConstraints(const Query& query,
-                                                std::vector< ref<Expr> > &result) {
-  IndependentElementSet eltsClosure(query.expr);
-  std::vector< std::pair<ref<Expr>, IndependentElementSet> > worklist;
-
-  for (ConstraintManager::const_iterator it = query.constraints.begin(), 
-         ie = query.constraints.end(); it != ie; ++it)
-    worklist.push_back(std::make_pair(*it, IndependentElementSet(*it)));
-
-  // XXX This should be more efficient (in terms of low level copy stuff).
-  bool done = false;
-  do {
-    done = true;
-    std::vector< std::pair<ref<Expr>, IndependentElementSet> > newWorklist;
-    for (std::vector< std::pair<ref<Expr>, IndependentElementSet> >::iterator
-           it = worklist.begin(), ie = worklist.end(); it != ie; ++it) {
-      if (it->second.intersects(eltsClosure)) {
-        if (eltsClosure.add(it->second))
-          done = false;
-        result.push_back(it->first);
-      } else {
-        newWorklist.push_back(*it);
+typedef std::pair< IndependentElementSet, std::vector< ref<Expr> > >
+  IndependentFactor;
+
+/// getIndependentFactors - Partition \a constraints into factors which
+/// share no array bytes.
+static void
+getIndependentFactors(const std::vector< ref<Expr> > &constraints,
+                      std::vector<IndependentFactor> &factors) {
+  for (unsigned i = 0; i != constraints.size(); ++i) {
+    IndependentFactor f(IndependentElementSet(constraints[i]),
+                        std::vector< ref<Expr> >(1, constraints[i]));
+
+    // Absorb every factor the new one overlaps. As it grows it may come to
+    // overlap factors it was already checked against, so repeat until it
+    // stops growing.
+    bool merged;
+    do {
+      merged = false;
+      for (unsigned j = 0; j != factors.size();) {
+        if (f.first.intersects(factors[j].first)) {
+          f.first.add(factors[j].first);
+          f.second.insert(f.second.end(), factors[j].second.begin(),
+                          factors[j].second.end());
+          factors[j] = factors.back();
+          factors.pop_back();
+          merged = true;
+        } else {
+          ++j;
+        }
       }
-    }
-    worklist.swap(newWorklist);
-  } while (!done);
-
-  if (0) {
-    std::set< ref<Expr> > reqset(result.begin(), result.end());
-    std::cerr << "--\n";
-    std::cerr << "Q: " << query.expr << "\n";
-    std::cerr << "\telts: " << IndependentElementSet(query.expr) << "\n";
-    int i = 0;
-  for (ConstraintManager::const_iterator it = query.constraints.begin(), 
-         ie = query.constraints.end(); it != ie; ++it) {
-      std::cerr << "C" << i++ << ": " << *it;
-      std::cerr << " " << (reqset.count(*it) ? "(required)" : "(independent)") << "\n";
-      std::cerr << "\telts: " << IndependentElementSet(*it) << "\n";
-    }
-    std::cerr << "elts closure: " << eltsClosure << "\n";
-  }
+    } while (merged);
 
-  return eltsClosure;
+    factors.push_back(f);
+  }
 }
 
 class IndependentSolver : public SolverImpl {
@@ -280,18 +295,14 @@ public:
   bool computeInitialValues(const Query& query,
                             const std::vector<const Array*> &objects,
                             std::vector< std::vector<unsigned char> > &values,
-                            bool &hasSolution) {
-    return solver->impl->computeInitialValues(query, objects, values,
-                                              hasSolution);
-  }
+                            bool &hasSolution);
   SolverRunStatus getOperationStatusCode();
 };
   
 bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+  query.constraints.getIndependentConstraints(query.expr, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), 
                                        result);
@@ -299,8 +310,7 @@ bool IndependentSolver::computeValidity(const Query& query,
 
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  query.constraints.getIndependentConstraints(query.expr, required);
   ConstraintManager tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), 
                                     isValid);
@@ -308,12 +318,72 @@ bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
 
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  query.constraints.getIndependentConstraints(query.expr, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
 
+/// computeInitialValues - Solve each independent factor of the query on its
+/// own and merge the solutions, so the underlying solver sees smaller
+/// queries which are more likely to be cached.
+bool IndependentSolver::computeInitialValues(const Query& query,
+                                             const std::vector<const Array*>
+                                               &objects,
+                                             std::vector< std::vector<unsigned char> >
+                                               &values,
+                                             bool &hasSolution) {
+  std::vector< ref<Expr> > constraints(query.constraints.begin(),
+                                       query.constraints.end());
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr)) {
+    if (CE->isTrue())
+      return solver->impl->computeInitialValues(query, objects, values,
+                                                hasSolution);
+  } else {
+    constraints.push_back(Expr::createIsZero(query.expr));
+  }
+
+  std::vector<IndependentFactor> factors;
+  getIndependentFactors(constraints, factors);
+
+  // Bytes no factor mentions are unconstrained.
+  std::vector< std::vector<unsigned char> > result(objects.size());
+  for (unsigned i = 0; i != objects.size(); ++i) {
+    const Array *array = objects[i];
+    result[i].resize(array->size, 0);
+    for (unsigned j = 0; j != array->constantValues.size(); ++j)
+      result[i][j] = array->constantValues[j]->getZExtValue(8);
+  }
+
+  for (unsigned i = 0; i != factors.size(); ++i) {
+    const IndependentFactor &f = factors[i];
+    std::vector<const Array*> factorObjects;
+    std::vector<unsigned> factorIndices;
+    for (unsigned j = 0; j != objects.size(); ++j) {
+      if (f.first.mentions(objects[j])) {
+        factorObjects.push_back(objects[j]);
+        factorIndices.push_back(j);
+      }
+    }
+
+    ConstraintManager tmp(f.second);
+    Query factorQuery(tmp, ConstantExpr::alloc(0, Expr::Bool));
+    std::vector< std::vector<unsigned char> > factorValues;
+    if (!solver->impl->computeInitialValues(factorQuery, factorObjects,
+                                            factorValues, hasSolution))
+      return false;
+    if (!hasSolution)
+      return true;
+
+    for (unsigned j = 0; j != factorObjects.size(); ++j)
+      f.first.copySolution(factorObjects[j], factorValues[j],
+                           result[factorIndices[j]]);
+  }
+
+  hasSolution = true;
+  values.swap(result);
+  return true;
+}
+
 SolverImpl::SolverRunStatus IndependentSolver::getOperationStatusCode() {
   return solver->impl->getOperationStatusCode();      
 }
@@ -0,0 +1,298 @@
+//===-- ModelSamplingSolver.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprBytecode.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/Internal/ADT/RNG.h"
+
+#include "SolverStats.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <deque>
+#include <vector>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+  cl::opt<unsigned>
+  ModelSamplingCandidates("model-sampling-candidates",
+                          cl::desc("Number of candidate assignments the model "
+                                   "sampling may try per query (default=256)"),
+                          cl::init(256));
+
+  cl::opt<unsigned>
+  ModelSamplingSeeds("model-sampling-seeds",
+                     cl::desc("Number of recent models kept as seeds for "
+                              "model sampling (default=16)"),
+                     cl::init(16));
+}
+
+/***/
+
+namespace {
+
+/// SamplingContext - The per-query state of the sampling: the objects to
+/// assign, and the constants of the query, which are likely values for its
+/// inputs.
+struct SamplingContext {
+  std::vector<const Array*> objects;
+  /// The constants of 1, 2, 4 and 8 bytes, by log2 of their size.
+  std::vector<uint64_t> constants[4];
+
+  void scan(const ref<Expr> &e, ExprHashSet &visited);
+};
+
+}
+
+void SamplingContext::scan(const ref<Expr> &e, ExprHashSet &visited) {
+  if (!visited.insert(e).second)
+    return;
+
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    switch (CE->getWidth()) {
+    case Expr::Int8: constants[0].push_back(CE->getZExtValue()); break;
+    case Expr::Int16: constants[1].push_back(CE->getZExtValue()); break;
+    case Expr::Int32: constants[2].push_back(CE->getZExtValue()); break;
+    case Expr::Int64: constants[3].push_back(CE->getZExtValue()); break;
+    default: break;
+    }
+    return;
+  }
+
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+      scan(un->index, visited);
+      scan(un->value, visited);
+    }
+  }
+
+  for (unsigned i = 0, N = e->getNumKids(); i != N; ++i)
+    scan(e->getKid(i), visited);
+}
+
+/***/
+
+/// ModelSamplingSolver - An incomplete solver which looks for satisfying
+/// assignments by compiling the constraints of a query once (see
+/// ExprBytecode) and checking many concrete candidates against them: the
+/// all zero assignment, recent models, random bytes, and mutations of
+/// these which plant the constants of the query.
+///
+/// Like FPLocalSearchSolver it can only find models, and passes the
+/// queries it does not satisfy to the underlying solver. It does no hill
+/// climbing, so each candidate costs a single run of the program; it is
+/// meant for the many easy satisfiable queries.
+class ModelSamplingSolver : public IncompleteSolver {
+  RNG rng;
+  /// The most recent models found, newest first.
+  std::deque<Assignment> models;
+
+  void mutate(Assignment &a, const SamplingContext &ctx);
+
+  /// search - Look for an assignment to the objects of \a ctx which
+  /// satisfies \a constraints, compiled to \a code.
+  bool search(const std::vector< ref<Expr> > &constraints,
+              const ExprBytecode &code, const SamplingContext &ctx,
+              Assignment &result);
+
+  /// findModel - Search for an assignment satisfying the constraints of \a
+  /// query and, if \a negateExpr is set, the negation of its expression.
+  bool findModel(const Query &query, bool negateExpr, Assignment &result);
+
+public:
+  ModelSamplingSolver() {}
+  ~ModelSamplingSolver() {}
+
+  IncompleteSolver::PartialValidity computeTruth(const Query&);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+};
+
+void ModelSamplingSolver::mutate(Assignment &a, const SamplingContext &ctx) {
+  const Array *array = ctx.objects[rng.getInt32() % ctx.objects.size()];
+  std::vector<unsigned char> &bytes = a.bindings[array];
+  if (bytes.empty())
+    return;
+
+  // Mutate a naturally aligned word of 1, 2, 4 or 8 bytes.
+  unsigned logSize = rng.getInt32() % 4;
+  while ((1U << logSize) > bytes.size())
+    --logSize;
+  unsigned numBytes = 1 << logSize;
+  unsigned offset = (rng.getInt32() % (bytes.size() / numBytes)) * numBytes;
+
+  uint64_t v = 0;
+  for (unsigned i = 0; i != numBytes; ++i)
+    v |= (uint64_t) bytes[offset + i] << (8 * i);
+
+  const std::vector<uint64_t> &constants = ctx.constants[logSize];
+  switch (rng.getInt32() % 4) {
+  case 0:
+    v = ((uint64_t) rng.getInt32() << 32) | rng.getInt32();
+    break;
+  case 1:
+    if (!constants.empty()) {
+      v = constants[rng.getInt32() % constants.size()];
+      break;
+    }
+    // FALLTHROUGH
+  case 2:
+    v += rng.getBool() ? 1 : -1;
+    break;
+  default:
+    v = rng.getBool() ? 0 : ~0ULL;
+    break;
+  }
+
+  for (unsigned i = 0; i != numBytes; ++i)
+    bytes[offset + i] = (unsigned char) (v >> (8 * i));
+}
+
+bool ModelSamplingSolver::search(const std::vector< ref<Expr> > &constraints,
+                                 const ExprBytecode &code,
+                                 const SamplingContext &ctx,
+                                 Assignment &result) {
+  TimerStatIncrementer t(stats::modelSamplingTime);
+
+  // The starting points: all zeros, then the recent models.
+  std::vector<Assignment> starts(1);
+  for (unsigned i = 0; i != ctx.objects.size(); ++i)
+    starts[0].bindings[ctx.objects[i]] =
+      std::vector<unsigned char>(ctx.objects[i]->size, 0);
+  for (std::deque<Assignment>::iterator it = models.begin(),
+         ie = models.end(); it != ie; ++it) {
+    Assignment seed(starts[0]);
+    bool isUsed = false;
+    for (Assignment::bindings_ty::iterator bit = seed.bindings.begin(),
+           bie = seed.bindings.end(); bit != bie; ++bit) {
+      Assignment::bindings_ty::iterator mit = it->bindings.find(bit->first);
+      if (mit != it->bindings.end() &&
+          mit->second.size() == bit->second.size()) {
+        bit->second = mit->second;
+        isUsed = true;
+      }
+    }
+    if (isUsed)
+      starts.push_back(seed);
+  }
+
+  for (unsigned step = 0; step != ModelSamplingCandidates; ++step) {
+    Assignment candidate;
+    if (step < starts.size()) {
+      candidate = starts[step];
+    } else if (step % 4 == 0) {
+      candidate = starts[0];
+      for (Assignment::bindings_ty::iterator it = candidate.bindings.begin(),
+             ie = candidate.bindings.end(); it != ie; ++it)
+        for (unsigned i = 0; i != it->second.size(); ++i)
+          it->second[i] = (unsigned char) rng.getInt32();
+    } else {
+      candidate = starts[rng.getInt32() % starts.size()];
+      for (unsigned i = 0, e = 1 + rng.getInt32() % 4; i != e; ++i)
+        mutate(candidate, ctx);
+    }
+
+    // A hit of the program is confirmed against the constraints
+    // themselves before it is used, as it decides validity and test inputs.
+    if (code.evaluate(candidate) == ExprBytecode::True &&
+        candidate.satisfies(constraints.begin(), constraints.end())) {
+      ++stats::modelSamplingHits;
+      models.push_front(candidate);
+      if (models.size() > ModelSamplingSeeds)
+        models.pop_back();
+      result.bindings.swap(candidate.bindings);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ModelSamplingSolver::findModel(const Query &query, bool negateExpr,
+                                    Assignment &result) {
+  std::vector< ref<Expr> > constraints(query.constraints.begin(),
+                                       query.constraints.end());
+  if (negateExpr)
+    constraints.push_back(Expr::createIsZero(query.expr));
+
+  SamplingContext ctx;
+  findSymbolicObjects(constraints.begin(), constraints.end(), ctx.objects);
+  if (ctx.objects.empty())
+    return false;
+
+  ExprBytecode code(constraints.begin(), constraints.end());
+  if (!code.isValid())
+    return false;
+
+  ExprHashSet visited;
+  for (unsigned i = 0; i != constraints.size(); ++i)
+    ctx.scan(constraints[i], visited);
+
+  return search(constraints, code, ctx, result);
+}
+
+IncompleteSolver::PartialValidity
+ModelSamplingSolver::computeTruth(const Query& query) {
+  Assignment a;
+  if (findModel(query, true, a))
+    return IncompleteSolver::MayBeFalse;
+
+  return IncompleteSolver::None;
+}
+
+bool ModelSamplingSolver::computeValue(const Query& query, ref<Expr> &result) {
+  Assignment a;
+  if (!findModel(query, false, a))
+    return false;
+
+  result = a.evaluate(query.expr);
+  return isa<ConstantExpr>(result);
+}
+
+bool
+ModelSamplingSolver::computeInitialValues(const Query& query,
+                                          const std::vector<const Array*>
+                                            &objects,
+                                          std::vector< std::vector<unsigned char> >
+                                            &values,
+                                          bool &hasSolution) {
+  Assignment a;
+  if (!findModel(query, true, a))
+    return false;
+
+  // Objects which do not appear in the query are unconstrained.
+  for (unsigned i = 0; i != objects.size(); ++i) {
+    Assignment::bindings_ty::iterator it = a.bindings.find(objects[i]);
+    if (it != a.bindings.end())
+      values.push_back(it->second);
+    else
+      values.push_back(std::vector<unsigned char>(objects[i]->size, 0));
+  }
+  hasSolution = true;
+  return true;
+}
+
+/***/
+
+Solver *klee::createModelSamplingSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new ModelSamplingSolver(), s));
+}
@@ -0,0 +1,600 @@
+//===-- PersistentCachingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/ExprContext.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "SolverStats.h"
+
+#include "llvm/ADT/APFloat.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace klee;
+
+/***/
+
+namespace {
+  /// QueryKey - A 128 bit structural hash of a query, which (unlike
+  /// Expr::hash) does not depend on anything particular to one run, such as
+  /// addresses.
+  struct QueryKey {
+    uint64_t lo, hi;
+
+    QueryKey() : lo(0x243f6a8885a308d3ULL), hi(0x13198a2e03707344ULL) {}
+
+    static uint64_t mix(uint64_t h, uint64_t v) {
+      h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+      h ^= h >> 30;
+      h *= 0xbf58476d1ce4e5b9ULL;
+      h ^= h >> 27;
+      h *= 0x94d049bb133111ebULL;
+      h ^= h >> 31;
+      return h;
+    }
+
+    void add(uint64_t v) {
+      lo = mix(lo, v);
+      hi = mix(hi, ~v);
+    }
+    void add(const QueryKey &k) {
+      add(k.lo);
+      add(k.hi);
+    }
+    void add(const std::string &s) {
+      add(s.size());
+      for (unsigned i = 0; i != s.size(); ++i)
+        add((unsigned char) s[i]);
+    }
+  };
+
+  /// QueryHasher - Computes QueryKeys, sharing the work for common
+  /// subexpressions. The keys are kept across queries, so the constraints
+  /// a query shares with earlier ones are not hashed again, until the
+  /// ExprContext clears its caches.
+  class QueryHasher : public ExprCache {
+    ExprHashMap<QueryKey> exprKeys;
+    std::map<const Array*, QueryKey> arrayKeys;
+    std::map<const UpdateNode*, QueryKey> updateKeys;
+
+    QueryKey hashArray(const Array *array);
+    QueryKey hashUpdates(const UpdateNode *un);
+    QueryKey computeKey(const ref<Expr> &e);
+    static unsigned getSemanticsID(const llvm::fltSemantics *sem);
+
+  public:
+    QueryHasher() { ExprContext::get().registerCache(this); }
+    ~QueryHasher() { ExprContext::get().unregisterCache(this); }
+
+    void clear() {
+      exprKeys.clear();
+      arrayKeys.clear();
+      updateKeys.clear();
+    }
+    void forgetUpdate(const UpdateNode *un) { updateKeys.erase(un); }
+    void forgetArray(const Array *array) { arrayKeys.erase(array); }
+
+    QueryKey hash(const ref<Expr> &e);
+
+    /// hash - The key of a query. The constraints are combined with a
+    /// commutative sum, so the key does not depend on their order.
+    QueryKey hash(const Query &query, unsigned kind,
+                  const std::vector<const Array*> &objects);
+  };
+}
+
+unsigned QueryHasher::getSemanticsID(const llvm::fltSemantics *sem) {
+  // The width of the expression tells the other formats apart.
+  return sem == &llvm::APFloat::PPCDoubleDouble;
+}
+
+QueryKey QueryHasher::hashArray(const Array *array) {
+  std::map<const Array*, QueryKey>::iterator it = arrayKeys.find(array);
+  if (it != arrayKeys.end())
+    return it->second;
+
+  QueryKey k;
+  k.add(array->name);
+  k.add(array->size);
+  k.add(array->domain);
+  k.add(array->range);
+  k.add(array->constantValues.size());
+  for (unsigned i = 0; i != array->constantValues.size(); ++i)
+    k.add(hash(array->constantValues[i]));
+  arrayKeys.insert(std::make_pair(array, k));
+  return k;
+}
+
+QueryKey QueryHasher::hashUpdates(const UpdateNode *un) {
+  // Walk down to the first update with a key (or the end of the list) and
+  // extend that key back up, so long lists take no stack.
+  std::vector<const UpdateNode*> pending;
+  QueryKey k;
+  for (; un; un = un->next) {
+    std::map<const UpdateNode*, QueryKey>::iterator it = updateKeys.find(un);
+    if (it != updateKeys.end()) {
+      k = it->second;
+      break;
+    }
+    pending.push_back(un);
+  }
+
+  while (!pending.empty()) {
+    const UpdateNode *next = pending.back();
+    pending.pop_back();
+    k.add(hash(next->index));
+    k.add(hash(next->value));
+    updateKeys.insert(std::make_pair(next, k));
+  }
+  return k;
+}
+
+QueryKey QueryHasher::hash(const ref<Expr> &root) {
+  ExprHashMap<QueryKey>::iterator it = exprKeys.find(root);
+  if (it != exprKeys.end())
+    return it->second;
+
+  // Key the operands of an expression, including the updates it reads
+  // through, before the expression itself. This uses an explicit stack
+  // rather than recursion, as expressions can be deep enough to overflow
+  // the native one; an entry is marked once its operands are pushed.
+  std::vector< std::pair<ref<Expr>, bool> > stack;
+  stack.push_back(std::make_pair(root, false));
+  while (!stack.empty()) {
+    ref<Expr> e = stack.back().first;
+    if (exprKeys.count(e)) {
+      stack.pop_back();
+    } else if (stack.back().second) {
+      stack.pop_back();
+      exprKeys.insert(std::make_pair(e, computeKey(e)));
+    } else {
+      stack.back().second = true;
+      for (unsigned i = 0; i != e->getNumKids(); ++i)
+        stack.push_back(std::make_pair(e->getKid(i), false));
+      if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+        for (const UpdateNode *un = re->updates.head;
+             un && !updateKeys.count(un); un = un->next) {
+          stack.push_back(std::make_pair(un->index, false));
+          stack.push_back(std::make_pair(un->value, false));
+        }
+      }
+    }
+  }
+
+  return exprKeys.find(root)->second;
+}
+
+/// computeKey - The key of \a e, whose operands have keys already.
+QueryKey QueryHasher::computeKey(const ref<Expr> &e) {
+  QueryKey k;
+  k.add(e->getKind());
+  k.add(e->getWidth());
+  for (unsigned i = 0; i != e->getNumKids(); ++i)
+    k.add(hash(e->getKid(i)));
+
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const llvm::APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    for (unsigned i = 0; i != value.getNumWords(); ++i)
+      k.add(value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read: {
+    ReadExpr *re = cast<ReadExpr>(e);
+    k.add(hashArray(re->updates.root));
+    k.add(hashUpdates(re->updates.head));
+    break;
+  }
+  case Expr::Extract:
+    k.add(cast<ExtractExpr>(e)->offset);
+    break;
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+    k.add(getSemanticsID(cast<FConvertExpr>(e)->getSemantics()));
+    break;
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+    k.add(getSemanticsID(cast<F2FConvertExpr>(e)->getSemantics()));
+    k.add(cast<F2FConvertExpr>(e)->fromIsIEEE());
+    break;
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+    k.add(cast<F2IConvertExpr>(e)->fromIsIEEE());
+    k.add(cast<F2IConvertExpr>(e)->roundNearest());
+    break;
+  case Expr::FOrd1:
+    k.add(cast<FOrd1Expr>(e)->isIEEE());
+    break;
+  case Expr::FSqrt:
+  case Expr::FCos:
+  case Expr::FSin:
+    k.add(cast<FUnaryExpr>(e)->isIEEE());
+    break;
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FRem:
+    k.add(cast<FBinaryExpr>(e)->isIEEE());
+    break;
+  case Expr::FCmp:
+    k.add(cast<FCmpExpr>(e)->isIEEE());
+    break;
+  case Expr::Any:
+    k.add(cast<AnyExpr>(e)->getKey());
+    break;
+  default:
+    break;
+  }
+
+  return k;
+}
+
+QueryKey QueryHasher::hash(const Query &query, unsigned kind,
+                           const std::vector<const Array*> &objects) {
+  QueryKey constraints;
+  constraints.lo = constraints.hi = 0;
+  unsigned numConstraints = 0;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it, ++numConstraints) {
+    QueryKey c = hash(*it);
+    constraints.lo += c.lo;
+    constraints.hi += c.hi;
+  }
+
+  QueryKey k;
+  k.add(kind);
+  k.add(numConstraints);
+  k.add(constraints);
+  k.add(hash(query.expr));
+  k.add(objects.size());
+  for (unsigned i = 0; i != objects.size(); ++i)
+    k.add(hashArray(objects[i]));
+  return k;
+}
+
+/***/
+
+namespace {
+  /// CacheFile - A hash table of query results in a memory mapped file,
+  /// which several processes may use at once.
+  ///
+  /// The file holds a header, a table of slots probed linearly, and the
+  /// data of the results. Readers hold a shared lock on the file and
+  /// writers an exclusive one. Results are only ever added, until either
+  /// the table or the data is full.
+  class CacheFile {
+    struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t numSlots;
+      uint64_t dataSize;
+      uint64_t dataUsed;
+    };
+
+    struct Slot {
+      uint64_t lo, hi;
+      uint64_t offset;
+      uint32_t length;
+      /// The kind of result, 0 for an empty slot.
+      uint32_t kind;
+    };
+
+    enum { Version = 1, MaxProbes = 64 };
+
+    int fd;
+    size_t size;
+    char *base;
+
+    Header *header() { return (Header*) base; }
+    Slot *slots() { return (Slot*) (base + sizeof(Header)); }
+    char *data() {
+      return base + sizeof(Header) + header()->numSlots * sizeof(Slot);
+    }
+
+    bool initialize(size_t requestedSize);
+
+  public:
+    CacheFile() : fd(-1), size(0), base(0) {}
+    ~CacheFile();
+
+    /// open - Open (or create, with the given size) the cache at \a path.
+    bool open(const std::string &path, size_t requestedSize);
+
+    bool lookup(unsigned kind, const QueryKey &key, std::string &result);
+    void insert(unsigned kind, const QueryKey &key, const std::string &result);
+  };
+}
+
+static const char CacheMagic[8] = { 'K', 'L', 'E', 'E', 'Q', 'C', 'C', 0 };
+
+CacheFile::~CacheFile() {
+  if (base)
+    munmap(base, size);
+  if (fd != -1)
+    close(fd);
+}
+
+bool CacheFile::initialize(size_t requestedSize) {
+  // A quarter of the file for the table.
+  uint64_t numSlots = requestedSize / 4 / sizeof(Slot);
+  if (numSlots < MaxProbes || numSlots > 0xFFFFFFFFULL)
+    return false;
+  if (ftruncate(fd, requestedSize) == -1)
+    return false;
+
+  Header h;
+  memcpy(h.magic, CacheMagic, sizeof(h.magic));
+  h.version = Version;
+  h.numSlots = numSlots;
+  h.dataSize = requestedSize - sizeof(Header) - numSlots * sizeof(Slot);
+  h.dataUsed = 0;
+  return pwrite(fd, &h, sizeof(h), 0) == (ssize_t) sizeof(h);
+}
+
+bool CacheFile::open(const std::string &path, size_t requestedSize) {
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1)
+    return false;
+
+  // The first process to get here sets the file up.
+  flock(fd, LOCK_EX);
+  struct stat st;
+  bool ok = fstat(fd, &st) != -1 &&
+            (st.st_size != 0 || initialize(requestedSize)) &&
+            fstat(fd, &st) != -1;
+  flock(fd, LOCK_UN);
+  if (!ok || (size_t) st.st_size < sizeof(Header))
+    return false;
+
+  size = st.st_size;
+  void *p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    return false;
+  base = (char*) p;
+
+  Header *h = header();
+  if (memcmp(h->magic, CacheMagic, sizeof(h->magic)) ||
+      h->version != Version ||
+      sizeof(Header) + (uint64_t) h->numSlots * sizeof(Slot) + h->dataSize !=
+        size) {
+    munmap(base, size);
+    base = 0;
+    return false;
+  }
+  return true;
+}
+
+bool CacheFile::lookup(unsigned kind, const QueryKey &key,
+                       std::string &result) {
+  bool found = false;
+  flock(fd, LOCK_SH);
+  Header *h = header();
+  for (unsigned i = 0; i != MaxProbes; ++i) {
+    Slot &s = slots()[(key.lo + i) % h->numSlots];
+    if (!s.kind)
+      break;
+    if (s.kind == kind && s.lo == key.lo && s.hi == key.hi) {
+      if (s.offset + s.length <= h->dataSize) {
+        result.assign(data() + s.offset, s.length);
+        found = true;
+      }
+      break;
+    }
+  }
+  flock(fd, LOCK_UN);
+  return found;
+}
+
+void CacheFile::insert(unsigned kind, const QueryKey &key,
+                       const std::string &result) {
+  flock(fd, LOCK_EX);
+  Header *h = header();
+  for (unsigned i = 0; i != MaxProbes; ++i) {
+    Slot &s = slots()[(key.lo + i) % h->numSlots];
+    if (s.kind == kind && s.lo == key.lo && s.hi == key.hi)
+      break;
+    if (s.kind)
+      continue;
+    if (h->dataUsed + result.size() > h->dataSize)
+      break;
+
+    memcpy(data() + h->dataUsed, result.data(), result.size());
+    s.lo = key.lo;
+    s.hi = key.hi;
+    s.offset = h->dataUsed;
+    s.length = result.size();
+    s.kind = kind;
+    h->dataUsed += result.size();
+    break;
+  }
+  flock(fd, LOCK_UN);
+}
+
+/***/
+
+/// PersistentCachingSolver - Caches query results in a file, so that they
+/// are kept across runs and shared with other processes using the same
+/// file.
+///
+/// Queries are identified by their QueryKey alone. Cached counterexamples
+/// are checked against the query before they are used, which other
+/// results cannot be; a collision of the 128 bit keys is taken to be too
+/// unlikely to matter.
+class PersistentCachingSolver : public SolverImpl {
+  enum ResultKind { TruthResult = 1, ValueResult, InitialValuesResult };
+
+  Solver *solver;
+  CacheFile file;
+  bool isOpen;
+  QueryHasher hasher;
+
+  QueryKey getKey(const Query &query, ResultKind kind,
+                  const std::vector<const Array*> &objects =
+                    std::vector<const Array*>()) {
+    return hasher.hash(query, kind, objects);
+  }
+
+public:
+  PersistentCachingSolver(Solver *s, const std::string &path, size_t size)
+    : solver(s) {
+    isOpen = file.open(path, size);
+    if (!isOpen)
+      fprintf(stderr, "warning: unable to open query cache %s\n",
+              path.c_str());
+  }
+  ~PersistentCachingSolver() { delete solver; }
+
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+};
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  if (!isOpen)
+    return solver->impl->computeTruth(query, isValid);
+
+  QueryKey key = getKey(query, TruthResult);
+  std::string result;
+  if (file.lookup(TruthResult, key, result) && result.size() == 1) {
+    ++stats::queryPersistentCacheHits;
+    isValid = result[0];
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+
+  file.insert(TruthResult, key, std::string(1, (char) isValid));
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  if (!isOpen)
+    return solver->impl->computeValue(query, result);
+
+  QueryKey key = getKey(query, ValueResult);
+  std::string data;
+  if (file.lookup(ValueResult, key, data)) {
+    unsigned numWords = (query.expr->getWidth() + 63) / 64;
+    if (data.size() == numWords * sizeof(uint64_t)) {
+      ++stats::queryPersistentCacheHits;
+      std::vector<uint64_t> words(numWords);
+      memcpy(&words[0], data.data(), data.size());
+      result = ConstantExpr::alloc(llvm::APInt(query.expr->getWidth(),
+                                               numWords, &words[0]));
+      return true;
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValue(query, result))
+    return false;
+
+  const llvm::APInt &value = cast<ConstantExpr>(result)->getAPValue();
+  file.insert(ValueResult, key,
+              std::string((const char*) value.getRawData(),
+                          value.getNumWords() * sizeof(uint64_t)));
+  return true;
+}
+
+bool
+PersistentCachingSolver::computeInitialValues(const Query &query,
+                                              const std::vector<const Array*>
+                                                &objects,
+                                              std::vector< std::vector<unsigned char> >
+                                                &values,
+                                              bool &hasSolution) {
+  if (!isOpen)
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution);
+
+  unsigned solutionSize = 0;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    solutionSize += objects[i]->size;
+
+  QueryKey key = getKey(query, InitialValuesResult, objects);
+  std::string data;
+  if (file.lookup(InitialValuesResult, key, data) && !data.empty()) {
+    if (!data[0] && data.size() == 1) {
+      ++stats::queryPersistentCacheHits;
+      hasSolution = false;
+      return true;
+    }
+
+    if (data[0] && data.size() == 1 + solutionSize) {
+      std::vector< std::vector<unsigned char> > model(objects.size());
+      size_t pos = 1;
+      for (unsigned i = 0; i != objects.size(); ++i) {
+        model[i].insert(model[i].begin(), data.begin() + pos,
+                        data.begin() + pos + objects[i]->size);
+        pos += objects[i]->size;
+      }
+
+      // Only use the counterexample if it still is one.
+      std::vector<const Array*> objectsCopy(objects);
+      Assignment a(objectsCopy, model);
+      if (a.satisfies(query.constraints.begin(), query.constraints.end()) &&
+          a.evaluate(query.expr)->isFalse()) {
+        ++stats::queryPersistentCacheHits;
+        values.swap(model);
+        hasSolution = true;
+        return true;
+      }
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeInitialValues(query, objects, values,
+                                          hasSolution))
+    return false;
+
+  data.assign(1, (char) hasSolution);
+  if (hasSolution)
+    for (unsigned i = 0; i != values.size(); ++i)
+      data.append(values[i].begin(), values[i].end());
+  file.insert(InitialValuesResult, key, data);
+  return true;
+}
+
+/***/
+
+Solver *klee::createPersistentCachingSolver(Solver *s, const std::string &path,
+                                            unsigned sizeMB) {
+  return new Solver(new PersistentCachingSolver(s, path,
+                                                (size_t) sizeMB << 20));
+}
@@ -0,0 +1,200 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+
+#include "SolverStats.h"
+#include "SolverWorkerPool.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/Internal/Support/Timer.h"
+
+#include <cassert>
+#include <vector>
+
+#include <errno.h>
+#include <poll.h>
+
+using namespace klee;
+
+/// PortfolioSolverImpl - Runs each query on several complete solvers at once,
+/// each in a long-lived worker process of its own, and uses the first
+/// answer.
+///
+/// The workers are forked at the first query and then kept, so a query only
+/// costs serializing it to each of them. Workers which lose a race keep
+/// solving, and are killed at the next query only if they still have not
+/// answered by then; on easy queries they usually have.
+class PortfolioSolverImpl : public SolverImpl {
+private:
+  std::vector<SolverWorkerPool*> workers;
+  double timeout;
+  SolverRunStatus runStatusCode;
+
+public:
+  PortfolioSolverImpl(const std::vector<Solver*> &backends);
+  ~PortfolioSolverImpl();
+
+  void setTimeout(double _timeout) { timeout = _timeout; }
+
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+};
+
+PortfolioSolverImpl::PortfolioSolverImpl(const std::vector<Solver*> &backends)
+  : timeout(0.0),
+    runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+  assert(!backends.empty() && "portfolio without solvers");
+  for (unsigned i = 0; i != backends.size(); ++i)
+    workers.push_back(new SolverWorkerPool(1, backends[i]));
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  for (unsigned i = 0; i != workers.size(); ++i)
+    delete workers[i];
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query& query,
+                                       bool &isValid) {
+  std::vector<const Array*> objects;
+  std::vector< std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query& query,
+                                       ref<Expr> &result) {
+  std::vector<const Array*> objects;
+  std::vector< std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+bool
+PortfolioSolverImpl::computeInitialValues(const Query &query,
+                                          const std::vector<const Array*>
+                                            &objects,
+                                          std::vector< std::vector<unsigned char> >
+                                            &values,
+                                          bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  TimerStatIncrementer t(stats::queryTime);
+
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+
+  WallTimer timer;
+  std::vector<SolverWorkerPool*> running;
+  for (unsigned i = 0; i != workers.size(); ++i) {
+    workers[i]->startQuery(query, objects, timeout);
+    if (workers[i]->getResultFD() != -1)
+      running.push_back(workers[i]);
+    else
+      runStatusCode = workers[i]->finishQuery(values, hasSolution);
+  }
+
+  bool winner = false;
+  while (!running.empty() && !winner) {
+    int wait = -1;
+    if (timeout) {
+      double remaining = timeout - timer.check() / 1000000.;
+      if (remaining <= 0) {
+        runStatusCode = SOLVER_RUN_STATUS_TIMEOUT;
+        break;
+      }
+      wait = (int) (remaining * 1000) + 1;
+    }
+
+    std::vector<struct pollfd> fds(running.size());
+    for (unsigned i = 0; i != running.size(); ++i) {
+      fds[i].fd = running[i]->getResultFD();
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+
+    int n = poll(&fds[0], fds.size(), wait);
+    if (n == -1 && errno != EINTR)
+      break;
+    if (n <= 0)
+      continue;
+
+    std::vector<SolverWorkerPool*> stillRunning;
+    for (unsigned i = 0; i != fds.size(); ++i) {
+      if (winner || !(fds[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+        stillRunning.push_back(running[i]);
+        continue;
+      }
+
+      SolverRunStatus status = running[i]->finishQuery(values, hasSolution);
+      if (status == SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+          status == SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+        winner = true;
+      runStatusCode = status;
+    }
+    running.swap(stillRunning);
+  }
+
+  // The remaining workers keep solving the query unless there is no
+  // answer, in which case they are too slow.
+  if (!winner) {
+    for (unsigned i = 0; i != running.size(); ++i)
+      running[i]->cancelQuery();
+    return false;
+  }
+
+  if (hasSolution)
+    ++stats::queriesInvalid;
+  else
+    ++stats::queriesValid;
+
+  return true;
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::getOperationStatusCode() {
+  return runStatusCode;
+}
+
+/***/
+
+PortfolioSolver::PortfolioSolver(const std::vector<Solver*> &backends)
+  : Solver(new PortfolioSolverImpl(backends))
+{
+}
+
+void PortfolioSolver::setTimeout(double timeout) {
+  static_cast<PortfolioSolverImpl*>(impl)->setTimeout(timeout);
+}
@@ -0,0 +1,471 @@
+//===-- SMTLIBSolver.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+
+#include "SolverStats.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprSMTLIBLetPrinter.h"
+#include "klee/util/ExprUtil.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace klee;
+
+namespace {
+  /// SExpr - A parsed SMT-LIBv2 response, either an atom or a list.
+  struct SExpr {
+    bool isList;
+    std::string atom;
+    std::vector<SExpr> list;
+
+    SExpr() : isList(false) {}
+  };
+}
+
+/// parseSExpr - Parse the s-expression starting at \a pos in \a s and advance
+/// \a pos past it. Returns false at the end of the input or on a parse error.
+static bool parseSExpr(const std::string &s, size_t &pos, SExpr &result) {
+  // Skip white space and comments.
+  for (;;) {
+    while (pos < s.size() && isspace((unsigned char) s[pos]))
+      ++pos;
+    if (pos < s.size() && s[pos] == ';') {
+      while (pos < s.size() && s[pos] != '\n')
+        ++pos;
+      continue;
+    }
+    break;
+  }
+
+  if (pos >= s.size() || s[pos] == ')')
+    return false;
+
+  result = SExpr();
+  if (s[pos] == '(') {
+    result.isList = true;
+    ++pos;
+    SExpr kid;
+    while (parseSExpr(s, pos, kid))
+      result.list.push_back(kid);
+    if (pos >= s.size())
+      return false;
+    ++pos; // ')'
+    return true;
+  }
+
+  size_t start = pos;
+  if (s[pos] == '"' || s[pos] == '|') {
+    char quote = s[pos++];
+    while (pos < s.size() && s[pos] != quote)
+      ++pos;
+    if (pos >= s.size())
+      return false;
+    ++pos;
+  } else {
+    while (pos < s.size() && !isspace((unsigned char) s[pos]) &&
+           s[pos] != '(' && s[pos] != ')')
+      ++pos;
+  }
+  result.atom = s.substr(start, pos - start);
+  return true;
+}
+
+/// parseByte - Parse a bitvector value printed by the solver, in any of
+/// the #x, #b and (_ bvN w) forms.
+static bool parseByte(const SExpr &value, unsigned char &result) {
+  const char *digits;
+  int base;
+  if (value.isList) {
+    if (value.list.size() != 3 || value.list[0].atom != "_" ||
+        value.list[1].atom.compare(0, 2, "bv") != 0)
+      return false;
+    digits = value.list[1].atom.c_str() + 2;
+    base = 10;
+  } else if (value.atom.compare(0, 2, "#x") == 0) {
+    digits = value.atom.c_str() + 2;
+    base = 16;
+  } else if (value.atom.compare(0, 2, "#b") == 0) {
+    digits = value.atom.c_str() + 2;
+    base = 2;
+  } else {
+    return false;
+  }
+
+  char *end;
+  unsigned long v = strtoul(digits, &end, base);
+  if (*digits == '\0' || *end != '\0' || v > 255)
+    return false;
+  result = (unsigned char) v;
+  return true;
+}
+
+/// runSolverProcess - Run \a argv with \a input on its standard input and
+/// collect its standard output in \a output. Both are done at once so that
+/// neither process can block the other on a full pipe.
+static SolverImpl::SolverRunStatus
+runSolverProcess(const std::vector<std::string> &argv,
+                 const std::string &input, std::string &output,
+                 double timeout) {
+  int toSolver[2], fromSolver[2];
+  if (pipe(toSolver) == -1)
+    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+  if (pipe(fromSolver) == -1) {
+    close(toSolver[0]);
+    close(toSolver[1]);
+    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  int pid = fork();
+  if (pid == -1) {
+    fprintf(stderr, "error: fork failed (for %s)\n", argv[0].c_str());
+    close(toSolver[0]);
+    close(toSolver[1]);
+    close(fromSolver[0]);
+    close(fromSolver[1]);
+    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+  }
+
+  if (pid == 0) {
+    dup2(toSolver[0], 0);
+    dup2(fromSolver[1], 1);
+    close(toSolver[0]);
+    close(toSolver[1]);
+    close(fromSolver[0]);
+    close(fromSolver[1]);
+
+    std::vector<char*> args;
+    for (unsigned i = 0; i != argv.size(); ++i)
+      args.push_back(const_cast<char*>(argv[i].c_str()));
+    args.push_back(0);
+
+    // A pending alarm is kept across exec, and kills the solver when it
+    // goes off.
+    if (timeout) {
+      ::signal(SIGALRM, SIG_DFL);
+      ::alarm(std::max(1, (int)timeout));
+    }
+    execvp(args[0], &args[0]);
+    _exit(127);
+  }
+
+  close(toSolver[0]);
+  close(fromSolver[1]);
+  fcntl(toSolver[1], F_SETFL, O_NONBLOCK);
+
+  // The solver may exit before reading all of the query.
+  void (*oldHandler)(int) = ::signal(SIGPIPE, SIG_IGN);
+
+  size_t written = 0;
+  int writeFd = toSolver[1];
+  if (input.empty()) {
+    close(writeFd);
+    writeFd = -1;
+  }
+
+  output.clear();
+  char buffer[4096];
+  for (;;) {
+    struct pollfd fds[2];
+    fds[0].fd = fromSolver[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = writeFd;
+    fds[1].events = POLLOUT;
+    if (poll(fds, writeFd == -1 ? 1 : 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (writeFd != -1 && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP))) {
+      ssize_t n = write(writeFd, input.data() + written, input.size() - written);
+      if (n > 0)
+        written += n;
+      if ((n == -1 && errno != EAGAIN && errno != EINTR) ||
+          written == input.size()) {
+        close(writeFd);
+        writeFd = -1;
+      }
+    }
+
+    if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+      ssize_t n = read(fromSolver[0], buffer, sizeof(buffer));
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      output.append(buffer, n);
+    }
+  }
+
+  if (writeFd != -1)
+    close(writeFd);
+  close(fromSolver[0]);
+  ::signal(SIGPIPE, oldHandler);
+
+  int status;
+  pid_t res;
+  do {
+    res = waitpid(pid, &status, 0);
+  } while (res < 0 && errno == EINTR);
+
+  if (res < 0) {
+    fprintf(stderr, "error: waitpid() for %s failed\n", argv[0].c_str());
+    return SolverImpl::SOLVER_RUN_STATUS_WAITPID_FAILED;
+  }
+
+  if (WIFSIGNALED(status) || !WIFEXITED(status)) {
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+      fprintf(stderr, "error: %s timed out\n", argv[0].c_str());
+      return SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+    }
+    fprintf(stderr, "error: %s did not return successfully\n",
+            argv[0].c_str());
+    return SolverImpl::SOLVER_RUN_STATUS_INTERRUPTED;
+  }
+
+  if (WEXITSTATUS(status) == 127) {
+    fprintf(stderr, "error: could not run %s\n", argv[0].c_str());
+    return SolverImpl::SOLVER_RUN_STATUS_UNEXPECTED_EXIT_CODE;
+  }
+
+  // Solvers disagree on the exit code after an error (e.g. asking for a
+  // model of an unsatisfiable query), so the output decides the result.
+  return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+}
+
+/***/
+
+class SMTLIBSolverImpl : public SolverImpl {
+private:
+  std::vector<std::string> argv;
+  ExprSMTLIBPrinter *printer;
+  double timeout;
+  SolverRunStatus runStatusCode;
+
+public:
+  SMTLIBSolverImpl(const std::string &path, const std::string &args);
+  ~SMTLIBSolverImpl();
+
+  void setTimeout(double _timeout) { timeout = _timeout; }
+
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+};
+
+SMTLIBSolverImpl::SMTLIBSolverImpl(const std::string &path,
+                                   const std::string &args)
+  : printer(createSMTLIBPrinter()),
+    timeout(0.0),
+    runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+  argv.push_back(path);
+  std::istringstream ss(args);
+  std::string arg;
+  while (ss >> arg)
+    argv.push_back(arg);
+
+  // Nobody reads the query, so keep it small.
+  printer->setHumanReadable(false);
+}
+
+SMTLIBSolverImpl::~SMTLIBSolverImpl() {
+  delete printer;
+}
+
+bool SMTLIBSolverImpl::computeTruth(const Query& query,
+                                    bool &isValid) {
+  std::vector<const Array*> objects;
+  std::vector< std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool SMTLIBSolverImpl::computeValue(const Query& query,
+                                    ref<Expr> &result) {
+  std::vector<const Array*> objects;
+  std::vector< std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+bool
+SMTLIBSolverImpl::computeInitialValues(const Query &query,
+                                       const std::vector<const Array*>
+                                         &objects,
+                                       std::vector< std::vector<unsigned char> >
+                                         &values,
+                                       bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  TimerStatIncrementer t(stats::queryTime);
+
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+
+  printer->setQuery(query);
+  if (printer->hasUnsupportedFloat()) {
+    fprintf(stderr, "error: query has a floating point format which "
+            "SMT-LIBv2 does not support\n");
+    return false;
+  }
+
+  // With uninterpreted functions in the query, a model has to be checked
+  // against the concrete semantics of the functions, which needs values for
+  // every object in the query. Only FSin and FCos are uninterpreted: FSqrt
+  // and FRem are printed as exact IEEE-754 terms, so models that use them
+  // need no check.
+  std::vector<const Array*> queryObjects(objects);
+  if (printer->hasFloatFunctions()) {
+    std::vector< ref<Expr> > exprs(query.constraints.begin(),
+                                   query.constraints.end());
+    exprs.push_back(query.expr);
+    std::vector<const Array*> used;
+    findSymbolicObjects(exprs.begin(), exprs.end(), used);
+    std::set<const Array*> requested(objects.begin(), objects.end());
+    for (unsigned i = 0; i != used.size(); ++i)
+      if (requested.insert(used[i]).second)
+        queryObjects.push_back(used[i]);
+  }
+
+  std::ostringstream smtlib;
+  printer->setOutput(smtlib);
+  printer->setArrayValuesToGet(queryObjects);
+  printer->generateOutput();
+
+  std::string output;
+  runStatusCode = runSolverProcess(argv, smtlib.str(), output, timeout);
+  if (runStatusCode != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE)
+    return false;
+
+  size_t pos = 0;
+  SExpr response;
+  if (!parseSExpr(output, pos, response) || response.isList) {
+    fprintf(stderr, "error: unexpected response from %s: %s\n",
+            argv[0].c_str(), output.substr(0, 256).c_str());
+    runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+    return false;
+  }
+
+  if (response.atom == "unsat") {
+    hasSolution = false;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+    ++stats::queriesValid;
+    return true;
+  }
+
+  if (response.atom != "sat") {
+    // "unknown", or a solver specific answer such as "timeout".
+    runStatusCode = timeout ? SOLVER_RUN_STATUS_TIMEOUT
+                            : SOLVER_RUN_STATUS_FAILURE;
+    return false;
+  }
+
+  // One (get-value) response per byte, in the order they were requested:
+  // (((select a (_ bv0 32)) #x2a))
+  values.clear();
+  values.reserve(queryObjects.size());
+  for (std::vector<const Array*>::const_iterator
+         it = queryObjects.begin(), ie = queryObjects.end(); it != ie; ++it) {
+    const Array *array = *it;
+    std::vector<unsigned char> data;
+
+    data.reserve(array->size);
+    for (unsigned offset = 0; offset < array->size; offset++) {
+      unsigned char val;
+      if (!parseSExpr(output, pos, response) || response.list.size() != 1 ||
+          response.list[0].list.size() != 2 ||
+          !parseByte(response.list[0].list[1], val)) {
+        fprintf(stderr, "error: unexpected model from %s for %s\n",
+                argv[0].c_str(), array->name.c_str());
+        runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+        return false;
+      }
+      data.push_back(val);
+    }
+
+    values.push_back(data);
+  }
+
+  if (printer->hasFloatFunctions()) {
+    // The model may rely on function results that are not the real ones.
+    Assignment a(queryObjects, values);
+    bool isModel = a.evaluate(query.expr)->isFalse();
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+           ie = query.constraints.end(); isModel && it != ie; ++it)
+      isModel = a.evaluate(*it)->isTrue();
+    if (!isModel) {
+      runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+      return false;
+    }
+  }
+
+  values.resize(objects.size());
+  hasSolution = true;
+  ++stats::queriesInvalid;
+  return true;
+}
+
+SolverImpl::SolverRunStatus SMTLIBSolverImpl::getOperationStatusCode() {
+  return runStatusCode;
+}
+
+/***/
+
+SMTLIBSolver::SMTLIBSolver(const std::string &path, const std::string &args)
+  : Solver(new SMTLIBSolverImpl(path, args))
+{
+}
+
+void SMTLIBSolver::setTimeout(double timeout) {
+  static_cast<SMTLIBSolverImpl*>(impl)->setTimeout(timeout);
+}
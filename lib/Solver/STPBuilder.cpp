@@ -11,6 +11,7 @@
 
 #include "klee/Expr.h"
 #include "klee/Solver.h"
+#include "klee/util/Assignment.h"
 #include "klee/util/Bits.h"
 
 #include "ConstantDivision.h"
@@ -59,7 +60,7 @@ namespace {
 
 STPBuilder::STPBuilder(::VC _vc, bool _optimizeDivides) 
   : vc(_vc), optimizeDivides(_optimizeDivides), fpCount(0),
-    spfloat(prop), dpfloat(prop)
+    spfloat(prop), dpfloat(prop), ufCount(0)
 {
   tempVars[0] = buildVar("__tmpInt8", 8);
   tempVars[1] = buildVar("__tmpInt16", 16);
@@ -68,9 +69,69 @@ STPBuilder::STPBuilder(::VC _vc, bool _optimizeDivides)
 
   spfloat.spec = ieee_float_spect::single_precision();
   dpfloat.spec = ieee_float_spect::double_precision();
+
+  ExprContext::get().registerCache(this);
 }
 
 STPBuilder::~STPBuilder() {
+  ExprContext::get().unregisterCache(this);
+  clear();
+}
+
+void STPBuilder::clear() {
+  // Freeing the abstracted update lists frees updates in turn, which are
+  // then forgotten, so take them out of the way first.
+  std::tr1::unordered_map<const UpdateNode*, UFUpdate> oldUFUpdates;
+  oldUFUpdates.swap(ufUpdates);
+  oldUFUpdates.clear();
+
+  for (std::tr1::unordered_map<const Array*, ::VCExpr>::iterator
+         it = initialArrays.begin(), ie = initialArrays.end(); it != ie; ++it)
+    vc_DeleteExpr(it->second);
+  initialArrays.clear();
+
+  for (std::tr1::unordered_map<const UpdateNode*, ::VCExpr>::iterator
+         it = updateArrays.begin(), ie = updateArrays.end(); it != ie; ++it)
+    vc_DeleteExpr(it->second);
+  updateArrays.clear();
+
+  // Drop the expressions reading the uninterpreted function arrays before
+  // freeing the arrays themselves. The applications are abstracted afresh
+  // by the next query which meets them.
+  constructed.clear();
+  resetUFApplications();
+  ufApplications.clear();
+  for (unsigned i = 0; i != ufArrays.size(); ++i)
+    delete ufArrays[i];
+  ufArrays.clear();
+}
+
+void STPBuilder::forgetUpdate(const UpdateNode *un) {
+  std::tr1::unordered_map<const UpdateNode*, ::VCExpr>::iterator it =
+    updateArrays.find(un);
+  if (it != updateArrays.end()) {
+    vc_DeleteExpr(it->second);
+    updateArrays.erase(it);
+  }
+
+  std::tr1::unordered_map<const UpdateNode*, UFUpdate>::iterator uit =
+    ufUpdates.find(un);
+  if (uit != ufUpdates.end()) {
+    // Freeing the abstracted list can free other updates, so keep it until
+    // the entry is gone.
+    UpdateList abstracted = uit->second.abstracted;
+    ufUpdates.erase(uit);
+    ufNotedUpdates.erase(un);
+  }
+}
+
+void STPBuilder::forgetArray(const Array *array) {
+  std::tr1::unordered_map<const Array*, ::VCExpr>::iterator it =
+    initialArrays.find(array);
+  if (it != initialArrays.end()) {
+    vc_DeleteExpr(it->second);
+    initialArrays.erase(it);
+  }
 }
 
 ///
@@ -408,31 +469,33 @@ ExprHandle STPBuilder::constructSDivByConstant(ExprHandle expr_n, unsigned width
 }
 
 ::VCExpr STPBuilder::getInitialArray(const Array *root) {
-  if (root->stpInitialArray) {
-    return root->stpInitialArray;
-  } else {
-    // STP uniques arrays by name, so we make sure the name is unique by
-    // including the address.
-    char buf[32];
-    sprintf(buf, "%s_%p", root->name.c_str(), (void*) root);
-    root->stpInitialArray = buildArray(buf, root->getDomain(), root->getRange());
-
-    if (root->isConstantArray()) {
-      // FIXME: Flush the concrete values into STP. Ideally we would do this
-      // using assertions, which is much faster, but we need to fix the caching
-      // to work correctly in that case.
-      for (unsigned i = 0, e = root->size; i != e; ++i) {
-        ::VCExpr prev = root->stpInitialArray;
-        root->stpInitialArray = 
-          vc_writeExpr(vc, prev,
-                       construct(ConstantExpr::alloc(i, root->getDomain()), 0, etBV),
-                       construct(root->constantValues[i], 0, etBV));
-        vc_DeleteExpr(prev);
-      }
+  std::tr1::unordered_map<const Array*, ::VCExpr>::iterator it =
+    initialArrays.find(root);
+  if (it != initialArrays.end())
+    return it->second;
+
+  // STP uniques arrays by name, so we make sure the name is unique by
+  // including the address.
+  char buf[32];
+  sprintf(buf, "%s_%p", root->name.c_str(), (void*) root);
+  ::VCExpr array = buildArray(buf, root->getDomain(), root->getRange());
+
+  if (root->isConstantArray()) {
+    // FIXME: Flush the concrete values into STP. Ideally we would do this
+    // using assertions, which is much faster, but we need to fix the caching
+    // to work correctly in that case.
+    for (unsigned i = 0, e = root->size; i != e; ++i) {
+      ::VCExpr prev = array;
+      array = 
+        vc_writeExpr(vc, prev,
+                     construct(ConstantExpr::alloc(i, root->getDomain()), 0, etBV),
+                     construct(root->constantValues[i], 0, etBV));
+      vc_DeleteExpr(prev);
     }
-
-    return root->stpInitialArray;
   }
+
+  initialArrays.insert(std::make_pair(root, array));
+  return array;
 }
 
 ExprHandle STPBuilder::getInitialRead(const Array *root, unsigned index) {
@@ -441,20 +504,368 @@ ExprHandle STPBuilder::getInitialRead(const Array *root, unsigned index) {
 
 ::VCExpr STPBuilder::getArrayForUpdate(const Array *root, 
                                        const UpdateNode *un) {
-  if (!un) {
-    return getInitialArray(root);
+  // Find the updates not yet built, down to one which is (or the root).
+  std::vector<const UpdateNode*> pending;
+  ::VCExpr array = 0;
+  for (; un; un = un->next) {
+    std::tr1::unordered_map<const UpdateNode*, ::VCExpr>::iterator it =
+      updateArrays.find(un);
+    if (it != updateArrays.end()) {
+      array = it->second;
+      break;
+    }
+    pending.push_back(un);
+  }
+  if (!un)
+    array = getInitialArray(root);
+
+  // Build them from the oldest.
+  while (!pending.empty()) {
+    const UpdateNode *next = pending.back();
+    pending.pop_back();
+    array = vc_writeExpr(vc, array,
+                         construct(next->index, 0, etBV),
+                         construct(next->value, 0, etBV));
+    updateArrays.insert(std::make_pair(next, array));
+  }
+
+  return array;
+}
+
+
+/***/
+
+static bool isUFKind(Expr::Kind k) {
+  return k == Expr::FSqrt || k == Expr::FSin || k == Expr::FCos ||
+         k == Expr::FRem;
+}
+
+static bool isUFIEEE(const ref<Expr> &e) {
+  if (const FUnaryExpr *fu = dyn_cast<FUnaryExpr>(e))
+    return fu->isIEEE();
+  return cast<FBinaryExpr>(e)->isIEEE();
+}
+
+const STPBuilder::UFApplication &
+STPBuilder::getUFApplication(const ref<Expr> &e, const ref<Expr> *args) {
+  ExprHashMap<UFApplication>::iterator it = ufApplications.find(e);
+  if (it != ufApplications.end())
+    return it->second;
+
+  std::ostringstream ss;
+  switch (e->getKind()) {
+  default: assert(0 && "invalid uninterpreted function");
+  case Expr::FSqrt: ss << "fsqrt"; break;
+  case Expr::FSin: ss << "fsin"; break;
+  case Expr::FCos: ss << "fcos"; break;
+  case Expr::FRem: ss << "frem"; break;
+  }
+  ss << ufCount++;
+
+  // The result is a little endian read of a fresh array, which lets the
+  // lemmas be written as ordinary expressions.
+  unsigned numBytes = e->getWidth() / 8;
+  const Array *array = new Array(ss.str(), numBytes);
+  ufArrays.push_back(array);
+  std::vector< ref<Expr> > bytes;
+  for (unsigned i = numBytes; i != 0; --i)
+    bytes.push_back(ReadExpr::create(UpdateList(array, 0),
+                                     ConstantExpr::alloc(i - 1, Expr::Int32)));
+
+  UFApplication u;
+  u.array = array;
+  u.result = ConcatExpr::createN(numBytes, &bytes[0]);
+  u.args.assign(args, args + e->getNumKids());
+  return ufApplications.insert(std::make_pair(e, u)).first->second;
+}
+
+/// abstractUF - Return \a e with each application of an uninterpreted
+/// function replaced by its result, registering the applications with the
+/// current query.
+ref<Expr> STPBuilder::abstractUF(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e))
+    return e;
+
+  ExprHashMap< ref<Expr> >::iterator it = ufAbstracted.find(e);
+  if (it != ufAbstracted.end())
+    return it->second;
+
+  ref<Expr> res;
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    UpdateList updates = abstractUFUpdates(re->updates);
+    ref<Expr> index = abstractUF(re->index);
+    if (updates.head == re->updates.head && index == re->index)
+      res = e;
+    else
+      res = ReadExpr::create(updates, index);
   } else {
-    // FIXME: This really needs to be non-recursive.
-    if (!un->stpArray)
-      un->stpArray = vc_writeExpr(vc,
-                                  getArrayForUpdate(root, un->next),
-                                  construct(un->index, 0, etBV),
-                                  construct(un->value, 0, etBV));
+    ref<Expr> kids[8];
+    unsigned numKids = e->getNumKids();
+    bool changed = false;
+    for (unsigned i = 0; i != numKids; ++i) {
+      kids[i] = abstractUF(e->getKid(i));
+      changed |= kids[i] != e->getKid(i);
+    }
+
+    if (isUFKind(e->getKind())) {
+      res = getUFApplication(e, kids).result;
+      queryUFApplications.push_back(e);
+    } else {
+      res = changed ? e->rebuild(kids) : e;
+    }
+  }
+  ufAbstracted.insert(std::make_pair(e, res));
+  return res;
+}
+
+/// abstractUFUpdates - Return \a ul with each application of an
+/// uninterpreted function in its updates replaced by its result,
+/// registering the applications with the current query.
+///
+/// Updates are abstracted once, from the oldest, and the result is kept
+/// with the applications found in each, so that a list abstracted for an
+/// earlier query is reused (together with its STP array) and only has its
+/// applications registered again.
+UpdateList STPBuilder::abstractUFUpdates(const UpdateList &ul) {
+  // Find the updates not yet abstracted, down to one which is (or the end).
+  std::vector<const UpdateNode*> pending;
+  const UpdateNode *un = ul.head;
+  std::tr1::unordered_map<const UpdateNode*, UFUpdate>::iterator it;
+  for (; un; un = un->next) {
+    it = ufUpdates.find(un);
+    if (it != ufUpdates.end())
+      break;
+    pending.push_back(un);
+  }
+
+  UpdateList res(ul.root, 0);
+  bool changed = false;
+  const UpdateNode *older = 0;
+  if (un) {
+    noteUFUpdates(un);
+    changed = it->second.changed;
+    if (changed)
+      res = it->second.abstracted;
+    older = it->second.applications.empty() ? it->second.older : un;
+  }
+
+  // Abstract the rest from the oldest.
+  while (!pending.empty()) {
+    const UpdateNode *next = pending.back();
+    pending.pop_back();
+
+    // Abstract the update apart from the rest of the query, to find the
+    // applications in it alone.
+    std::vector< ref<Expr> > applications;
+    ExprHashMap< ref<Expr> > abstracted;
+    applications.swap(queryUFApplications);
+    abstracted.swap(ufAbstracted);
+    ref<Expr> index = abstractUF(next->index);
+    ref<Expr> value = abstractUF(next->value);
+    applications.swap(queryUFApplications);
+    abstracted.swap(ufAbstracted);
+    noteUFApplications(applications);
+
+    if (!changed && (index != next->index || value != next->value)) {
+      res = UpdateList(ul.root, next->next);
+      changed = true;
+    }
+    if (changed)
+      res.extend(index, value);
+
+    UFUpdate u(changed ? res : UpdateList(ul.root, 0), changed, older);
+    u.applications.swap(applications);
+    if (!u.applications.empty())
+      older = next;
+    ufUpdates.insert(std::make_pair(next, u));
+  }
+
+  return changed ? res : ul;
+}
+
+/// noteUFUpdates - Register the applications in \a un and the updates
+/// older than it with the current query.
+void STPBuilder::noteUFUpdates(const UpdateNode *un) {
+  while (un && ufNotedUpdates.insert(un).second) {
+    const UFUpdate &u = ufUpdates.find(un)->second;
+    noteUFApplications(u.applications);
+    un = u.older;
+  }
+}
 
-    return un->stpArray;
+void STPBuilder::noteUFApplications(const std::vector< ref<Expr> >
+                                      &applications) {
+  for (unsigned i = 0; i != applications.size(); ++i) {
+    const ref<Expr> &e = applications[i];
+    ExprHashMap<UFApplication>::iterator it = ufApplications.find(e);
+    assert(it != ufApplications.end() && "unknown function application");
+    if (ufAbstracted.insert(std::make_pair(e, it->second.result)).second)
+      queryUFApplications.push_back(e);
   }
 }
 
+void STPBuilder::getUFArrays(std::vector<const Array*> &arrays) {
+  for (unsigned i = 0; i != queryUFApplications.size(); ++i)
+    arrays.push_back(ufApplications.find(queryUFApplications[i])->second.array);
+}
+
+static ref<Expr> floatConstant(Expr::Width w, double value) {
+  if (w == Expr::Int32)
+    return ConstantExpr::alloc(llvm::APFloat((float) value));
+  return ConstantExpr::alloc(llvm::APFloat(value));
+}
+
+void STPBuilder::addUFRangeLemmas(const ref<Expr> &e, const UFApplication &u,
+                                  std::vector< ref<Expr> > &lemmas) {
+  Expr::Width w = e->getWidth();
+  if (w != Expr::Int32 && w != Expr::Int64)
+    return;
+
+  float_utilst &f = floatUtils(e);
+  const ref<Expr> &x = u.args[0], &r = u.result;
+  ref<Expr> zero = ConstantExpr::alloc(0, w), one = floatConstant(w, 1.0),
+    minusOne = floatConstant(w, -1.0);
+  ref<Expr> nanIn;
+
+  switch (e->getKind()) {
+  default: assert(0 && "invalid uninterpreted function");
+  case Expr::FSqrt: {
+    nanIn = OrExpr::create(f.is_NaN(x), f.relation(x, float_utilst::LT, zero));
+    lemmas.push_back(Expr::createImplies(f.is_zero(x), EqExpr::create(r, x)));
+    lemmas.push_back(Expr::createImplies(f.is_plus_inf(x), f.is_plus_inf(r)));
+    // sqrt(x) lies between 1 and x.
+    lemmas.push_back(
+      Expr::createImplies(f.relation(x, float_utilst::GE, one),
+                          AndExpr::create(f.relation(r, float_utilst::LE, x),
+                                          f.relation(r, float_utilst::GE, one))));
+    lemmas.push_back(
+      Expr::createImplies(AndExpr::create(f.relation(x, float_utilst::GT, zero),
+                                          f.relation(x, float_utilst::LE, one)),
+                          AndExpr::create(f.relation(r, float_utilst::GE, x),
+                                          f.relation(r, float_utilst::LE, one))));
+    break;
+  }
+
+  case Expr::FSin:
+  case Expr::FCos: {
+    nanIn = OrExpr::create(f.is_NaN(x), f.is_infinity(x));
+    ref<Expr> inRange =
+      AndExpr::create(f.relation(r, float_utilst::GE, minusOne),
+                      f.relation(r, float_utilst::LE, one));
+    if (e->getKind() == Expr::FSin) {
+      // |sin(x)| <= |x|, and sin(+-0) = +-0.
+      inRange = AndExpr::create(inRange,
+                                f.relation(f.abs(r), float_utilst::LE, f.abs(x)));
+      lemmas.push_back(Expr::createImplies(f.is_zero(x), EqExpr::create(r, x)));
+    } else {
+      lemmas.push_back(Expr::createImplies(f.is_zero(x),
+                                           EqExpr::create(r, one)));
+    }
+    lemmas.push_back(Expr::createImplies(Expr::createIsZero(nanIn), inRange));
+    break;
+  }
+
+  case Expr::FRem: {
+    const ref<Expr> &y = u.args[1];
+    nanIn = OrExpr::create(OrExpr::create(f.is_NaN(x), f.is_NaN(y)),
+                           OrExpr::create(f.is_infinity(x), f.is_zero(y)));
+    ref<Expr> notNaN = Expr::createIsZero(nanIn);
+    ref<Expr> absX = f.abs(x), absY = f.abs(y), absR = f.abs(r);
+    // The remainder has the sign of x and is smaller than both operands, and
+    // is x itself when |x| < |y|.
+    lemmas.push_back(
+      Expr::createImplies(notNaN,
+                          AndExpr::create(
+                            AndExpr::create(
+                              f.relation(absR, float_utilst::LT, absY),
+                              f.relation(absR, float_utilst::LE, absX)),
+                            EqExpr::create(f.sign_bit(r), f.sign_bit(x)))));
+    lemmas.push_back(
+      Expr::createImplies(AndExpr::create(notNaN,
+                                          f.relation(absX, float_utilst::LT,
+                                                     absY)),
+                          EqExpr::create(r, x)));
+    break;
+  }
+  }
+
+  lemmas.push_back(EqExpr::create(f.is_NaN(r), nanIn));
+}
+
+void STPBuilder::getUFLemmas(std::vector< ref<Expr> > &lemmas) {
+  for (unsigned i = 0; i != queryUFApplications.size(); ++i) {
+    const ref<Expr> &e = queryUFApplications[i];
+    const UFApplication &u = ufApplications.find(e)->second;
+    addUFRangeLemmas(e, u, lemmas);
+
+    for (unsigned j = 0; j != i; ++j) {
+      const ref<Expr> &other = queryUFApplications[j];
+      if (other->getKind() != e->getKind() ||
+          other->getWidth() != e->getWidth() ||
+          isUFIEEE(other) != isUFIEEE(e))
+        continue;
+      const UFApplication &v = ufApplications.find(other)->second;
+
+      ref<Expr> sameArgs = ConstantExpr::alloc(1, Expr::Bool);
+      for (unsigned k = 0; k != u.args.size(); ++k)
+        sameArgs = AndExpr::create(sameArgs,
+                                   EqExpr::create(u.args[k], v.args[k]));
+      lemmas.push_back(Expr::createImplies(sameArgs,
+                                           EqExpr::create(u.result, v.result)));
+
+      Expr::Width w = e->getWidth();
+      if (e->getKind() != Expr::FSqrt || (w != Expr::Int32 && w != Expr::Int64))
+        continue;
+      float_utilst &f = floatUtils(e);
+      ref<Expr> zero = ConstantExpr::alloc(0, w);
+      for (unsigned k = 0; k != 2; ++k) {
+        const UFApplication &lo = k ? v : u, &hi = k ? u : v;
+        lemmas.push_back(
+          Expr::createImplies(
+            AndExpr::create(f.relation(lo.args[0], float_utilst::GE, zero),
+                            f.relation(lo.args[0], float_utilst::LE,
+                                       hi.args[0])),
+            f.relation(lo.result, float_utilst::LE, hi.result)));
+      }
+    }
+  }
+}
+
+bool STPBuilder::refineUF(Assignment &a, std::vector< ref<Expr> > &lemmas) {
+  bool refined = false;
+  for (unsigned i = 0; i != queryUFApplications.size(); ++i) {
+    const ref<Expr> &e = queryUFApplications[i];
+    const UFApplication &u = ufApplications.find(e)->second;
+
+    ref<ConstantExpr> args[2];
+    ref<Expr> atModel = ConstantExpr::alloc(1, Expr::Bool);
+    for (unsigned k = 0; k != u.args.size(); ++k) {
+      args[k] = dyn_cast<ConstantExpr>(a.evaluate(u.args[k]));
+      assert(!args[k].isNull() && "model does not bind all operands");
+      atModel = AndExpr::create(atModel, EqExpr::create(u.args[k], args[k]));
+    }
+
+    bool isIEEE = isUFIEEE(e);
+    ref<ConstantExpr> expected;
+    switch (e->getKind()) {
+    default: assert(0 && "invalid uninterpreted function");
+    case Expr::FSqrt: expected = args[0]->FSqrt(isIEEE); break;
+    case Expr::FSin: expected = args[0]->FSin(isIEEE); break;
+    case Expr::FCos: expected = args[0]->FCos(isIEEE); break;
+    case Expr::FRem: expected = args[0]->FRem(args[1], isIEEE); break;
+    }
+
+    ref<ConstantExpr> actual = dyn_cast<ConstantExpr>(a.evaluate(u.result));
+    assert(!actual.isNull() && "model does not bind the function result");
+    if (actual->getAPValue() == expected->getAPValue())
+      continue;
+
+    lemmas.push_back(Expr::createImplies(atModel,
+                                         EqExpr::create(u.result, expected)));
+    refined = true;
+  }
+  return refined;
+}
 
 /** if *et_out==etBV then result is a bitvector,
     otherwise it is a bool */
@@ -539,10 +950,13 @@ ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out, STPExprType
 
   case Expr::Read: {
     ReadExpr *re = cast<ReadExpr>(e);
+    // Build the updates with their function applications abstracted, so
+    // they are registered with every query using the array.
+    UpdateList updates = abstractUFUpdates(re->updates);
     *width_out = 8;
     *et_out = etBV;
     return vc_readExpr(vc,
-                       getArrayForUpdate(re->updates.root, re->updates.head),
+                       getArrayForUpdate(updates.root, updates.head),
                        construct(re->index, 0, etBV));
   }
     
@@ -1048,6 +1462,12 @@ ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out, STPExprType
     return constructActual(res, width_out, et_out);
   }
 
+  case Expr::FSqrt:
+  case Expr::FSin:
+  case Expr::FCos:
+  case Expr::FRem:
+    return construct(abstractUF(e), width_out, et_out);
+
   default: 
     assert(0 && "unhandled Expr type");
     *et_out = etBOOL;
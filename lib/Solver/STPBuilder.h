@@ -10,11 +10,14 @@
 #ifndef __UTIL_STPBUILDER_H__
 #define __UTIL_STPBUILDER_H__
 
+#include "klee/ExprContext.h"
 #include "klee/util/ExprHashMap.h"
 #include "klee/Config/config.h"
 
 #include <vector>
 #include <map>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
 
 #define Expr VCExpr
 #include <stp/c_interface.h>
@@ -27,6 +30,8 @@
 #include "float_utils.h"
 
 namespace klee {
+  class Assignment;
+
   class ExprHolder {
     friend class ExprHandle;
     ::VCExpr expr;
@@ -59,7 +64,7 @@ namespace klee {
     operator ::VCExpr () { return H->expr; }
   };
 
-class STPBuilder {
+class STPBuilder : public ExprCache {
   enum STPExprType {
     etBV,
     etBOOL,
@@ -77,6 +82,11 @@ class STPBuilder {
   };
   ExprHashMap<ConstructedExpr> constructed;
 
+  /// The STP arrays for arrays and update nodes, which live as long as
+  /// they do (see ExprCache).
+  std::tr1::unordered_map<const Array*, ::VCExpr> initialArrays;
+  std::tr1::unordered_map<const UpdateNode*, ::VCExpr> updateArrays;
+
   /// optimizeDivides - Rewrite division and reminders by constants
   /// into multiplies and shifts. STP should probably handle this for
   /// use.
@@ -88,6 +98,49 @@ class STPBuilder {
   propt prop;
   float_utilst spfloat, dpfloat;
 
+  /// Floating point operations with no bit-level encoding (FSqrt, FSin, FCos
+  /// and FRem) are abstracted as uninterpreted functions: each distinct
+  /// application is replaced by a read of a fresh array, constrained by the
+  /// lemmas from getUFLemmas and refined lazily by refineUF once a candidate
+  /// model is known.
+  struct UFApplication {
+    const Array *array;
+    /// The read standing for the result of the application.
+    ref<Expr> result;
+    /// The operands, with any nested applications already abstracted.
+    std::vector< ref<Expr> > args;
+  };
+  ExprHashMap<UFApplication> ufApplications;
+  std::vector<const Array*> ufArrays;
+  /// The number of arrays created for applications, which keeps their STP
+  /// names unique across clear.
+  unsigned ufCount;
+
+  /// The applications constructed since the last resetUFApplications, in
+  /// order, and the abstracted form of the expressions visited meanwhile.
+  std::vector< ref<Expr> > queryUFApplications;
+  ExprHashMap< ref<Expr> > ufAbstracted;
+
+  /// For each update built, the list up to it with the applications in the
+  /// updates abstracted (if that changed anything), the applications in its
+  /// own index and value, and the latest older update with applications.
+  /// They live as long as the update (see ExprCache), so that the update
+  /// arrays built for an earlier query are reused along with the
+  /// applications they depend on.
+  struct UFUpdate {
+    UFUpdate(const UpdateList &abstracted, bool changed,
+             const UpdateNode *older)
+      : abstracted(abstracted), changed(changed), older(older) {}
+    UpdateList abstracted;
+    bool changed;
+    std::vector< ref<Expr> > applications;
+    const UpdateNode *older;
+  };
+  std::tr1::unordered_map<const UpdateNode*, UFUpdate> ufUpdates;
+  /// The updates whose applications (and those of the older updates) are
+  /// registered with the current query.
+  std::tr1::unordered_set<const UpdateNode*> ufNotedUpdates;
+
 private:
   unsigned getShiftBits(unsigned amount) {
     unsigned bits = 1;
@@ -129,6 +182,14 @@ private:
   ExprHandle construct(ref<Expr> e, int *width_out, STPExprType *et_out);
   ExprHandle construct(ref<Expr> e, int *width_out, STPExprType et_out);
   
+  ref<Expr> abstractUF(const ref<Expr> &e);
+  UpdateList abstractUFUpdates(const UpdateList &ul);
+  void noteUFUpdates(const UpdateNode *un);
+  const UFApplication &getUFApplication(const ref<Expr> &e,
+                                        const ref<Expr> *args);
+  void addUFRangeLemmas(const ref<Expr> &e, const UFApplication &u,
+                        std::vector< ref<Expr> > &lemmas);
+
   ::VCExpr buildVar(const char *name, unsigned width);
   ::VCExpr buildArray(const char *name, unsigned indexWidth, unsigned valueWidth);
 
@@ -150,6 +211,10 @@ public:
   STPBuilder(::VC _vc, bool _optimizeDivides=true);
   ~STPBuilder();
 
+  void clear();
+  void forgetUpdate(const UpdateNode *un);
+  void forgetArray(const Array *array);
+
   ExprHandle getTrue();
   ExprHandle getFalse();
   ExprHandle getTempVar(Expr::Width w);
@@ -160,6 +225,47 @@ public:
     constructed.clear();
     return res;
   }
+
+  /// resetUFApplications - Start tracking uninterpreted function
+  /// applications for a new query.
+  void resetUFApplications() {
+    queryUFApplications.clear();
+    ufAbstracted.clear();
+    ufNotedUpdates.clear();
+  }
+
+  /// hasUFApplications - Whether any expression constructed since the last
+  /// reset was abstracted as an uninterpreted function.
+  bool hasUFApplications() const { return !queryUFApplications.empty(); }
+
+  /// getQueryUFApplications - The applications constructed since the last
+  /// reset, in the order they were constructed.
+  const std::vector< ref<Expr> > &getQueryUFApplications() const {
+    return queryUFApplications;
+  }
+
+  /// noteUFApplications - Track applications constructed for an earlier
+  /// query as part of the current one, for formulas which are still
+  /// asserted.
+  void noteUFApplications(const std::vector< ref<Expr> > &applications);
+
+  /// getUFArrays - Append the arrays standing for the results of the
+  /// applications in the current query.
+  void getUFArrays(std::vector<const Array*> &arrays);
+
+  /// getUFLemmas - Compute the lemmas constraining the applications in the
+  /// current query: functional consistency (Ackermann) for each pair of
+  /// applications of the same function, monotonicity of square root, and
+  /// the NaN behaviour and range of each function.
+  void getUFLemmas(std::vector< ref<Expr> > &lemmas);
+
+  /// refineUF - Check the applications in the current query against their
+  /// concrete semantics under the candidate model \a a, which must bind the
+  /// arrays from getUFArrays. For each application whose abstract result is
+  /// wrong, add a lemma fixing its result at the model's operands.
+  ///
+  /// \return True if any lemmas were added, i.e. the model was spurious.
+  bool refineUF(Assignment &a, std::vector< ref<Expr> > &lemmas);
 };
 
 }
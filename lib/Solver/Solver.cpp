@@ -12,6 +12,7 @@
 
 #include "SolverStats.h"
 #include "STPBuilder.h"
+#include "SolverWorkerPool.h"
 
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
@@ -21,11 +22,14 @@
 #include "klee/util/ExprUtil.h"
 #include "klee/Internal/Support/Timer.h"
 
+#include "llvm/Support/CommandLine.h"
+
 #define vc_bvBoolExtract IAMTHESPAWNOFSATAN
 
 #include <cassert>
 #include <cstdio>
 #include <map>
+#include <set>
 #include <vector>
 #include <iostream>
 
@@ -38,6 +42,29 @@
 
 using namespace klee;
 
+namespace {
+  llvm::cl::opt<unsigned>
+  MaxUFRefinements("max-uf-refinements",
+                   llvm::cl::desc("Number of times a query with uninterpreted "
+                                  "FP functions is refined before giving up "
+                                  "(default=16)"),
+                   llvm::cl::init(16));
+
+  llvm::cl::opt<unsigned>
+  STPWorkers("stp-workers",
+             llvm::cl::desc("Number of long-lived STP worker processes used "
+                            "with -use-forked-stp, 0 forks for every query "
+                            "(default=0)"),
+             llvm::cl::init(0));
+
+  llvm::cl::opt<bool>
+  IncrementalSTP("incremental-stp",
+                 llvm::cl::desc("Keep the constraints of the last query "
+                                "asserted in STP and only assert the ones "
+                                "a query adds to them (default=off)"),
+                 llvm::cl::init(false));
+}
+
 /***/
 
 void Query::dump(std::ostream &out) const {
@@ -454,7 +481,10 @@ Solver *klee::createDummySolver() {
 
 /***/
 
-class STPSolverImpl : public SolverImpl {
+/// STPSolverImpl - The STP solver. It is an ExprCache so that the
+/// constraints left asserted, which refer to what the builder keeps, are
+/// retracted when the builder is cleared.
+class STPSolverImpl : public SolverImpl, public ExprCache {
 private:
   /// The solver we are part of, for access to public information.
   STPSolver *solver;
@@ -463,11 +493,24 @@ private:
   double timeout;
   bool useForkedSTP;
   SolverRunStatus runStatusCode;
+  /// Long-lived processes which solve the queries when forking, if any.
+  SolverWorkerPool *workerPool;
+
+  /// The constraints left asserted by earlier queries, each in a context
+  /// level of its own, and the uninterpreted function applications
+  /// constructed for each of them.
+  std::vector< ref<Expr> > assertedConstraints;
+  std::vector< std::vector< ref<Expr> > > assertedUFApplications;
+
+  void popConstraints(unsigned level);
+  void assertConstraints(const ConstraintManager &constraints);
 
 public:
   STPSolverImpl(STPSolver *_solver, bool _useForkedSTP, bool _optimizeDivides = true);
   ~STPSolverImpl();
 
+  void clear() { popConstraints(0); }
+
   char *getConstraintLog(const Query&);
   void setTimeout(double _timeout) { timeout = _timeout; }
 
@@ -495,7 +538,8 @@ STPSolverImpl::STPSolverImpl(STPSolver *_solver, bool _useForkedSTP, bool _optim
     builder(new STPBuilder(vc, _optimizeDivides)),
     timeout(0.0),
     useForkedSTP(_useForkedSTP),
-    runStatusCode(SOLVER_RUN_STATUS_FAILURE)
+    runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+    workerPool(0)
 {
   assert(vc && "unable to create validity checker");
   assert(builder && "unable to create STPBuilder");
@@ -510,16 +554,23 @@ STPSolverImpl::STPSolverImpl(STPSolver *_solver, bool _useForkedSTP, bool _optim
 
   vc_registerErrorHandler(::stp_error_handler);
 
-  if (useForkedSTP) {
+  if (useForkedSTP && STPWorkers) {
+    workerPool = new SolverWorkerPool(STPWorkers,
+                                      new STPSolver(false, _optimizeDivides));
+  } else if (useForkedSTP) {
     shared_memory_id = shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
     assert(shared_memory_id>=0 && "shmget failed");
     shared_memory_ptr = (unsigned char*) shmat(shared_memory_id, NULL, 0);
     assert(shared_memory_ptr!=(void*)-1 && "shmat failed");
     shmctl(shared_memory_id, IPC_RMID, NULL);
   }
+
+  ExprContext::get().registerCache(this);
 }
 
 STPSolverImpl::~STPSolverImpl() {
+  ExprContext::get().unregisterCache(this);
+  delete workerPool;
   delete builder;
 
   vc_Destroy(vc);
@@ -543,8 +594,9 @@ void STPSolver::setTimeout(double timeout) {
 /***/
 
 char *STPSolverImpl::getConstraintLog(const Query &query) {
+  popConstraints(0);
   vc_push(vc);
-  for (std::vector< ref<Expr> >::const_iterator it = query.constraints.begin(), 
+  for (ConstraintManager::const_iterator it = query.constraints.begin(), 
          ie = query.constraints.end(); it != ie; ++it)
     vc_assertFormula(vc, builder->construct(*it));
   assert(query.expr == ConstantExpr::alloc(0, Expr::Bool) &&
@@ -592,6 +644,46 @@ bool STPSolverImpl::computeValue(const Query& query,
   return true;
 }
 
+/// popConstraints - Retract the asserted constraints from \a level on.
+void STPSolverImpl::popConstraints(unsigned level) {
+  while (assertedConstraints.size() > level) {
+    vc_pop(vc);
+    assertedConstraints.pop_back();
+    assertedUFApplications.pop_back();
+  }
+}
+
+/// assertConstraints - Make \a constraints the asserted constraints, keeping
+/// the longest prefix they share with the ones already asserted.
+///
+/// Successive queries along a path share all but their last few
+/// constraints, so only those have to be constructed and asserted. A query
+/// from another state retracts constraints back to the point where the
+/// paths diverged.
+void STPSolverImpl::assertConstraints(const ConstraintManager &constraints) {
+  unsigned level = 0;
+  ConstraintManager::const_iterator it = constraints.begin(),
+    ie = constraints.end();
+  for (; it != ie && level != assertedConstraints.size(); ++it, ++level)
+    if (*it != assertedConstraints[level])
+      break;
+  popConstraints(level);
+
+  for (unsigned i = 0; i != level; ++i)
+    builder->noteUFApplications(assertedUFApplications[i]);
+
+  for (; it != ie; ++it) {
+    unsigned numApplications = builder->getQueryUFApplications().size();
+    vc_push(vc);
+    vc_assertFormula(vc, builder->construct(*it));
+    const std::vector< ref<Expr> > &applications =
+      builder->getQueryUFApplications();
+    assertedConstraints.push_back(*it);
+    assertedUFApplications.push_back(std::vector< ref<Expr> >(
+        applications.begin() + numApplications, applications.end()));
+  }
+}
+
 static SolverImpl::SolverRunStatus runAndGetCex(::VC vc, STPBuilder *builder, ::VCExpr q,
                                                 const std::vector<const Array*> &objects,
                                                 std::vector< std::vector<unsigned char> > &values,
@@ -739,11 +831,32 @@ STPSolverImpl::computeInitialValues(const Query &query,
     
   TimerStatIncrementer t(stats::queryTime);
 
-  vc_push(vc);
+  if (workerPool) {
+    ++stats::queries;
+    ++stats::queryCounterexamples;
 
-  for (ConstraintManager::const_iterator it = query.constraints.begin(), 
-         ie = query.constraints.end(); it != ie; ++it)
-    vc_assertFormula(vc, builder->construct(*it));
+    runStatusCode = workerPool->computeInitialValues(query, objects, values,
+                                                     hasSolution, timeout);
+    if (SOLVER_RUN_STATUS_SUCCESS_SOLVABLE == runStatusCode)
+      ++stats::queriesInvalid;
+    else if (SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE == runStatusCode)
+      ++stats::queriesValid;
+    else
+      return false;
+    return true;
+  }
+
+  builder->resetUFApplications();
+
+  if (IncrementalSTP) {
+    assertConstraints(query.constraints);
+    vc_push(vc);
+  } else {
+    vc_push(vc);
+    for (ConstraintManager::const_iterator it = query.constraints.begin(), 
+           ie = query.constraints.end(); it != ie; ++it)
+      vc_assertFormula(vc, builder->construct(*it));
+  }
   
   ++stats::queries;
   ++stats::queryCounterexamples;
@@ -757,16 +870,62 @@ STPSolverImpl::computeInitialValues(const Query &query,
     fprintf(stderr, "note: STP query: %.*s\n", (unsigned) len, buf);
   }
 
+  // With uninterpreted functions in the query, a model has to be checked
+  // against the concrete semantics of the functions, which needs values for
+  // every object and function result in the query.
+  std::vector<const Array*> queryObjects(objects);
+  if (builder->hasUFApplications()) {
+    std::vector< ref<Expr> > lemmas;
+    builder->getUFLemmas(lemmas);
+    for (unsigned i = 0; i != lemmas.size(); ++i)
+      vc_assertFormula(vc, builder->construct(lemmas[i]));
+
+    std::vector< ref<Expr> > exprs(query.constraints.begin(),
+                                   query.constraints.end());
+    exprs.push_back(query.expr);
+    std::vector<const Array*> used;
+    findSymbolicObjects(exprs.begin(), exprs.end(), used);
+    std::set<const Array*> requested(objects.begin(), objects.end());
+    for (unsigned i = 0; i != used.size(); ++i)
+      if (requested.insert(used[i]).second)
+        queryObjects.push_back(used[i]);
+    builder->getUFArrays(queryObjects);
+  }
+
   bool success;
-  if (useForkedSTP) {
-    runStatusCode = runAndGetCexForked(vc, builder, stp_e, objects, values, 
-                                       hasSolution, timeout);
-    success = ((SOLVER_RUN_STATUS_SUCCESS_SOLVABLE == runStatusCode) ||
-               (SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE == runStatusCode));    
-  } else {
-    runStatusCode = runAndGetCex(vc, builder, stp_e, objects, values, hasSolution);    
-    success = true;
+  for (unsigned refinements = 0;; ++refinements) {
+    values.clear();
+    if (useForkedSTP) {
+      runStatusCode = runAndGetCexForked(vc, builder, stp_e, queryObjects,
+                                         values, hasSolution, timeout);
+      success = ((SOLVER_RUN_STATUS_SUCCESS_SOLVABLE == runStatusCode) ||
+                 (SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE == runStatusCode));    
+    } else {
+      runStatusCode = runAndGetCex(vc, builder, stp_e, queryObjects, values,
+                                   hasSolution);    
+      success = true;
+    }
+
+    if (!success || !hasSolution || !builder->hasUFApplications())
+      break;
+
+    Assignment a(queryObjects, values);
+    std::vector< ref<Expr> > lemmas;
+    if (!builder->refineUF(a, lemmas))
+      break;
+
+    // The model relied on a wrong function result; rule it out and retry.
+    ++stats::queryUFRefinements;
+    if (refinements == MaxUFRefinements) {
+      runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+      success = false;
+      break;
+    }
+    for (unsigned i = 0; i != lemmas.size(); ++i)
+      vc_assertFormula(vc, builder->construct(lemmas[i]));
   }
+  if (success && hasSolution)
+    values.resize(objects.size());
   
   if (success) {
     if (hasSolution)
@@ -11,7 +11,14 @@
 
 using namespace klee;
 
+Statistic stats::cexCacheHits("CexCacheHits", "CChits");
+Statistic stats::cexCacheLookupNodes("CexCacheLookupNodes", "CCnodes");
+Statistic stats::cexCacheMisses("CexCacheMisses", "CCmisses");
 Statistic stats::cexCacheTime("CexCacheTime", "CCtime");
+Statistic stats::fpLocalSearchHits("FPLocalSearchHits", "FPLShits");
+Statistic stats::fpLocalSearchTime("FPLocalSearchTime", "FPLStime");
+Statistic stats::modelSamplingHits("ModelSamplingHits", "MShits");
+Statistic stats::modelSamplingTime("ModelSamplingTime", "MStime");
 Statistic stats::queries("Queries", "Q");
 Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
 Statistic stats::queriesValid("QueriesValid", "Qv");
@@ -20,4 +27,8 @@ Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
+Statistic stats::queryPersistentCacheHits("QueryPersistentCacheHits", "QPChits");
+Statistic stats::queryPersistentCacheMisses("QueryPersistentCacheMisses",
+                                            "QPCmisses");
 Statistic stats::queryTime("QueryTime", "Qtime");
+Statistic stats::queryUFRefinements("QueryUFRefinements", "QUFref");
@@ -15,7 +15,14 @@
 namespace klee {
 namespace stats {
 
+  extern Statistic cexCacheHits;
+  extern Statistic cexCacheLookupNodes;
+  extern Statistic cexCacheMisses;
   extern Statistic cexCacheTime;
+  extern Statistic fpLocalSearchHits;
+  extern Statistic fpLocalSearchTime;
+  extern Statistic modelSamplingHits;
+  extern Statistic modelSamplingTime;
   extern Statistic queries;
   extern Statistic queriesInvalid;
   extern Statistic queriesValid;
@@ -24,7 +31,10 @@ namespace stats {
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
   extern Statistic queryTime;
+  extern Statistic queryUFRefinements;
 
 }
 }
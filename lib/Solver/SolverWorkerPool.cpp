@@ -0,0 +1,728 @@
+//===-- SolverWorkerPool.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SolverWorkerPool.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/ExprContext.h"
+#include "klee/Solver.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/Internal/Support/Timer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace klee;
+
+/***/
+
+// Queries are sent to workers as a sequence of records, each of which may
+// only refer to earlier records: arrays, update lists (oldest update first)
+// and expressions (kids first). Expressions are rebuilt with alloc() so the
+// worker solves exactly the query it was given.
+
+namespace {
+  enum RecordKind { ArrayRecord, UpdateListRecord, ExprRecord, QueryRecord };
+
+  class QueryWriter {
+    std::string &out;
+    ExprHashMap<unsigned> exprIds;
+    std::map<const Array*, unsigned> arrayIds;
+    std::map<std::pair<const Array*, const UpdateNode*>, unsigned> listIds;
+    unsigned numExprs;
+
+    void write(uint64_t value) {
+      out.append((const char*) &value, sizeof(value));
+    }
+
+    unsigned writeArray(const Array *array);
+    unsigned writeUpdateList(const UpdateList &ul);
+
+  public:
+    QueryWriter(std::string &_out) : out(_out), numExprs(0) {}
+
+    unsigned writeExpr(const ref<Expr> &e);
+    void writeQuery(const Query &query,
+                    const std::vector<const Array*> &objects);
+  };
+
+  class QueryReader {
+    const std::string &in;
+    size_t pos;
+    std::vector< ref<Expr> > exprs;
+    std::vector<UpdateList> lists;
+
+    /// The arrays read, which the caller owns. They must outlive the
+    /// expressions read (and what the solver keeps for them).
+    std::vector<const Array*> &arrays;
+
+    uint64_t read() {
+      uint64_t value = 0;
+      if (pos + sizeof(value) <= in.size())
+        memcpy(&value, in.data() + pos, sizeof(value));
+      pos += sizeof(value);
+      return value;
+    }
+
+    void readArray();
+    void readUpdateList();
+    void readExpr();
+
+  public:
+    QueryReader(const std::string &_in, std::vector<const Array*> &_arrays)
+      : in(_in), pos(0), arrays(_arrays) {}
+
+    bool readQuery(std::vector< ref<Expr> > &constraints, ref<Expr> &expr,
+                   std::vector<const Array*> &objects);
+  };
+}
+
+unsigned QueryWriter::writeArray(const Array *array) {
+  std::map<const Array*, unsigned>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+
+  std::vector<unsigned> constants;
+  for (unsigned i = 0; i != array->constantValues.size(); ++i)
+    constants.push_back(writeExpr(array->constantValues[i]));
+
+  write(ArrayRecord);
+  write((uint64_t) (uintptr_t) array);
+  write(array->name.size());
+  out.append(array->name);
+  write(array->size);
+  write(array->domain);
+  write(array->range);
+  write(constants.size());
+  for (unsigned i = 0; i != constants.size(); ++i)
+    write(constants[i]);
+
+  unsigned id = arrayIds.size();
+  arrayIds.insert(std::make_pair(array, id));
+  return id;
+}
+
+unsigned QueryWriter::writeUpdateList(const UpdateList &ul) {
+  std::pair<const Array*, const UpdateNode*> key(ul.root, ul.head);
+  std::map<std::pair<const Array*, const UpdateNode*>, unsigned>::iterator
+    it = listIds.find(key);
+  if (it != listIds.end())
+    return it->second;
+
+  unsigned root = writeArray(ul.root);
+  std::vector<const UpdateNode*> updates;
+  for (const UpdateNode *un = ul.head; un; un = un->next)
+    updates.push_back(un);
+
+  std::vector<unsigned> kids;
+  for (unsigned i = updates.size(); i != 0; --i) {
+    kids.push_back(writeExpr(updates[i - 1]->index));
+    kids.push_back(writeExpr(updates[i - 1]->value));
+  }
+
+  write(UpdateListRecord);
+  write(root);
+  write(updates.size());
+  for (unsigned i = 0; i != kids.size(); ++i)
+    write(kids[i]);
+
+  unsigned id = listIds.size();
+  listIds.insert(std::make_pair(key, id));
+  return id;
+}
+
+unsigned QueryWriter::writeExpr(const ref<Expr> &e) {
+  ExprHashMap<unsigned>::iterator it = exprIds.find(e);
+  if (it != exprIds.end())
+    return it->second;
+
+  unsigned list = 0;
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e))
+    list = writeUpdateList(re->updates);
+
+  std::vector<unsigned> kids;
+  for (unsigned i = 0; i != e->getNumKids(); ++i)
+    kids.push_back(writeExpr(e->getKid(i)));
+
+  write(ExprRecord);
+  write(e->getKind());
+  write(kids.size());
+  for (unsigned i = 0; i != kids.size(); ++i)
+    write(kids[i]);
+
+  // The rest of the expression.
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const llvm::APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    write(value.getBitWidth());
+    write(value.getNumWords());
+    for (unsigned i = 0; i != value.getNumWords(); ++i)
+      write(value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read:
+    write(list);
+    break;
+  case Expr::Extract:
+    write(cast<ExtractExpr>(e)->offset);
+    write(cast<ExtractExpr>(e)->width);
+    break;
+  case Expr::ZExt:
+  case Expr::SExt:
+    write(cast<CastExpr>(e)->width);
+    break;
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+    // Workers are forks of this process, so the semantics are at the same
+    // address there.
+    write((uint64_t) (uintptr_t) cast<FConvertExpr>(e)->getSemantics());
+    break;
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+    write((uint64_t) (uintptr_t) cast<F2FConvertExpr>(e)->getSemantics());
+    write(cast<F2FConvertExpr>(e)->fromIsIEEE());
+    break;
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+    write(e->getWidth());
+    write(cast<F2IConvertExpr>(e)->fromIsIEEE());
+    write(cast<F2IConvertExpr>(e)->roundNearest());
+    break;
+  case Expr::FOrd1:
+    write(cast<FOrd1Expr>(e)->isIEEE());
+    break;
+  case Expr::FSqrt:
+  case Expr::FCos:
+  case Expr::FSin:
+    write(cast<FUnaryExpr>(e)->isIEEE());
+    break;
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FRem:
+    write(cast<FBinaryExpr>(e)->isIEEE());
+    break;
+  case Expr::FCmp:
+    write(cast<FCmpExpr>(e)->isIEEE());
+    break;
+  case Expr::Any:
+    write(e->getWidth());
+    write(cast<AnyExpr>(e)->getKey());
+    break;
+  default:
+    break;
+  }
+
+  unsigned id = numExprs++;
+  exprIds.insert(std::make_pair(e, id));
+  return id;
+}
+
+void QueryWriter::writeQuery(const Query &query,
+                             const std::vector<const Array*> &objects) {
+  std::vector<unsigned> constraints;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it)
+    constraints.push_back(writeExpr(*it));
+  unsigned expr = writeExpr(query.expr);
+  std::vector<unsigned> arrays;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    arrays.push_back(writeArray(objects[i]));
+
+  write(QueryRecord);
+  write(constraints.size());
+  for (unsigned i = 0; i != constraints.size(); ++i)
+    write(constraints[i]);
+  write(expr);
+  write(arrays.size());
+  for (unsigned i = 0; i != arrays.size(); ++i)
+    write(arrays[i]);
+}
+
+void QueryReader::readArray() {
+  read(); // The key, which only tells arrays apart in the parent.
+  std::string name = in.substr(pos, read());
+  pos += name.size();
+  unsigned size = read();
+  Expr::Width domain = read();
+  Expr::Width range = read();
+  std::vector< ref<ConstantExpr> > constants;
+  for (unsigned i = 0, e = read(); i != e; ++i)
+    constants.push_back(cast<ConstantExpr>(exprs[read()]));
+
+  arrays.push_back(new Array(name, size,
+                             constants.empty() ? 0 : &constants[0],
+                             constants.empty() ? 0 :
+                               &constants[0] + constants.size(),
+                             domain, range));
+}
+
+void QueryReader::readUpdateList() {
+  UpdateList ul(arrays[read()], 0);
+  for (unsigned i = 0, e = read(); i != e; ++i) {
+    ref<Expr> index = exprs[read()];
+    ul.extend(index, exprs[read()]);
+  }
+  lists.push_back(ul);
+}
+
+void QueryReader::readExpr() {
+  Expr::Kind kind = (Expr::Kind) read();
+  ref<Expr> kids[3];
+  for (unsigned i = 0, e = read(); i != e; ++i)
+    kids[i] = exprs[read()];
+
+  switch (kind) {
+  case Expr::Constant: {
+    unsigned width = read();
+    std::vector<uint64_t> words;
+    for (unsigned i = 0, e = read(); i != e; ++i)
+      words.push_back(read());
+    exprs.push_back(ConstantExpr::alloc(llvm::APInt(width, words.size(),
+                                                    &words[0])));
+    return;
+  }
+  case Expr::Any: {
+    Expr::Width width = read();
+    exprs.push_back(AnyExpr::alloc(width, read()));
+    return;
+  }
+  default:
+    break;
+  }
+
+  ref<Expr> e;
+  switch (kind) {
+  case Expr::NotOptimized: e = NotOptimizedExpr::alloc(kids[0]); break;
+  case Expr::Read: e = ReadExpr::alloc(lists[read()], kids[0]); break;
+  case Expr::Select: e = SelectExpr::alloc(kids[0], kids[1], kids[2]); break;
+  case Expr::Concat: e = ConcatExpr::alloc(kids[0], kids[1]); break;
+  case Expr::Extract: {
+    unsigned offset = read();
+    e = ExtractExpr::alloc(kids[0], offset, read());
+    break;
+  }
+  case Expr::ZExt: e = ZExtExpr::alloc(kids[0], read()); break;
+  case Expr::SExt: e = SExtExpr::alloc(kids[0], read()); break;
+  case Expr::UIToFP:
+    e = UIToFPExpr::alloc(kids[0], (const llvm::fltSemantics*) (uintptr_t) read());
+    break;
+  case Expr::SIToFP:
+    e = SIToFPExpr::alloc(kids[0], (const llvm::fltSemantics*) (uintptr_t) read());
+    break;
+  case Expr::FPExt:
+  case Expr::FPTrunc: {
+    const llvm::fltSemantics *sem = (const llvm::fltSemantics*) (uintptr_t) read();
+    bool fromIsIEEE = read();
+    e = (kind == Expr::FPExt) ? FPExtExpr::alloc(kids[0], sem, fromIsIEEE)
+                              : FPTruncExpr::alloc(kids[0], sem, fromIsIEEE);
+    break;
+  }
+  case Expr::FPToUI:
+  case Expr::FPToSI: {
+    Expr::Width width = read();
+    bool fromIsIEEE = read();
+    bool roundNearest = read();
+    e = (kind == Expr::FPToUI)
+      ? FPToUIExpr::alloc(kids[0], width, fromIsIEEE, roundNearest)
+      : FPToSIExpr::alloc(kids[0], width, fromIsIEEE, roundNearest);
+    break;
+  }
+  case Expr::FOrd1: e = FOrd1Expr::alloc(kids[0], read()); break;
+  case Expr::FSqrt: e = FSqrtExpr::alloc(kids[0], read()); break;
+  case Expr::FCos: e = FCosExpr::alloc(kids[0], read()); break;
+  case Expr::FSin: e = FSinExpr::alloc(kids[0], read()); break;
+  case Expr::Not: e = NotExpr::alloc(kids[0]); break;
+
+#define INT_BINARY_CASE(T) \
+  case Expr::T: e = T ## Expr::alloc(kids[0], kids[1]); break;
+#define FLOAT_BINARY_CASE(T) \
+  case Expr::T: e = T ## Expr::alloc(kids[0], kids[1], read()); break;
+
+  INT_BINARY_CASE(Add) INT_BINARY_CASE(Sub) INT_BINARY_CASE(Mul)
+  INT_BINARY_CASE(UDiv) INT_BINARY_CASE(SDiv)
+  INT_BINARY_CASE(URem) INT_BINARY_CASE(SRem)
+  INT_BINARY_CASE(And) INT_BINARY_CASE(Or) INT_BINARY_CASE(Xor)
+  INT_BINARY_CASE(Shl) INT_BINARY_CASE(LShr) INT_BINARY_CASE(AShr)
+  INT_BINARY_CASE(Eq) INT_BINARY_CASE(Ne)
+  INT_BINARY_CASE(Ult) INT_BINARY_CASE(Ule)
+  INT_BINARY_CASE(Ugt) INT_BINARY_CASE(Uge)
+  INT_BINARY_CASE(Slt) INT_BINARY_CASE(Sle)
+  INT_BINARY_CASE(Sgt) INT_BINARY_CASE(Sge)
+  FLOAT_BINARY_CASE(FAdd) FLOAT_BINARY_CASE(FSub) FLOAT_BINARY_CASE(FMul)
+  FLOAT_BINARY_CASE(FDiv) FLOAT_BINARY_CASE(FRem)
+
+#undef INT_BINARY_CASE
+#undef FLOAT_BINARY_CASE
+
+  case Expr::FCmp:
+    e = FCmpExpr::alloc(kids[0], kids[1], kids[2], read());
+    break;
+  default:
+    assert(0 && "invalid expression kind in serialized query");
+  }
+  exprs.push_back(e);
+}
+
+bool QueryReader::readQuery(std::vector< ref<Expr> > &constraints,
+                            ref<Expr> &expr,
+                            std::vector<const Array*> &objects) {
+  while (pos < in.size()) {
+    switch (read()) {
+    case ArrayRecord: readArray(); break;
+    case UpdateListRecord: readUpdateList(); break;
+    case ExprRecord: readExpr(); break;
+    case QueryRecord:
+      for (unsigned i = 0, e = read(); i != e; ++i)
+        constraints.push_back(exprs[read()]);
+      expr = exprs[read()];
+      for (unsigned i = 0, e = read(); i != e; ++i)
+        objects.push_back(arrays[read()]);
+      return pos == in.size();
+    default:
+      return false;
+    }
+  }
+  return false;
+}
+
+/***/
+
+/// waitFor - Wait until \a fd is ready for \a events or \a deadline (in
+/// microseconds of \a timer) has passed. Returns false on timeout or error.
+static bool waitFor(int fd, short events, WallTimer *timer,
+                    uint64_t deadline) {
+  for (;;) {
+    uint64_t now = timer->check();
+    if (now >= deadline)
+      return false;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    int n = poll(&pfd, 1, (int) ((deadline - now) / 1000) + 1);
+    if (n == -1 && errno != EINTR)
+      return false;
+    if (n > 0)
+      return true;
+  }
+}
+
+/// writeAll - Write \a size bytes to \a fd, waiting at most until \a
+/// deadline (in microseconds of \a timer) if it is not 0. Returns false on
+/// error or timeout.
+static bool writeAll(int fd, const void *data, size_t size,
+                     WallTimer *timer = 0, uint64_t deadline = 0) {
+  const char *p = (const char*) data;
+  while (size) {
+    // A pipe which polls writable takes PIPE_BUF bytes without blocking.
+    size_t chunk = size;
+    if (timer) {
+      if (!waitFor(fd, POLLOUT, timer, deadline))
+        return false;
+      chunk = std::min(size, (size_t) PIPE_BUF);
+    }
+
+    ssize_t n = write(fd, p, chunk);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// readAll - Read \a size bytes from \a fd, waiting at most until \a deadline
+/// (in microseconds of \a timer) if it is not 0. Returns false on end of
+/// file, error or timeout.
+static bool readAll(int fd, void *data, size_t size,
+                    WallTimer *timer = 0, uint64_t deadline = 0) {
+  char *p = (char*) data;
+  while (size) {
+    if (timer && !waitFor(fd, POLLIN, timer, deadline))
+      return false;
+
+    ssize_t n = read(fd, p, size);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+SolverWorkerPool::SolverWorkerPool(unsigned numWorkers, Solver *_solver)
+  : workers(numWorkers), solver(_solver), current(0), deadline(0),
+    sendStatus(SolverImpl::SOLVER_RUN_STATUS_FAILURE) {
+  assert(numWorkers && "worker pool without workers");
+}
+
+SolverWorkerPool::~SolverWorkerPool() {
+  for (unsigned i = 0; i != workers.size(); ++i)
+    kill(workers[i]);
+  delete solver;
+}
+
+void SolverWorkerPool::runWorker(int in, int out) {
+  // Interrupts are for the parent, which shuts the workers down.
+  ::signal(SIGINT, SIG_IGN);
+
+  // Run in a process group of our own, so that killing it also kills any
+  // process the solver starts (forked STP, an external solver).
+  setpgid(0, 0);
+
+  for (;;) {
+    uint64_t size;
+    if (!readAll(in, &size, sizeof(size)))
+      break;
+    std::string request(size, '\0');
+    if (size && !readAll(in, &request[0], size))
+      break;
+
+    std::vector<const Array*> arrays;
+    bool ok;
+    {
+      std::vector< ref<Expr> > constraints;
+      ref<Expr> expr;
+      std::vector<const Array*> objects;
+      QueryReader reader(request, arrays);
+      ok = reader.readQuery(constraints, expr, objects);
+
+      if (ok) {
+        ConstraintManager cm(constraints);
+        std::vector< std::vector<unsigned char> > values;
+        bool hasSolution = false;
+        bool success = solver->impl->computeInitialValues(Query(cm, expr),
+                                                          objects, values,
+                                                          hasSolution);
+
+        int32_t status = success ? solver->impl->getOperationStatusCode()
+                                 : SolverImpl::SOLVER_RUN_STATUS_FAILURE;
+        unsigned char result[2] = { success, hasSolution };
+        ok = writeAll(out, &status, sizeof(status)) &&
+             writeAll(out, result, sizeof(result));
+        if (ok && success && hasSolution)
+          for (unsigned i = 0; ok && i != values.size(); ++i)
+            ok = writeAll(out, &values[i][0], values[i].size());
+      }
+    }
+
+    // The expressions of the query are gone. Drop what the solver (and
+    // anything else in this process) keeps for them, so the worker does
+    // not grow from query to query, then free the arrays they read.
+    ExprContext::get().clearCaches();
+    for (unsigned i = 0; i != arrays.size(); ++i)
+      delete arrays[i];
+    if (!ok)
+      break;
+  }
+  _exit(0);
+}
+
+bool SolverWorkerPool::spawn(Worker &w) {
+  int toWorker[2], fromWorker[2];
+  if (pipe(toWorker) == -1)
+    return false;
+  if (pipe(fromWorker) == -1) {
+    close(toWorker[0]);
+    close(toWorker[1]);
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  int pid = fork();
+  if (pid == -1) {
+    fprintf(stderr, "error: fork failed (for solver worker)\n");
+    close(toWorker[0]);
+    close(toWorker[1]);
+    close(fromWorker[0]);
+    close(fromWorker[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    close(toWorker[1]);
+    close(fromWorker[0]);
+    for (unsigned i = 0; i != workers.size(); ++i) {
+      if (workers[i].pid != -1) {
+        close(workers[i].toWorker);
+        close(workers[i].fromWorker);
+      }
+    }
+    runWorker(toWorker[0], fromWorker[1]);
+  }
+
+  // Also set in the parent, so the group exists before any kill.
+  setpgid(pid, pid);
+  close(toWorker[0]);
+  close(fromWorker[1]);
+  w.pid = pid;
+  w.toWorker = toWorker[1];
+  w.fromWorker = fromWorker[0];
+  return true;
+}
+
+void SolverWorkerPool::kill(Worker &w) {
+  if (w.pid == -1)
+    return;
+
+  ::kill(-w.pid, SIGKILL);
+  ::kill(w.pid, SIGKILL);
+  int status;
+  while (waitpid(w.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  close(w.toWorker);
+  close(w.fromWorker);
+  w.pid = -1;
+  if (current == &w)
+    current = 0;
+}
+
+void SolverWorkerPool::startQuery(const Query &query,
+                                  const std::vector<const Array*> &objects,
+                                  double timeout) {
+  // Drop the answer to the last query if nobody read it. The worker is only
+  // kept if it has answered by now; waiting for it could take as long as
+  // the query which nobody wants anymore.
+  if (current) {
+    struct pollfd pfd;
+    pfd.fd = current->fromWorker;
+    pfd.events = POLLIN;
+    std::vector< std::vector<unsigned char> > values;
+    bool hasSolution;
+    if (poll(&pfd, 1, 0) == 1)
+      readAnswer(values, hasSolution, false);
+    else
+      kill(*current);
+    current = 0;
+  }
+
+  // Use a running worker if there is one. Queries are solved one at a time,
+  // so a worker is only forked when there is none (at first, and after one
+  // is lost).
+  Worker *w = 0;
+  for (unsigned i = 0; i != workers.size() && !w; ++i)
+    if (workers[i].pid != -1)
+      w = &workers[i];
+  for (unsigned i = 0; i != workers.size() && !w; ++i)
+    if (spawn(workers[i]))
+      w = &workers[i];
+  if (!w) {
+    sendStatus = SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+    return;
+  }
+
+  std::string request;
+  QueryWriter writer(request);
+  writer.writeQuery(query, objects);
+
+  objectSizes.clear();
+  for (unsigned i = 0; i != objects.size(); ++i)
+    objectSizes.push_back(objects[i]->size);
+
+  // The timeout covers sending the query too, as a stuck worker stops
+  // reading it.
+  timer = WallTimer();
+  deadline = (uint64_t) (timeout * 1000000);
+  WallTimer *t = timeout ? &timer : 0;
+
+  // The worker may have died since its last query.
+  void (*oldHandler)(int) = ::signal(SIGPIPE, SIG_IGN);
+  uint64_t size = request.size();
+  bool sent = writeAll(w->toWorker, &size, sizeof(size), t, deadline) &&
+              writeAll(w->toWorker, request.data(), request.size(), t,
+                       deadline);
+  ::signal(SIGPIPE, oldHandler);
+
+  if (!sent) {
+    bool timedOut = timeout && timer.check() >= deadline;
+    kill(*w);
+    if (timedOut) {
+      fprintf(stderr, "error: solver worker timed out\n");
+      sendStatus = SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+    } else {
+      fprintf(stderr, "error: solver worker did not return successfully\n");
+      sendStatus = SolverImpl::SOLVER_RUN_STATUS_INTERRUPTED;
+    }
+    return;
+  }
+
+  current = w;
+}
+
+/// readAnswer - Read the answer of the current worker, waiting until the
+/// deadline of the query if \a wait is set and only for the rest of an
+/// answer which has started to arrive otherwise.
+SolverImpl::SolverRunStatus
+SolverWorkerPool::readAnswer(std::vector< std::vector<unsigned char> > &values,
+                             bool &hasSolution, bool wait) {
+  Worker &w = *current;
+  current = 0;
+  WallTimer *t = (wait && deadline) ? &timer : 0;
+
+  int32_t status;
+  unsigned char result[2];
+  bool ok = readAll(w.fromWorker, &status, sizeof(status), t, deadline) &&
+            readAll(w.fromWorker, result, sizeof(result), t, deadline);
+  if (ok && result[0] && result[1]) {
+    values = std::vector< std::vector<unsigned char> >(objectSizes.size());
+    for (unsigned i = 0; ok && i != objectSizes.size(); ++i) {
+      values[i].resize(objectSizes[i]);
+      ok = !objectSizes[i] ||
+           readAll(w.fromWorker, &values[i][0], objectSizes[i], t, deadline);
+    }
+  }
+
+  if (!ok) {
+    bool timedOut = t && timer.check() >= deadline;
+    kill(w);
+    if (timedOut) {
+      fprintf(stderr, "error: solver worker timed out\n");
+      return SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+    }
+    fprintf(stderr, "error: solver worker did not return successfully\n");
+    return SolverImpl::SOLVER_RUN_STATUS_INTERRUPTED;
+  }
+
+  if (result[0])
+    hasSolution = result[1];
+  return (SolverImpl::SolverRunStatus) status;
+}
+
+SolverImpl::SolverRunStatus
+SolverWorkerPool::finishQuery(std::vector< std::vector<unsigned char> >
+                                &values,
+                              bool &hasSolution) {
+  if (!current)
+    return sendStatus;
+  return readAnswer(values, hasSolution, true);
+}
+
+void SolverWorkerPool::cancelQuery() {
+  if (current)
+    kill(*current);
+}
@@ -0,0 +1,105 @@
+//===-- SolverWorkerPool.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SOLVERWORKERPOOL_H
+#define KLEE_SOLVERWORKERPOOL_H
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/Internal/Support/Timer.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace klee {
+  /// SolverWorkerPool - A pool of long-lived solver processes.
+  ///
+  /// Workers are forked once and then solve queries which are serialized to
+  /// them over a pipe, using the solver the pool was given. This keeps the
+  /// crash isolation and timeouts of solving in a forked process without
+  /// forking (and copying the page tables of) the whole process for every
+  /// query. A worker which times out or dies is killed and replaced by a new
+  /// one the next time a worker is needed.
+  ///
+  /// Queries are solved one at a time, so this is not a pool of concurrent
+  /// workers: one worker is forked on demand, at the first query and again
+  /// after it is lost, and the further slots are only tried when forking
+  /// into the first fails. Each worker clears its caches and frees the
+  /// arrays of a query once it has answered it.
+  class SolverWorkerPool {
+    struct Worker {
+      pid_t pid;
+      int toWorker, fromWorker;
+
+      Worker() : pid(-1), toWorker(-1), fromWorker(-1) {}
+    };
+
+    std::vector<Worker> workers;
+    Solver *solver;
+
+    /// The worker solving the current query until its answer is read, the
+    /// sizes of the objects it answers with and the deadline (in
+    /// microseconds of timer, 0 is none) of the query.
+    Worker *current;
+    std::vector<unsigned> objectSizes;
+    WallTimer timer;
+    uint64_t deadline;
+
+    /// The status of the current query if sending it failed.
+    SolverImpl::SolverRunStatus sendStatus;
+
+    bool spawn(Worker &w);
+    void kill(Worker &w);
+    void runWorker(int in, int out);
+    SolverImpl::SolverRunStatus
+    readAnswer(std::vector< std::vector<unsigned char> > &values,
+               bool &hasSolution, bool wait);
+
+  public:
+    /// \param numWorkers - The number of workers to keep.
+    /// \param solver - The solver the workers solve queries with, which the
+    /// pool takes ownership of. It is only used in the workers.
+    SolverWorkerPool(unsigned numWorkers, Solver *solver);
+    ~SolverWorkerPool();
+
+    /// startQuery - Send the query to a worker, forking one if there is
+    /// none, and start its timeout of \a timeout seconds (0 is off). A query
+    /// whose answer was not read is dropped here, and its worker is killed
+    /// if it has not answered yet.
+    void startQuery(const Query &query,
+                    const std::vector<const Array*> &objects, double timeout);
+
+    /// getResultFD - The descriptor which becomes readable once the worker
+    /// answers the current query, or -1 if there is no query to answer.
+    int getResultFD() const { return current ? current->fromWorker : -1; }
+
+    /// finishQuery - Wait for the answer to the current query, killing the
+    /// worker if it does not answer before the timeout.
+    SolverImpl::SolverRunStatus
+    finishQuery(std::vector< std::vector<unsigned char> > &values,
+                bool &hasSolution);
+
+    /// cancelQuery - Kill the worker solving the current query, if any.
+    void cancelQuery();
+
+    /// computeInitialValues - Solve the query in a worker, killing the worker
+    /// if it does not answer within \a timeout seconds (0 is off).
+    SolverImpl::SolverRunStatus
+    computeInitialValues(const Query &query,
+                         const std::vector<const Array*> &objects,
+                         std::vector< std::vector<unsigned char> > &values,
+                         bool &hasSolution, double timeout) {
+      startQuery(query, objects, timeout);
+      return finishQuery(values, hasSolution);
+    }
+  };
+}
+
+#endif
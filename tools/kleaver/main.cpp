@@ -7,6 +7,7 @@
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/ExprBuilder.h"
+#include "klee/ExprContext.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
 #include "klee/Statistics.h"
@@ -87,6 +88,27 @@ namespace {
   cl::opt<bool>
   UseFastCexSolver("use-fast-cex-solver",
 		   cl::init(false));
+
+  cl::opt<bool>
+  UseFPLocalSearch("use-fp-local-search",
+                   cl::init(false),
+                   cl::desc("Search for models of floating point queries "
+                            "concretely before calling the solver"));
+
+  cl::opt<bool>
+  UseModelSampling("use-model-sampling",
+                   cl::init(false),
+                   cl::desc("Check compiled queries against sampled inputs "
+                            "before calling the solver"));
+
+  cl::opt<std::string>
+  SMTLIBSolverPath("smtlib-solver",
+                   cl::desc("Use this SMT-LIBv2 solver binary instead of STP. "
+                            "A new solver process is started for every query"));
+
+  cl::opt<std::string>
+  SMTLIBSolverArgs("smtlib-solver-args",
+                   cl::desc("Arguments for -smtlib-solver"));
   
   // FIXME: Command line argument modified in Executor.cpp of Klee. Different
   // output file name used.
@@ -190,9 +212,16 @@ static bool EvaluateInputAST(const char *Filename,
 
   // FIXME: Support choice of solver.
   Solver *S, *STP = S = 
-    UseDummySolver ? createDummySolver() : new STPSolver(true);
+    UseDummySolver ? createDummySolver() :
+    !SMTLIBSolverPath.empty() ? new SMTLIBSolver(SMTLIBSolverPath,
+                                                 SMTLIBSolverArgs) :
+    new STPSolver(true);
   if (UseSTPQueryPCLog)
     S = createPCLoggingSolver(S, "stp-queries.pc", MinQueryTimeToLog);
+  if (UseFPLocalSearch)
+    S = createFPLocalSearchSolver(S);
+  if (UseModelSampling)
+    S = createModelSamplingSolver(S);
   if (UseFastCexSolver)
     S = createFastCexSolver(S);
   S = createCexCachingSolver(S);
@@ -317,21 +346,22 @@ int main(int argc, char **argv) {
   }
 #endif
   
-  ExprBuilder *Builder = 0;
+  // Install the builder in the context, which owns it.
+  ExprContext &Context = ExprContext::get();
   switch (BuilderKind) {
   case DefaultBuilder:
-    Builder = createDefaultExprBuilder();
     break;
   case ConstantFoldingBuilder:
-    Builder = createDefaultExprBuilder();
-    Builder = createConstantFoldingExprBuilder(Builder);
+    Context.setBuilder(
+      createConstantFoldingExprBuilder(createDefaultExprBuilder()));
     break;
   case SimplifyingBuilder:
-    Builder = createDefaultExprBuilder();
-    Builder = createConstantFoldingExprBuilder(Builder);
-    Builder = createSimplifyingExprBuilder(Builder);
+    Context.setBuilder(
+      createSimplifyingExprBuilder(
+        createConstantFoldingExprBuilder(createDefaultExprBuilder())));
     break;
   }
+  ExprBuilder *Builder = &Context.getBuilder();
 
   switch (ToolAction) {
   case PrintTokens:
@@ -363,7 +393,6 @@ int main(int argc, char **argv) {
     std::cerr << argv[0] << ": error: Unknown program action!\n";
   }
 
-  delete Builder;
 #if LLVM_VERSION_CODE < LLVM_VERSION(2, 9)
   delete MB;
 #endif
@@ -0,0 +1,170 @@
+//===-- ExprBytecodeTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprBytecode.h"
+
+#include "llvm/ADT/APFloat.h"
+
+#include <vector>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+uint64_t nextRandom(uint64_t &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+/// The special values planted in the operands: zeros, infinities, NaNs
+/// of either sign, the smallest denormal and the largest finite value.
+const uint32_t floatSpecials[] = {
+  0x00000000, 0x80000000, 0x7f800000, 0xff800000, 0x7fc00000, 0xffc00000,
+  0x7f800001, 0x00000001, 0x7f7fffff, 0x3f800000, 0xbf800000
+};
+
+const uint64_t doubleSpecials[] = {
+  0x0000000000000000ULL, 0x8000000000000000ULL, 0x7ff0000000000000ULL,
+  0xfff0000000000000ULL, 0x7ff8000000000000ULL, 0xfff8000000000000ULL,
+  0x7ff0000000000001ULL, 0x0000000000000001ULL, 0x7fefffffffffffffULL,
+  0x3ff0000000000000ULL, 0xbff0000000000000ULL
+};
+
+void setBytes(std::vector<unsigned char> &bytes, uint64_t v, unsigned n) {
+  for (unsigned i = 0; i != n; ++i)
+    bytes[i] = (unsigned char) (v >> (8 * i));
+}
+
+/// Fill \a bytes with random bits, a special float in the low 4 bytes or a
+/// special double.
+void randomOperand(std::vector<unsigned char> &bytes, uint64_t &state) {
+  setBytes(bytes, nextRandom(state), 8);
+  switch (nextRandom(state) % 3) {
+  case 0:
+    setBytes(bytes, floatSpecials[nextRandom(state) %
+                                  (sizeof floatSpecials / 4)], 4);
+    break;
+  case 1:
+    setBytes(bytes, doubleSpecials[nextRandom(state) %
+                                   (sizeof doubleSpecials / 8)], 8);
+    break;
+  default:
+    break;
+  }
+}
+
+/// Add constraints over the floating point values of width \a w at the
+/// start of \a xa and \a ya which exercise each floating point operation.
+void addFPConstraints(std::vector< ref<Expr> > &res,
+                      const Array *xa, const Array *ya, Expr::Width w) {
+  ref<Expr> x = Expr::createTempRead(xa, w), y = Expr::createTempRead(ya, w);
+  const fltSemantics *sem = w == Expr::Int32 ? &APFloat::IEEEsingle
+                                             : &APFloat::IEEEdouble;
+  ref<Expr> nan = w == Expr::Int32
+    ? ConstantExpr::create(0x7fc00000, w)
+    : ConstantExpr::create(0x7ff8000000000000ULL, w);
+  ref<Expr> negZero = ConstantExpr::create(1ULL << (w - 1), w);
+
+  ref<Expr> ops[] = {
+    FAddExpr::create(x, y, false), FSubExpr::create(x, y, false),
+    FMulExpr::create(x, y, false), FDivExpr::create(x, y, false),
+    FSubExpr::create(x, x, false), FSqrtExpr::create(x, false)
+  };
+  for (unsigned i = 0; i != sizeof ops / sizeof ops[0]; ++i) {
+    res.push_back(EqExpr::create(ops[i], y));
+    res.push_back(EqExpr::create(ops[i], nan));
+    res.push_back(EqExpr::create(ops[i], negZero));
+    res.push_back(FOrd1Expr::create(ops[i], false));
+    for (unsigned p = 1; p < FCmpExpr::TRUE; p += 3)
+      res.push_back(FCmpExpr::create(ops[i], y,
+                                     ConstantExpr::create(p, 4), false));
+  }
+
+  const fltSemantics *other = w == Expr::Int32 ? &APFloat::IEEEdouble
+                                               : &APFloat::IEEEsingle;
+  Expr::Width otherWidth = w == Expr::Int32 ? Expr::Int64 : Expr::Int32;
+  ref<Expr> converted = w == Expr::Int32
+    ? FPExtExpr::create(x, other, false)
+    : FPTruncExpr::create(x, other, false);
+  res.push_back(EqExpr::create(converted,
+                               Expr::createTempRead(ya, otherWidth)));
+  res.push_back(EqExpr::create(converted, ConstantExpr::create(0, otherWidth)));
+
+  ref<Expr> xi = ExtractExpr::create(x, 0, Expr::Int32);
+  res.push_back(EqExpr::create(UIToFPExpr::create(xi, sem), y));
+  res.push_back(EqExpr::create(SIToFPExpr::create(xi, sem), y));
+  res.push_back(EqExpr::create(FPToSIExpr::create(x, Expr::Int32, false, false),
+                               ExtractExpr::create(y, 0, Expr::Int32)));
+  res.push_back(EqExpr::create(FPToUIExpr::create(x, Expr::Int16, false, true),
+                               ConstantExpr::create(0, Expr::Int16)));
+}
+
+TEST(ExprBytecodeTest, InfMinusInf) {
+  Array *array = new Array("bc0", 4);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  ref<Expr> e = EqExpr::create(FSubExpr::create(x, x, false),
+                               ConstantExpr::create(0x7fc00000, Expr::Int32));
+  std::vector< ref<Expr> > constraints(1, e);
+  ExprBytecode code(constraints.begin(), constraints.end());
+  ASSERT_TRUE(code.isValid());
+
+  Assignment a;
+  a.bindings[array] = std::vector<unsigned char>(4);
+  setBytes(a.bindings[array], 0x7f800000, 4);
+  bool expected = a.satisfies(constraints.begin(), constraints.end());
+  ExprBytecode::Result res = code.evaluate(a);
+  if (res != ExprBytecode::Unknown)
+    EXPECT_EQ(expected, res == ExprBytecode::True);
+}
+
+TEST(ExprBytecodeTest, AgreesWithAssignment) {
+  Array *xa = new Array("bc1", 8), *ya = new Array("bc2", 8);
+  std::vector< ref<Expr> > constraints;
+  addFPConstraints(constraints, xa, ya, Expr::Int32);
+  addFPConstraints(constraints, xa, ya, Expr::Int64);
+
+  std::vector<ExprBytecode*> programs;
+  for (unsigned i = 0; i != constraints.size(); ++i) {
+    programs.push_back(new ExprBytecode(&constraints[i], &constraints[i] + 1));
+    EXPECT_TRUE(programs.back()->isValid());
+  }
+
+  uint64_t state = 0x2545f4914f6cdd1dULL;
+  unsigned decided = 0;
+  for (unsigned n = 0; n != 2000; ++n) {
+    Assignment a;
+    a.bindings[xa] = std::vector<unsigned char>(8);
+    a.bindings[ya] = std::vector<unsigned char>(8);
+    randomOperand(a.bindings[xa], state);
+    randomOperand(a.bindings[ya], state);
+
+    for (unsigned i = 0; i != constraints.size(); ++i) {
+      ExprBytecode::Result res = programs[i]->evaluate(a);
+      if (res == ExprBytecode::Unknown)
+        continue;
+      ++decided;
+      EXPECT_EQ(a.satisfies(&constraints[i], &constraints[i] + 1),
+                res == ExprBytecode::True)
+        << "constraint " << i << " under operands " << n;
+    }
+  }
+  EXPECT_LT(0U, decided);
+
+  for (unsigned i = 0; i != programs.size(); ++i)
+    delete programs[i];
+}
+
+}
@@ -11,8 +11,16 @@
 #include "gtest/gtest.h"
 
 #include "klee/Expr.h"
+#include "klee/ExprBuilder.h"
+
+#include "llvm/ADT/APFloat.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdlib>
+#include <map>
 
 using namespace klee;
+using namespace llvm;
 
 namespace {
 
@@ -110,4 +118,411 @@ TEST(ExprTest, ExtractConcat) {
   EXPECT_EQ(Expr::Extract, concat2->getKid(1)->getKind());
 }
 
+/***/
+
+ref<Expr> getFloat(uint32_t bits) {
+  return ConstantExpr::create(bits, Expr::Int32);
+}
+
+ref<Expr> createFCmp(const ref<Expr> &l, const ref<Expr> &r, unsigned pred) {
+  return FCmpExpr::create(l, r, ConstantExpr::create(pred, 4), false);
+}
+
+const uint32_t floatPosZero = 0x00000000, floatNegZero = 0x80000000;
+
+TEST(ExprTest, FPNegation) {
+  Array *array = new Array("arr4", 256);
+  ref<Expr> x = Expr::createTempRead(array, 32);
+  ref<Expr> y = ExtractExpr::create(Expr::createTempRead(array, 64), 32, 32);
+
+  // -0 - Y negates Y exactly.
+  ref<Expr> negY = FSubExpr::create(getFloat(floatNegZero), y, false);
+  EXPECT_EQ(FSubExpr::create(x, y, false), FAddExpr::create(x, negY, false));
+  EXPECT_EQ(FSubExpr::create(x, y, false), FAddExpr::create(negY, x, false));
+  EXPECT_EQ(FAddExpr::create(x, y, false), FSubExpr::create(x, negY, false));
+  ref<Expr> negX = FSubExpr::create(getFloat(floatNegZero), x, false);
+  EXPECT_EQ(FMulExpr::create(x, y, false), FMulExpr::create(negX, negY, false));
+  EXPECT_EQ(FDivExpr::create(x, y, false), FDivExpr::create(negX, negY, false));
+
+  // +0 - Y is +0 rather than -0 for Y = +0, so it is not a negation.
+  ref<Expr> subY = FSubExpr::create(getFloat(floatPosZero), y, false);
+  EXPECT_EQ(Expr::FSub, subY->getKind());
+  ref<Expr> sum = FAddExpr::create(x, subY, false);
+  EXPECT_EQ(Expr::FAdd, sum->getKind());
+  EXPECT_EQ(subY, sum->getKid(1));
+  EXPECT_EQ(Expr::FMul, FMulExpr::create(negX, subY, false)->getKind());
+  EXPECT_EQ(negX, FMulExpr::create(negX, subY, false)->getKid(0));
+
+  // X - +0 is X, but X - -0 is +0 for X = -0.
+  EXPECT_EQ(x, FSubExpr::create(x, getFloat(floatPosZero), false));
+  EXPECT_EQ(Expr::FSub,
+            FSubExpr::create(x, getFloat(floatNegZero), false)->getKind());
+  EXPECT_EQ(x, FAddExpr::create(x, getFloat(floatNegZero), false));
+  EXPECT_EQ(Expr::FAdd,
+            FAddExpr::create(x, getFloat(floatPosZero), false)->getKind());
+
+  // X - X is NaN for infinite X.
+  EXPECT_EQ(Expr::FSub, FSubExpr::create(x, x, false)->getKind());
+}
+
+TEST(ExprTest, FPExtTrunc) {
+  Array *array = new Array("arr5", 256);
+  ref<Expr> x = Expr::createTempRead(array, 32);
+  ref<Expr> d = Expr::createTempRead(array, 64);
+  ref<Expr> ld = ConcatExpr::create(ExtractExpr::create(d, 0, 16), d);
+
+  ref<Expr> ext = FPExtExpr::create(x, &APFloat::IEEEdouble, false);
+  EXPECT_EQ(x, FPTruncExpr::create(ext, &APFloat::IEEEsingle, false));
+  EXPECT_EQ(FPExtExpr::create(x, &APFloat::x87DoubleExtended, false),
+            FPExtExpr::create(ext, &APFloat::x87DoubleExtended, false));
+
+  ref<Expr> ldExt = FPExtExpr::create(ext, &APFloat::x87DoubleExtended, false);
+  EXPECT_EQ(ext, FPTruncExpr::create(ldExt, &APFloat::IEEEdouble, false));
+  ref<Expr> dExt = FPExtExpr::create(d, &APFloat::x87DoubleExtended, false);
+  EXPECT_EQ(FPTruncExpr::create(d, &APFloat::IEEEsingle, false),
+            FPTruncExpr::create(dExt, &APFloat::IEEEsingle, false));
+
+  // Rounding twice may differ from rounding once.
+  ref<Expr> trunc = FPTruncExpr::create(ld, &APFloat::IEEEdouble, false);
+  ref<Expr> trunc2 = FPTruncExpr::create(trunc, &APFloat::IEEEsingle, false);
+  EXPECT_EQ(Expr::FPTrunc, trunc2->getKind());
+  EXPECT_EQ(trunc, trunc2->getKid(0));
+}
+
+TEST(ExprTest, FCmpSelf) {
+  Array *array = new Array("arr6", 256);
+  ref<Expr> x = Expr::createTempRead(array, 32);
+  ref<Expr> ord = FOrd1Expr::create(x, false);
+
+  EXPECT_EQ(ord, createFCmp(x, x, FCmpExpr::OEQ));
+  EXPECT_EQ(ord, createFCmp(x, x, FCmpExpr::OGE));
+  EXPECT_EQ(ord, createFCmp(x, x, FCmpExpr::ORD));
+  EXPECT_EQ(Expr::createIsZero(ord), createFCmp(x, x, FCmpExpr::UNO));
+  EXPECT_EQ(Expr::createIsZero(ord), createFCmp(x, x, FCmpExpr::UNE));
+  EXPECT_EQ(Expr::createIsZero(ord), createFCmp(x, x, FCmpExpr::ULT));
+  EXPECT_EQ(getConstant(1, Expr::Bool),
+            createFCmp(x, x, FCmpExpr::UEQ));
+  EXPECT_EQ(getConstant(1, Expr::Bool),
+            createFCmp(x, x, FCmpExpr::ULE));
+  EXPECT_EQ(getConstant(0, Expr::Bool),
+            createFCmp(x, x, FCmpExpr::OLT));
+  EXPECT_EQ(getConstant(0, Expr::Bool),
+            createFCmp(x, x, FCmpExpr::ONE));
+}
+
+TEST(ExprTest, FCmpIToFP) {
+  Array *array = new Array("arr7", 256);
+  ref<Expr> x = Expr::createTempRead(array, 16);
+  ref<Expr> y = ExtractExpr::create(Expr::createTempRead(array, 32), 16, 16);
+  ref<Expr> sx = SIToFPExpr::create(x, &APFloat::IEEEsingle);
+  ref<Expr> ux = UIToFPExpr::create(x, &APFloat::IEEEsingle);
+  const uint32_t f2_5 = 0x40200000, fm2_5 = 0xc0200000, f3 = 0x40400000,
+    f40000 = 0x471c4000, fm40000 = 0xc71c4000, fm1 = 0xbf800000;
+
+  // Strict bounds round up, and the others down.
+  EXPECT_EQ(SltExpr::create(x, getConstant(3, 16)),
+            createFCmp(sx, getFloat(f2_5), FCmpExpr::OLT));
+  EXPECT_EQ(SleExpr::create(x, getConstant(2, 16)),
+            createFCmp(sx, getFloat(f2_5), FCmpExpr::OLE));
+  EXPECT_EQ(SltExpr::create(getConstant(2, 16), x),
+            createFCmp(sx, getFloat(f2_5), FCmpExpr::OGT));
+  EXPECT_EQ(SleExpr::create(getConstant(3, 16), x),
+            createFCmp(sx, getFloat(f2_5), FCmpExpr::OGE));
+  EXPECT_EQ(SltExpr::create(x, getConstant(-2, 16)),
+            createFCmp(sx, getFloat(fm2_5), FCmpExpr::OLT));
+  EXPECT_EQ(SleExpr::create(x, getConstant(-3, 16)),
+            createFCmp(sx, getFloat(fm2_5), FCmpExpr::OLE));
+  EXPECT_EQ(UltExpr::create(x, getConstant(3, 16)),
+            createFCmp(ux, getFloat(f2_5), FCmpExpr::OLT));
+  EXPECT_EQ(SltExpr::create(getConstant(2, 16), x),
+            createFCmp(getFloat(f2_5), sx, FCmpExpr::OLT));
+
+  // An integer equals no constant with a fractional part.
+  EXPECT_EQ(getConstant(0, Expr::Bool),
+            createFCmp(sx, getFloat(f2_5), FCmpExpr::OEQ));
+  EXPECT_EQ(getConstant(1, Expr::Bool),
+            createFCmp(sx, getFloat(f2_5), FCmpExpr::ONE));
+  EXPECT_EQ(EqExpr::create(getConstant(3, 16), x),
+            createFCmp(sx, getFloat(f3), FCmpExpr::OEQ));
+
+  // Constants out of the range of the integer.
+  EXPECT_EQ(getConstant(1, Expr::Bool),
+            createFCmp(sx, getFloat(f40000), FCmpExpr::OLT));
+  EXPECT_EQ(getConstant(0, Expr::Bool),
+            createFCmp(sx, getFloat(f40000), FCmpExpr::OGE));
+  EXPECT_EQ(getConstant(1, Expr::Bool),
+            createFCmp(sx, getFloat(fm40000), FCmpExpr::OGT));
+  EXPECT_EQ(getConstant(0, Expr::Bool),
+            createFCmp(ux, getFloat(fm1), FCmpExpr::OLE));
+  EXPECT_EQ(UleExpr::create(x, getConstant(40000, 16)),
+            createFCmp(ux, getFloat(f40000), FCmpExpr::OLE));
+
+  // Comparisons of two exact conversions.
+  ref<Expr> sy = SIToFPExpr::create(y, &APFloat::IEEEsingle);
+  EXPECT_EQ(SltExpr::create(x, y), createFCmp(sx, sy, FCmpExpr::OLT));
+  EXPECT_EQ(EqExpr::create(x, y), createFCmp(sx, sy, FCmpExpr::UEQ));
+}
+
+TEST(ExprTest, FCmpInexactIToFP) {
+  Array *array = new Array("arr8", 256);
+  ref<Expr> x32 = Expr::createTempRead(array, 32);
+  ref<Expr> x25 = ExtractExpr::create(x32, 0, 25);
+  const uint32_t f2_5 = 0x40200000;
+
+  // A float holds every 25 bit signed integer, but not every unsigned one
+  // or every 32 bit one.
+  ref<Expr> s32 = SIToFPExpr::create(x32, &APFloat::IEEEsingle);
+  EXPECT_EQ(Expr::FCmp, createFCmp(s32, getFloat(f2_5), FCmpExpr::OLT)->getKind());
+  ref<Expr> u25 = UIToFPExpr::create(x25, &APFloat::IEEEsingle);
+  EXPECT_EQ(Expr::FCmp, createFCmp(u25, getFloat(f2_5), FCmpExpr::OLT)->getKind());
+  ref<Expr> s25 = SIToFPExpr::create(x25, &APFloat::IEEEsingle);
+  EXPECT_EQ(SltExpr::create(x25, ConstantExpr::create(3, 25)),
+            createFCmp(s25, getFloat(f2_5), FCmpExpr::OLT));
+
+  ref<Expr> t32 = SIToFPExpr::create(
+    ExtractExpr::create(Expr::createTempRead(array, 64), 32, 32),
+    &APFloat::IEEEsingle);
+  EXPECT_EQ(Expr::FCmp, createFCmp(s32, t32, FCmpExpr::OLT)->getKind());
+}
+
+/// checkRelaxedFP - The simplifications only made under -relaxed-fp, which
+/// is set in a child process so that it does not apply to the other tests.
+void checkRelaxedFP() {
+  const char *argv[] = { "ExprTest", "-relaxed-fp" };
+  cl::ParseCommandLineOptions(2, (char**) argv);
+
+  Array *array = new Array("arr9", 256);
+  ref<Expr> x = Expr::createTempRead(array, 32);
+  ref<Expr> y = ExtractExpr::create(Expr::createTempRead(array, 64), 32, 32);
+  ref<Expr> d = Expr::createTempRead(array, 64);
+  ref<Expr> ld = ConcatExpr::create(ExtractExpr::create(d, 0, 16), d);
+
+  bool ok = true;
+  ok &= x == FSubExpr::create(x, getFloat(floatNegZero), false);
+  ok &= FSubExpr::create(x, y, false) ==
+    FAddExpr::create(x, FSubExpr::create(getFloat(floatPosZero), y, false),
+                     false);
+  ok &= getFloat(floatPosZero) == FSubExpr::create(x, x, false);
+  ok &= FPTruncExpr::create(ld, &APFloat::IEEEsingle, false) ==
+    FPTruncExpr::create(FPTruncExpr::create(ld, &APFloat::IEEEdouble, false),
+                        &APFloat::IEEEsingle, false);
+  std::exit(ok ? 0 : 1);
+}
+
+TEST(ExprTest, RelaxedFP) {
+  EXPECT_EXIT(checkRelaxedFP(), ::testing::ExitedWithCode(0), "");
+}
+
+/***/
+
+TEST(ExprTest, Interning) {
+  Array *array = new Array("arr10", 256);
+  ref<Expr> x = Expr::createTempRead(array, 32);
+  ref<Expr> y = ExtractExpr::create(Expr::createTempRead(array, 64), 32, 32);
+  ref<Expr> oeq = ConstantExpr::create(FCmpExpr::OEQ, 4);
+
+  // Structurally equal expressions are the same object.
+  EXPECT_EQ(ConstantExpr::alloc(5, 32).get(), ConstantExpr::alloc(5, 32).get());
+  EXPECT_EQ(ReadExpr::alloc(UpdateList(array, 0), getConstant(3, 32)).get(),
+            ReadExpr::alloc(UpdateList(array, 0), getConstant(3, 32)).get());
+  EXPECT_EQ(ExtractExpr::alloc(x, 8, 8).get(), ExtractExpr::alloc(x, 8, 8).get());
+  EXPECT_EQ(ZExtExpr::alloc(x, 64).get(), ZExtExpr::alloc(x, 64).get());
+  EXPECT_EQ(FCmpExpr::alloc(x, y, oeq, true).get(),
+            FCmpExpr::alloc(x, y, oeq, true).get());
+  EXPECT_EQ(FAddExpr::alloc(x, y, true).get(), FAddExpr::alloc(x, y, true).get());
+  EXPECT_EQ(FSqrtExpr::alloc(x, true).get(), FSqrtExpr::alloc(x, true).get());
+  EXPECT_EQ(FOrd1Expr::alloc(x, true).get(), FOrd1Expr::alloc(x, true).get());
+  EXPECT_EQ(FPToSIExpr::alloc(x, 32, false, true).get(),
+            FPToSIExpr::alloc(x, 32, false, true).get());
+  EXPECT_EQ(FPExtExpr::alloc(x, &APFloat::IEEEdouble, false).get(),
+            FPExtExpr::alloc(x, &APFloat::IEEEdouble, false).get());
+  EXPECT_EQ(SIToFPExpr::alloc(x, &APFloat::IEEEdouble).get(),
+            SIToFPExpr::alloc(x, &APFloat::IEEEdouble).get());
+  EXPECT_EQ(AnyExpr::alloc(32, 7).get(), AnyExpr::alloc(32, 7).get());
+
+  // Expressions differing only in their other fields are not.
+  EXPECT_NE(ConstantExpr::alloc(5, 32).get(), ConstantExpr::alloc(5, 64).get());
+  Array *array2 = new Array("arr11", 256);
+  EXPECT_NE(ReadExpr::alloc(UpdateList(array, 0), getConstant(3, 32)).get(),
+            ReadExpr::alloc(UpdateList(array2, 0), getConstant(3, 32)).get());
+  EXPECT_NE(ExtractExpr::alloc(x, 8, 8).get(), ExtractExpr::alloc(x, 16, 8).get());
+  EXPECT_NE(ExtractExpr::alloc(x, 8, 8).get(), ExtractExpr::alloc(x, 8, 16).get());
+  EXPECT_NE(ZExtExpr::alloc(x, 64).get(), SExtExpr::alloc(x, 64).get());
+  EXPECT_NE(FCmpExpr::alloc(x, y, oeq, true).get(),
+            FCmpExpr::alloc(x, y, oeq, false).get());
+  EXPECT_NE(FAddExpr::alloc(x, y, true).get(), FAddExpr::alloc(x, y, false).get());
+  EXPECT_NE(FSqrtExpr::alloc(x, true).get(), FSqrtExpr::alloc(x, false).get());
+  EXPECT_NE(FOrd1Expr::alloc(x, true).get(), FOrd1Expr::alloc(x, false).get());
+  EXPECT_NE(FPToSIExpr::alloc(x, 32, false, true).get(),
+            FPToSIExpr::alloc(x, 32, false, false).get());
+  EXPECT_NE(FPToSIExpr::alloc(x, 32, false, true).get(),
+            FPToSIExpr::alloc(x, 32, true, true).get());
+  EXPECT_NE(FPToSIExpr::alloc(x, 32, false, true).get(),
+            FPToSIExpr::alloc(x, 16, false, true).get());
+  EXPECT_NE(FPExtExpr::alloc(x, &APFloat::IEEEdouble, false).get(),
+            FPExtExpr::alloc(x, &APFloat::IEEEdouble, true).get());
+  EXPECT_NE(FPExtExpr::alloc(x, &APFloat::IEEEdouble, false).get(),
+            FPExtExpr::alloc(x, &APFloat::x87DoubleExtended, false).get());
+  EXPECT_NE(SIToFPExpr::alloc(x, &APFloat::IEEEdouble).get(),
+            UIToFPExpr::alloc(x, &APFloat::IEEEdouble).get());
+  EXPECT_NE(AnyExpr::alloc(32, 7).get(), AnyExpr::alloc(32, 8).get());
+  EXPECT_NE(AnyExpr::alloc(32, 7).get(), AnyExpr::alloc(64, 7).get());
+}
+
+/***/
+
+/// checkUpdates - Extend an update list of \a array with writes at a few
+/// concrete indices, enough to be compacted several times, and at two
+/// symbolic ones, checking after each write what reads resolve to.
+void checkUpdates(const Array *array) {
+  Array *indices = new Array(array->name + "_idx", 4);
+  ref<Expr> symIndex = Expr::createTempRead(indices, 32);
+
+  UpdateList ul(array, 0);
+  std::map<unsigned, unsigned> latest;
+  const UpdateNode *lastSymbolic = 0;
+  for (unsigned step = 0; step != 60; ++step) {
+    if (step == 25 || step == 45) {
+      ul.extend(symIndex, getConstant(step, 8));
+      latest.clear();
+      lastSymbolic = ul.head;
+    } else {
+      unsigned index = (step * 3) % 5;
+      ul.extend(getConstant(index, 32), getConstant(step, 8));
+      latest[index] = step;
+    }
+
+    // The overwritten concrete writes are dropped once there are 16.
+    unsigned concrete = ul.getSize() - (lastSymbolic ? lastSymbolic->getSize() : 0);
+    EXPECT_GE(16U, concrete) << "step " << step;
+    EXPECT_LE(latest.size(), concrete) << "step " << step;
+
+    for (unsigned index = 0; index != 8; ++index) {
+      ref<Expr> read = ReadExpr::create(ul, getConstant(index, 32));
+      std::map<unsigned, unsigned>::iterator it = latest.find(index);
+      if (it != latest.end()) {
+        EXPECT_EQ(getConstant(it->second, 8), read)
+          << "step " << step << ", index " << index;
+      } else if (!lastSymbolic && array->isConstantArray()) {
+        EXPECT_EQ(ref<Expr>(array->constantValues[index]), read)
+          << "step " << step << ", index " << index;
+      } else {
+        // The read skips the concrete writes at other indices.
+        ASSERT_EQ(Expr::Read, read->getKind());
+        EXPECT_EQ(lastSymbolic, cast<ReadExpr>(read)->updates.head)
+          << "step " << step << ", index " << index;
+      }
+    }
+
+    // A read at a symbolic index resolves only through a write at the same
+    // index at the head.
+    ref<Expr> read = ReadExpr::create(ul, symIndex);
+    if (ul.head == lastSymbolic) {
+      EXPECT_EQ(getConstant(step, 8), read);
+    } else {
+      ASSERT_EQ(Expr::Read, read->getKind());
+      EXPECT_EQ(ul.head, cast<ReadExpr>(read)->updates.head);
+    }
+  }
+}
+
+TEST(ExprTest, UpdateCompaction) {
+  checkUpdates(new Array("arr12", 64));
+
+  std::vector< ref<ConstantExpr> > values;
+  for (unsigned i = 0; i != 64; ++i)
+    values.push_back(ConstantExpr::create(100 + i, 8));
+  checkUpdates(new Array("arr13", 64, &values[0], &values[0] + values.size()));
+}
+
+/***/
+
+TEST(ExprTest, SimplifyingBuilderFacts) {
+  ExprBuilder *b = createSimplifyingExprBuilder(createDefaultExprBuilder());
+  Array *array = new Array("arr14", 256);
+  ref<Expr> x8 = Expr::createTempRead(array, 8);
+  ref<Expr> z = b->ZExt(x8, 32), s = b->SExt(x8, 32);
+
+  // Masks clearing only known zero bits, or setting only known one bits.
+  EXPECT_EQ(z, b->And(b->Constant(0xff, 32), z));
+  EXPECT_EQ(z, b->And(z, b->Constant(0x1ff, 32)));
+  EXPECT_EQ(Expr::And, b->And(z, b->Constant(0x7f, 32))->getKind());
+  ref<Expr> o = b->Or(z, b->Constant(0x100, 32));
+  EXPECT_EQ(o, b->Or(b->Constant(0x100, 32), o));
+  EXPECT_EQ(Expr::Or, b->Or(b->Constant(0x200, 32), o)->getKind());
+
+  // Comparisons decided by the intervals.
+  EXPECT_EQ(b->True(), b->Ult(z, b->Constant(256, 32)));
+  EXPECT_EQ(b->False(), b->Ugt(z, b->Constant(255, 32)));
+  EXPECT_EQ(Expr::Ult, b->Ult(z, b->Constant(255, 32))->getKind());
+  EXPECT_EQ(b->True(), b->Slt(s, b->Constant(128, 32)));
+  EXPECT_EQ(b->True(), b->Sle(b->Constant(-128, 32), s));
+  EXPECT_EQ(b->False(), b->Slt(s, b->Constant(-128, 32)));
+  EXPECT_EQ(Expr::Slt, b->Slt(s, b->Constant(127, 32))->getKind());
+  EXPECT_EQ(b->False(), b->Eq(z, b->Constant(256, 32)));
+
+  // Extracts of known bits.
+  EXPECT_EQ(b->Constant(0, 8), b->Extract(z, 8, 8));
+  EXPECT_EQ(b->Constant(1, 1), b->Extract(o, 8, 1));
+  EXPECT_EQ(Expr::Extract, b->Extract(z, 4, 8)->getKind());
+
+  // Selects on a condition the facts fix, which was built unsimplified.
+  ref<Expr> t = Expr::createTempRead(array, 32);
+  ref<Expr> f = b->Add(t, b->Constant(1, 32));
+  EXPECT_EQ(t, b->Select(UltExpr::alloc(z, b->Constant(256, 32)), t, f));
+  EXPECT_EQ(f, b->Select(UltExpr::alloc(b->Constant(255, 32), z), t, f));
+  EXPECT_EQ(Expr::Select,
+            b->Select(UltExpr::alloc(z, b->Constant(255, 32)), t, f)->getKind());
+
+  delete b;
+}
+
+TEST(ExprTest, SimplifyingBuilderWrapAround) {
+  ExprBuilder *b = createSimplifyingExprBuilder(createDefaultExprBuilder());
+  Array *array = new Array("arr15", 256);
+  ref<Expr> x8 = Expr::createTempRead(array, 8);
+  ref<Expr> z = b->ZExt(x8, 32), z64 = b->ZExt(x8, 64);
+
+  // Without wrapping around, the sum is in [1, 256].
+  ref<Expr> inc = b->Add(z, b->Constant(1, 32));
+  EXPECT_EQ(b->True(), b->Ult(inc, b->Constant(257, 32)));
+  EXPECT_EQ(b->False(), b->Eq(inc, b->Constant(0, 32)));
+  ref<Expr> inc64 = b->Add(z64, b->Constant(1, 64));
+  EXPECT_EQ(b->True(), b->Ult(inc64, b->Constant(257, 64)));
+
+  // X + 0xffffff80 wraps around for X >= 0x80, so it may be below
+  // 0xffffff80.
+  ref<Expr> add = b->Add(z, b->Constant(0xffffff80, 32));
+  EXPECT_EQ(Expr::Ult, b->Ult(add, b->Constant(0xffffff80, 32))->getKind());
+  EXPECT_EQ(Expr::Ult, b->Ult(b->Constant(0x7f, 32), add)->getKind());
+  ref<Expr> add64 = b->Add(z64, b->Constant(0xffffffffffffff80ULL, 64));
+  EXPECT_EQ(Expr::Ult,
+            b->Ult(add64, b->Constant(0xffffffffffffff80ULL, 64))->getKind());
+  EXPECT_EQ(Expr::Slt, b->Slt(add64, b->Constant(0, 64))->getKind());
+
+  // (X + 2) * 2^24 is at least 2^25 unless it wraps around, which it
+  // does to 0 for X = 254.
+  ref<Expr> mul = b->Mul(b->Add(z, b->Constant(2, 32)),
+                         b->Constant(1 << 24, 32));
+  EXPECT_EQ(Expr::Eq, b->Eq(mul, b->Constant(0, 32))->getKind());
+  EXPECT_EQ(Expr::Ult, b->Ult(mul, b->Constant(1 << 25, 32))->getKind());
+  EXPECT_EQ(Expr::Extract, b->Extract(mul, 31, 1)->getKind());
+  ref<Expr> mul64 = b->Mul(b->Add(z64, b->Constant(2, 64)),
+                           b->Constant(1ULL << 56, 64));
+  EXPECT_EQ(Expr::Eq, b->Eq(mul64, b->Constant(0, 64))->getKind());
+  EXPECT_EQ(Expr::Slt, b->Slt(mul64, b->Constant(0, 64))->getKind());
+
+  // X - 1 is 0xffffffff for X = 0.
+  ref<Expr> dec = b->Sub(z, b->Constant(1, 32));
+  EXPECT_EQ(Expr::Ult, b->Ult(dec, b->Constant(255, 32))->getKind());
+  EXPECT_EQ(Expr::Extract, b->Extract(dec, 31, 1)->getKind());
+  ref<Expr> dec64 = b->Sub(z64, b->Constant(1, 64));
+  EXPECT_EQ(Expr::Ult, b->Ult(dec64, b->Constant(255, 64))->getKind());
+  EXPECT_EQ(Expr::Slt, b->Slt(dec64, b->Constant(0, 64))->getKind());
+  EXPECT_EQ(Expr::And,
+            b->And(dec64, b->Constant(0xff, 64))->getKind());
+
+  delete b;
+}
+
 }
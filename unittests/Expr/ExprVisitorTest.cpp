@@ -0,0 +1,131 @@
+//===-- ExprVisitorTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/util/ExprVisitor.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// The number of levels of the deep expressions, well past what the
+/// recursive walks used to overflow the stack on.
+const unsigned depth = 150000;
+
+/// buildChain - Build depth levels of Select and Add over \a x, on top of
+/// \a bottom. The value is bottom + x * depth / 2 as long as x < 10.
+ref<Expr> buildChain(ref<Expr> x, ref<Expr> bottom) {
+  ref<Expr> ten = ConstantExpr::alloc(10, Expr::Int32);
+  ref<Expr> e = bottom;
+  for (unsigned i = 0; i != depth / 2; ++i) {
+    e = SelectExpr::alloc(UltExpr::alloc(x, ten), e, x);
+    e = AddExpr::alloc(e, x);
+  }
+  return e;
+}
+
+/// CountingVisitor - Replaces one expression by another, recursively, and
+/// counts how often each expression is visited.
+class CountingVisitor : public ExprVisitor {
+  ref<Expr> src, dst;
+
+public:
+  ExprHashMap<unsigned> counts;
+
+  CountingVisitor(ref<Expr> _src, ref<Expr> _dst)
+    : ExprVisitor(true), src(_src), dst(_dst) {}
+
+  Action visitExpr(const Expr &e) {
+    ++counts[ref<Expr>(const_cast<Expr*>(&e))];
+    if (e == *src.get())
+      return Action::changeTo(dst);
+    return Action::doChildren();
+  }
+};
+
+TEST(ExprVisitorTest, DeepChain) {
+  Array *xa = new Array("vis0", 4), *ba = new Array("vis1", 4);
+  ref<Expr> x = Expr::createTempRead(xa, 32);
+  ref<Expr> bottom = Expr::createTempRead(ba, 32);
+  ref<Expr> chain = buildChain(x, bottom);
+
+  // The array only read at the bottom is found.
+  std::vector<const Array*> objects;
+  findSymbolicObjects(chain, objects);
+  ASSERT_EQ(2U, objects.size());
+  EXPECT_EQ(xa, objects[0]);
+  EXPECT_EQ(ba, objects[1]);
+
+  // Fixing x rewrites the constraint on the chain with ExprReplaceVisitor,
+  // and fixing the bottom as well folds the chain with ExprReplaceVisitor2.
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(chain, ConstantExpr::alloc(0xffffffff,
+                                                              Expr::Int32)));
+  cm.addConstraint(EqExpr::create(ConstantExpr::alloc(5, Expr::Int32), x));
+  // The equalities read x and the rewritten constraint only the bottom.
+  for (ConstraintManager::const_iterator it = cm.begin(), ie = cm.end();
+       it != ie; ++it) {
+    objects.clear();
+    findSymbolicObjects(*it, objects);
+    EXPECT_EQ(1U, objects.size());
+  }
+  cm.addConstraint(EqExpr::create(ConstantExpr::alloc(7, Expr::Int32),
+                                  bottom));
+  EXPECT_EQ(ref<Expr>(ConstantExpr::alloc(7 + 5 * (depth / 2), Expr::Int32)),
+            cm.simplifyExpr(chain));
+}
+
+TEST(ExprVisitorTest, RecursiveVisitsOnce) {
+  Array *xa = new Array("vis2", 4), *ya = new Array("vis3", 4);
+  ref<Expr> x = Expr::createTempRead(xa, 32);
+  ref<Expr> y = Expr::createTempRead(ya, 32);
+  ref<Expr> chain = buildChain(x, x);
+
+  // Every node of the chain is rebuilt, and each rebuilt node is visited
+  // again; no expression is visited twice.
+  CountingVisitor visitor(x, y);
+  ref<Expr> result = visitor.visit(chain);
+  std::vector<const Array*> objects;
+  findSymbolicObjects(result, objects);
+  ASSERT_EQ(1U, objects.size());
+  EXPECT_EQ(ya, objects[0]);
+  for (ExprHashMap<unsigned>::iterator it = visitor.counts.begin(),
+         ie = visitor.counts.end(); it != ie; ++it)
+    ASSERT_EQ(1U, it->second);
+}
+
+TEST(ExprVisitorTest, NestedUpdates) {
+  // Each read is the value written by the update list of the next one, so
+  // walking the update lists nests as deep as the chain. Fewer levels than
+  // above do, as freeing the nest still recurses once per level.
+  const unsigned nestedDepth = 50000;
+  Array *ba = new Array("vis4", 4), *ua = new Array("vis5", 4);
+  ref<Expr> zero = ConstantExpr::alloc(0, Expr::Int32);
+  ref<Expr> e = ReadExpr::alloc(UpdateList(ba, 0), zero);
+  for (unsigned i = 0; i != nestedDepth; ++i) {
+    UpdateList ul(ua, 0);
+    ul.extend(zero, e);
+    e = ReadExpr::alloc(ul, zero);
+  }
+
+  std::vector<const Array*> objects;
+  findSymbolicObjects(e, objects);
+  ASSERT_EQ(2U, objects.size());
+  EXPECT_EQ(ua, objects[0]);
+  EXPECT_EQ(ba, objects[1]);
+}
+
+}